@@ -0,0 +1,241 @@
+// Client of the adapter's management port (UART=1 builds, protocol in src/mgmt.h).
+//
+//   akabctl [-d device] [-b baud] command [arguments]
+//
+// device is a serial port wired to the adapter's PD0/PD1 (/dev/ttyUSB0 by default), or the
+// pty that host/mgmt_sim prints. Commands:
+//   ping                             protocol version, output and receiver of the firmware
+//   options [chord=0|1] [caps=0|1]   shows the converter options, or changes some
+//   map CODE [e] [KEY]               shows, or sets, the key code PS/2 scancode CODE converts to
+//                                    (hex; e: E0 prefixed). KEY ff disables the key
+//   unmap                            every key back to the conversion table
+//   counters                         dumps the counters
+//   reinit                           releases the held keys on the host and resets the keyboard
+// Exits with 1 when the adapter does not answer or refuses the command.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <util/crc16.h>
+
+#include "mgmt.h"
+#include "ps2_converter.h"
+
+#define REPLY_TIMEOUT_MS 500
+#define TRIES            3
+
+static const char * const status_names[] = { "ok", "unknown command", "bad argument", "keys held", "remap table full" };
+static const char * const counter_names[MGMT_CNT_COUNT] = {
+	"frames", "frame errors", "uart errors", "stack free", "latency max us", "restarts",
+	"repeats shed", "macros shed", "presses dropped", "overflows", "overruns"
+};
+
+static int fd;
+static uint8_t reply[MGMT_PAYLOAD_MAX];
+static uint8_t reply_length;
+
+static speed_t ctl_speed(unsigned long baud) {
+	switch (baud) {
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+	}
+	fprintf(stderr, "akabctl: unsupported baud rate %lu\n", baud);
+	exit(2);
+}
+
+static int ctl_open(const char *device, unsigned long baud) {
+	struct termios tio;
+
+	fd = open(device, O_RDWR | O_NOCTTY);
+	if (fd < 0 || tcgetattr(fd, &tio)) {
+		perror(device);
+		return 0;
+	}
+
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, ctl_speed(baud));
+	cfsetospeed(&tio, ctl_speed(baud));
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	tcsetattr(fd, TCSANOW, &tio);
+	tcflush(fd, TCIOFLUSH);
+
+	return 1;
+}
+
+static int ctl_readByte(uint8_t *c, int timeout_ms) {
+	struct pollfd pfd = { fd, POLLIN, 0 };
+
+	if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+	return read(fd, c, 1) == 1;
+}
+
+// Waits for the reply to command: 1 with its payload (status first) in reply
+static int ctl_reply(uint8_t command) {
+	uint8_t c, length, cmd, idx;
+	uint16_t crc;
+
+	for (;;) {
+		do {
+			if (!ctl_readByte(&c, REPLY_TIMEOUT_MS)) return 0;
+		} while (c != MGMT_SOF);
+
+		if (!ctl_readByte(&length, REPLY_TIMEOUT_MS) || length > MGMT_PAYLOAD_MAX) continue;
+		if (!ctl_readByte(&cmd, REPLY_TIMEOUT_MS)) return 0;
+		crc = _crc_xmodem_update(_crc_xmodem_update(0, length), cmd);
+
+		for (idx = 0; idx < length; idx++) {
+			if (!ctl_readByte(&reply[idx], REPLY_TIMEOUT_MS)) return 0;
+			crc = _crc_xmodem_update(crc, reply[idx]);
+		}
+		if (!ctl_readByte(&c, REPLY_TIMEOUT_MS) || c != (crc & 0xFF)) continue;
+		if (!ctl_readByte(&c, REPLY_TIMEOUT_MS) || c != (crc >> 8)) continue;
+
+		if (cmd != (command | MGMT_REPLY) || !length) continue; // Late answer to an earlier try
+		reply_length = length;
+		return 1;
+	}
+}
+
+// Sends a command until it is answered. Returns 1 with an ok status
+static int ctl_command(uint8_t command, const uint8_t *payload, uint8_t length) {
+	uint8_t frame[MGMT_FRAME_MAX];
+	uint16_t crc = 0;
+	uint8_t idx, size = 0;
+
+	frame[size++] = MGMT_SOF;
+	frame[size++] = length;
+	frame[size++] = command;
+	memcpy(&frame[size], payload, length);
+	size += length;
+	for (idx = 1; idx < size; idx++) crc = _crc_xmodem_update(crc, frame[idx]);
+	frame[size++] = crc & 0xFF;
+	frame[size++] = crc >> 8;
+
+	for (int attempt = 0; attempt < TRIES; attempt++) {
+		if (write(fd, frame, size) != size) {
+			perror("akabctl: write");
+			return 0;
+		}
+		if (!ctl_reply(command)) continue;
+
+		if (reply[0] != MGMT_OK) {
+			fprintf(stderr, "akabctl: %s\n", reply[0] < sizeof(status_names) / sizeof(status_names[0]) ? status_names[reply[0]] : "error");
+			return 0;
+		}
+		return 1;
+	}
+
+	fprintf(stderr, "akabctl: no answer\n");
+	return 0;
+}
+
+static int ctl_options(int argc, char **argv) {
+	uint8_t options;
+
+	if (!ctl_command(MGMT_CMD_GET_OPTIONS, NULL, 0)) return 0;
+	options = reply[1];
+
+	if (argc) {
+		for (int idx = 0; idx < argc; idx++) {
+			uint8_t bit;
+
+			if (!strncmp(argv[idx], "chord=", 6)) bit = PS2K_OPT_RESET_CHORD;
+			else if (!strncmp(argv[idx], "caps=", 5)) bit = PS2K_OPT_CAPS_LATCH;
+			else {
+				fprintf(stderr, "akabctl: unknown option %s\n", argv[idx]);
+				return 0;
+			}
+
+			if (atoi(strchr(argv[idx], '=') + 1)) options |= bit;
+			else options &= ~bit;
+		}
+		if (!ctl_command(MGMT_CMD_SET_OPTIONS, &options, 1)) return 0;
+	}
+
+	printf("chord=%d caps=%d\n", !!(options & PS2K_OPT_RESET_CHORD), !!(options & PS2K_OPT_CAPS_LATCH));
+	return 1;
+}
+
+static int ctl_map(int argc, char **argv) {
+	uint8_t args[3];
+	int idx = 0;
+
+	if (!argc) return -1;
+
+	args[0] = strtoul(argv[idx++], NULL, 16);
+	args[1] = idx < argc && !strcmp(argv[idx], "e");
+	if (args[1]) idx++;
+
+	if (idx < argc) {
+		args[2] = strtoul(argv[idx], NULL, 16);
+		if (!ctl_command(MGMT_CMD_SET_MAP, args, 3)) return 0;
+	}
+
+	if (!ctl_command(MGMT_CMD_GET_MAP, args, 2)) return 0;
+	printf("%s%02X -> %02X\n", args[1] ? "E0 " : "", args[0], reply[1]);
+	return 1;
+}
+
+static int ctl_counters(void) {
+	if (!ctl_command(MGMT_CMD_COUNTERS, NULL, 0)) return 0;
+
+	for (uint8_t idx = 0; idx < reply[1] && 2 + 2 * idx + 1 < reply_length; idx++) {
+		uint16_t value = reply[2 + 2 * idx] | (reply[3 + 2 * idx] << 8);
+
+		if (idx < MGMT_CNT_COUNT) printf("%-15s %u\n", counter_names[idx], value);
+		else printf("counter %-7u %u\n", idx, value);
+	}
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	const char *device = "/dev/ttyUSB0";
+	unsigned long baud = 38400;
+	int opt = 1, ok = -1;
+	const char *cmd;
+
+	for (; opt + 1 < argc && argv[opt][0] == '-'; opt += 2) {
+		if (!strcmp(argv[opt], "-d")) device = argv[opt + 1];
+		else if (!strcmp(argv[opt], "-b")) baud = strtoul(argv[opt + 1], NULL, 0);
+	}
+	if (opt >= argc) {
+		fprintf(stderr, "usage: akabctl [-d device] [-b baud] ping|options|map|unmap|counters|reinit [arguments]\n");
+		return 2;
+	}
+	cmd = argv[opt++];
+
+	if (!ctl_open(device, baud)) return 1;
+
+	if (!strcmp(cmd, "ping")) {
+		ok = ctl_command(MGMT_CMD_PING, NULL, 0);
+		if (ok) printf("version %u, %s output, %s receiver\n", reply[1], reply[2] ? "PC/XT" : "Amiga", reply[3] ? "input capture" : "INT0");
+	} else if (!strcmp(cmd, "options")) {
+		ok = ctl_options(argc - opt, argv + opt);
+	} else if (!strcmp(cmd, "map")) {
+		ok = ctl_map(argc - opt, argv + opt);
+	} else if (!strcmp(cmd, "unmap")) {
+		ok = ctl_command(MGMT_CMD_CLEAR_MAPS, NULL, 0);
+	} else if (!strcmp(cmd, "counters")) {
+		ok = ctl_counters();
+	} else if (!strcmp(cmd, "reinit")) {
+		ok = ctl_command(MGMT_CMD_KEYB_INIT, NULL, 0);
+	}
+
+	if (ok < 0) {
+		fprintf(stderr, "akabctl: bad command line\n");
+		return 2;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+// Throughput benchmark of the translation path, on the host.
+//
+//   bench [-n keystrokes] [-m max_ns]
+//
+// Replays random keystrokes (make then break of a mapped key) three ways:
+//   wire:   clock and data edges through the INT0 handler, the decoder, the converter and the queue
+//   conv:   scancode sequences straight into the converter
+//   stream: the PS/2 bytes of all the keystrokes, as a capture, through convcore_stream() in
+//           one go: the converter core alone, as host tools use it
+// and prints the cost per keystroke and the key events (makes and breaks) per second. With -m,
+// exits with 1 if the wire path costs more than max_ns per keystroke: a coarse regression check,
+// to be set from a run on the same machine.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "convtable.h"
+#include "ps2_converter.h"
+#include "conv_core.h"
+#include "ps2_proto.h"
+
+#define BENCH_ACTIONS 4096 // Per convcore_stream() call
+
+typedef struct {
+	uint8_t code;
+	uint8_t extended;
+} bench_key_t;
+
+static bench_key_t keys[256];
+static uint16_t key_count;
+static unsigned long codes_out;
+
+static void bench_code(uint8_t code) {
+	codes_out++;
+}
+
+static const sim_sink_t bench_sink = { bench_code, NULL, NULL };
+
+static void bench_addKey(uint8_t code, uint8_t extended, uint8_t key_code) {
+	if (key_code == CONV_UNMAPPED || key_code == CONV_RESET_CODE || key_code == CONV_READOUT_CODE) return;
+
+	keys[key_count].code = code;
+	keys[key_count].extended = extended;
+	key_count++;
+}
+
+static void bench_keys(void) {
+	const uint8_t *entry;
+
+	for (uint16_t code = 1; code < CONV_NORMAL_SIZE; code++) bench_addKey(code, 0, pgm_read_byte(&ps2_normal_convtable[code]));
+	for (entry = ps2_extended_convtable; pgm_read_byte(entry); entry += 2) bench_addKey(pgm_read_byte(entry), 1, pgm_read_byte(entry + 1));
+}
+
+static double bench_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_wire(const bench_key_t *key) {
+	if (key->extended) sim_sendByte(PS2_SCANCODE_EXTENDED);
+	sim_sendByte(key->code);
+	sim_task();
+
+	if (key->extended) sim_sendByte(PS2_SCANCODE_EXTENDED);
+	sim_sendByte(PS2_SCANCODE_RELEASE);
+	sim_sendByte(key->code);
+	sim_task();
+}
+
+static void bench_conv(const bench_key_t *key) {
+	uint8_t seq[3];
+
+	if (key->extended) {
+		seq[0] = PS2_SCANCODE_EXTENDED;
+		seq[1] = key->code;
+		ps2k_callback(0, seq, 1);
+		sim_task();
+		seq[1] = PS2_SCANCODE_RELEASE;
+		seq[2] = key->code;
+		ps2k_callback(0, seq, 2);
+	} else {
+		seq[0] = key->code;
+		ps2k_callback(0, seq, 0);
+		sim_task();
+		seq[0] = PS2_SCANCODE_RELEASE;
+		seq[1] = key->code;
+		ps2k_callback(0, seq, 1);
+	}
+	sim_task();
+}
+
+static double bench_run(const char *name, void (*keystroke)(const bench_key_t *), unsigned long count) {
+	double start, ns;
+
+	sim_init(&bench_sink);
+	codes_out = 0;
+	srand(1);
+
+	start = bench_now();
+	for (unsigned long idx = 0; idx < count; idx++) keystroke(&keys[rand() % key_count]);
+	sim_drain();
+	ns = (bench_now() - start) / count;
+
+	printf("%-6s %9lu keystrokes %9lu codes out %8.1f ns/keystroke %10.0f events/s\n",
+		name, count, codes_out, ns, 2e9 / ns);
+
+	return ns;
+}
+
+static void bench_stream(unsigned long count) {
+	static convcore_action_t actions[BENCH_ACTIONS];
+	convcore_t ctx;
+	uint8_t *capture = malloc(count * 5); // E0 code E0 F0 code at most
+	size_t length = 0, pos, done;
+	double start, ns;
+
+	if (!capture) return;
+
+	srand(1);
+	for (unsigned long idx = 0; idx < count; idx++) {
+		const bench_key_t *key = &keys[rand() % key_count];
+
+		if (key->extended) capture[length++] = PS2_SCANCODE_EXTENDED;
+		capture[length++] = key->code;
+		if (key->extended) capture[length++] = PS2_SCANCODE_EXTENDED;
+		capture[length++] = PS2_SCANCODE_RELEASE;
+		capture[length++] = key->code;
+	}
+
+	convcore_init(&ctx);
+	codes_out = 0;
+
+	start = bench_now();
+	for (pos = 0; pos < length; pos += done) {
+		size_t actions_out;
+
+		done = convcore_stream(&ctx, 0, capture + pos, length - pos, actions, BENCH_ACTIONS, &actions_out);
+		for (size_t idx = 0; idx < actions_out; idx++) codes_out += actions[idx].type == CONVCORE_CODE;
+	}
+	ns = (bench_now() - start) / count;
+
+	printf("%-6s %9lu keystrokes %9lu codes out %8.1f ns/keystroke %10.0f events/s %8.1f MB/s\n",
+		"stream", count, codes_out, ns, 2e9 / ns, length / (ns * count / 1e3));
+
+	free(capture);
+}
+
+int main(int argc, char **argv) {
+	unsigned long count = 2000000;
+	double max_ns = 0, wire_ns;
+	int opt;
+
+	for (opt = 1; opt + 1 < argc; opt += 2) {
+		if (!strcmp(argv[opt], "-n")) count = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-m")) max_ns = atof(argv[opt + 1]);
+	}
+
+	bench_keys();
+	printf("%u mapped keys\n", key_count);
+
+	wire_ns = bench_run("wire", bench_wire, count);
+	bench_run("conv", bench_conv, count);
+	bench_stream(count);
+
+	if (max_ns > 0 && wire_ns > max_ns) {
+		printf("FAIL: wire path %.1f ns/keystroke, limit %.1f\n", wire_ns, max_ns);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,315 @@
+// Keyboard start up time, on the host: the reset of the old start up against kbprof_boot().
+//
+//   boot [-n boots] [-s seed]
+//
+// Runs the real keyboard profile code (keyb_profile.c, EEPROM cache included) against simulated
+// keyboards, with simulated time: _delay_ms(), the EEPROM writes and the PS/2 exchanges move a
+// microsecond clock forward. ps2keyb_query(), ps2keyb_readByte() and ps2keyb_sendCommand() are
+// played here, on the timings of ps2_keyb.c: a byte is clocked in 100us after the request to send,
+// 80us a bit, and a keyboard in its self test does not clock at all. Every boot is a power on
+// of the adapter and the keyboard together, at 0, then main()'s 50ms wait. Rows:
+//   legacy   the old start up: PS2_HTD_RESET, the keyboard ready after its second self test
+//   first    kbprof_boot() with an erased EEPROM: every keyboard is new
+//   known    kbprof_boot() on the first KBPROF_SLOTS keyboards, all in the cache already
+//   mixed    kbprof_boot() on all the keyboards, more than the cache holds
+// each one a keyboard drawn at random for every boot. Prints what kbprof_boot() did, the time from
+// power on to the keyboard ready (out of its self test, set up), the EEPROM bytes written, the longest
+// the watchdog went without a kick, and:
+//   wrong    keyboards left in a scancode set other than 2, not scanning, with LEDs on,
+//            or with another typematic rate than the build asks for
+// Exits with 1 if a kbprof_boot() row has any wrong, a known keyboard probed again,
+// or a watchdog gap of WDOG_GAP_MAX_MS or more.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps2_keyb.h"
+#include "ps2_proto.h"
+#include "keyb_profile.h"
+
+#define BIT_US       80  // Clock period
+#define RTS_US       100 // As PS2_RTS_US in ps2_keyb.c
+#define HTD_US       (RTS_US + 12 * BIT_US) // Host to device byte, request to send and ack bit included
+#define DTH_US       (11 * BIT_US)
+#define GAP_US       100 // Between the bytes of an answer
+#define CLOCK_MS     15  // ps2_keyb.c: PS2_CLOCK_MS
+#define ANSWER_MS    20  // ... PS2_ANSWER_MS
+#define READY_MS     15  // ... PS2_READY_MS
+#define START_MS     50  // main(): the wait on a cold start
+#define TYPEMATIC_DEFAULT 0x2B // 10.9 per second, after 500ms
+#define TYPEMATIC_SLOW    0x7F // keyb_profile.c: KBPROF_TYPEMATIC_RATE
+#define WDOG_GAP_MAX_MS   500  // Half of WDOG_TIMEOUT: the watchdog oscillator is not that accurate
+
+typedef struct {
+	const char *name;
+	uint8_t id[2], id_length;
+	uint8_t power_set; // Scancode set at power on and after a reset
+	uint8_t set_query; // Takes PS2_HTD_SCANCODESET, else asks for a resend
+	uint8_t typematic; // Takes PS2_HTD_TYPEMATIC, else asks for a resend
+	uint16_t bat_min_ms, bat_max_ms; // Self test
+	uint16_t ack_min_us, ack_max_us; // From the end of a command byte to the start of its answer
+} kb_model_t;
+
+static const kb_model_t models[] = {
+	{ "mf2",      { 0xAB, 0x83 }, 2, 2, 1, 1, 500, 750, 300, 1500 },
+	{ "laptop",   { 0xAB, 0x84 }, 2, 2, 1, 1, 250, 400, 200, 800 },
+	{ "at",       { 0x00, 0x00 }, 0, 2, 0, 1, 400, 600, 500, 2000 },
+	{ "terminal", { 0xAB, 0x86 }, 2, 3, 1, 1, 600, 750, 500, 3000 }, // Powers up in set 3
+	{ "budget",   { 0xAB, 0x85 }, 2, 2, 1, 0, 500, 700, 1000, 5000 },
+	{ "kvm",      { 0xAB, 0x87 }, 2, 2, 0, 1, 150, 300, 3000, 12000 },
+};
+#define MODEL_COUNT (sizeof(models) / sizeof(models[0]))
+
+enum { ROW_LEGACY, ROW_FIRST, ROW_KNOWN, ROW_MIXED, ROW_COUNT };
+static const char * const row_names[] = { "legacy", "first", "known", "mixed" };
+
+extern uint8_t __start_sim_eeprom[], __stop_sim_eeprom[];
+uint32_t sim_eepromWrites;
+
+static uint64_t now; // us
+static uint64_t last_kick, kick_gap;
+
+// The keyboard
+static const kb_model_t *model;
+static uint64_t bat_end; // Out of its self test then...
+static uint8_t bat_pending; // ... and sends 0xAA, unless a command comes first
+static uint8_t kb_set, kb_enabled, kb_leds, kb_rate;
+static uint8_t kb_arg; // Command waiting for its argument, 0 if none
+static uint8_t kb_out[3], kb_outCount; // Answer to the last byte
+
+void sim_delayUs(uint32_t us) {
+	now += us;
+}
+
+void sim_wdtReset(void) {
+	if (now - last_kick > kick_gap) kick_gap = now - last_kick;
+	last_kick = now;
+}
+
+static uint32_t kb_random(uint32_t min, uint32_t max) {
+	return min + rand() % (max - min + 1);
+}
+
+static void kb_selfTest(void) {
+	bat_end = now + 1000UL * kb_random(model->bat_min_ms, model->bat_max_ms);
+	bat_pending = 1;
+	kb_set = model->power_set;
+	kb_enabled = 1;
+	kb_leds = 0;
+	kb_rate = TYPEMATIC_DEFAULT;
+	kb_arg = 0;
+}
+
+static void kb_answer(uint8_t code) {
+	kb_out[kb_outCount++] = code;
+}
+
+static void kb_command(uint8_t code) {
+	uint8_t command = kb_arg;
+
+	kb_outCount = 0;
+	kb_arg = 0;
+
+	switch (command) {
+		case PS2_HTD_LEDCONTROL:
+			kb_leds = code;
+			kb_answer(PS2_SCANCODE_ACK);
+			return;
+		case PS2_HTD_TYPEMATIC:
+			kb_rate = code;
+			kb_answer(PS2_SCANCODE_ACK);
+			return;
+		case PS2_HTD_SCANCODESET:
+			if (code > 3) {
+				kb_answer(PS2_SCANCODE_RESEND);
+			} else {
+				kb_answer(PS2_SCANCODE_ACK);
+				if (code) kb_set = code;
+				else kb_answer(kb_set);
+			}
+			return;
+	}
+
+	switch (code) {
+		case PS2_HTD_SCANCODESET:
+		case PS2_HTD_TYPEMATIC:
+			if ((code == PS2_HTD_SCANCODESET && !model->set_query) || (code == PS2_HTD_TYPEMATIC && !model->typematic)) {
+				kb_answer(PS2_SCANCODE_RESEND);
+				break;
+			}
+			// Fall through
+		case PS2_HTD_LEDCONTROL:
+			kb_answer(PS2_SCANCODE_ACK);
+			kb_arg = code;
+			break;
+		case PS2_HTD_READID:
+			kb_answer(PS2_SCANCODE_ACK);
+			for (uint8_t idx = 0; idx < model->id_length; idx++) kb_answer(model->id[idx]);
+			break;
+		case PS2_HTD_ENABLE:
+			kb_enabled = 1;
+			kb_answer(PS2_SCANCODE_ACK);
+			break;
+		case PS2_HTD_RESET:
+			kb_answer(PS2_SCANCODE_ACK);
+			kb_selfTest(); // Counted from the ACK, added below
+			bat_end += DTH_US;
+			break;
+		default:
+			kb_answer(PS2_SCANCODE_RESEND);
+			break;
+	}
+}
+
+// A host-to-device byte, if the keyboard clocks it within wait_us of the request to send (0: whenever it does)
+static uint8_t kb_receive(uint8_t code, uint32_t wait_us) {
+	now += RTS_US;
+	if (wait_us && bat_end > now + wait_us) {
+		now += wait_us;
+		return 0;
+	}
+	if (bat_end > now) now = bat_end;
+
+	bat_pending = 0; // Sent while nobody listened, or held back for good
+	now += HTD_US - RTS_US;
+	kb_command(code);
+
+	return 1;
+}
+
+uint8_t ps2keyb_query(const uint8_t *command, uint8_t length, uint8_t *reply, uint8_t replyLength) {
+	uint8_t count = 0, next = 0;
+
+	for (uint8_t idx = 0; idx < length; idx++) {
+		if (!kb_receive(command[idx], CLOCK_MS * 1000UL)) return PS2KEYB_NOACK;
+
+		now += kb_random(model->ack_min_us, model->ack_max_us) + DTH_US;
+		if (kb_out[0] != PS2_SCANCODE_ACK) return PS2KEYB_NOACK;
+		next = 1;
+	}
+
+	while (count < replyLength) {
+		if (next >= kb_outCount) {
+			now += ANSWER_MS * 1000UL;
+			break;
+		}
+		now += GAP_US + DTH_US;
+		reply[count++] = kb_out[next++];
+	}
+
+	return count;
+}
+
+uint8_t ps2keyb_readByte(uint8_t *value, uint8_t timeout_ms) {
+	if (!bat_pending || bat_end > now + timeout_ms * 1000UL) {
+		now += timeout_ms * 1000UL;
+		return 0;
+	}
+
+	if (bat_end > now) now = bat_end;
+	now += DTH_US;
+	bat_pending = 0;
+	*value = PS2_SCANCODE_BAT_OK;
+
+	return 1;
+}
+
+void ps2keyb_sendCommand(uint8_t *command, uint8_t length) {
+	for (uint8_t idx = 0; idx < length; idx++) {
+		kb_receive(command[idx], 0); // The real sender waits for the clock as long as it takes
+		now += READY_MS * 1000UL; // The answer goes to the receiver interrupt, still off
+	}
+}
+
+static void eeprom_erase(void) {
+	memset(__start_sim_eeprom, 0xFF, __stop_sim_eeprom - __start_sim_eeprom);
+}
+
+// A power on with the keyboard of models[which]. Returns what kbprof_boot() did, KBPROF_ABSENT + 1 for
+// the old start up, and sets *ready_us. *wrong is set if the keyboard is not left as the firmware wants it
+static uint8_t boot(uint8_t legacy, uint8_t which, uint64_t *ready_us, uint8_t *wrong) {
+	uint8_t command = PS2_HTD_RESET;
+	uint8_t rate = TYPEMATIC_DEFAULT;
+	uint8_t done;
+
+	model = &models[which];
+	now = last_kick = 0;
+	kb_selfTest();
+
+	now += START_MS * 1000UL;
+	if (legacy) {
+		ps2keyb_sendCommand(&command, 1);
+		done = KBPROF_ABSENT + 1;
+	} else {
+		done = kbprof_boot();
+#if !defined (AKAB_OUTPUT_XT)
+		if (model->typematic) rate = TYPEMATIC_SLOW;
+#endif
+	}
+	sim_wdtReset();
+
+	*ready_us = now > bat_end ? now : bat_end;
+	*wrong = kb_set != 2 || !kb_enabled || kb_leds || kb_rate != rate;
+
+	return done;
+}
+
+int main(int argc, char **argv) {
+	unsigned long boots = 1000;
+	unsigned int seed = 1;
+	int failed = 0;
+
+	for (int opt = 1; opt + 1 < argc; opt += 2) {
+		if (!strcmp(argv[opt], "-n")) boots = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-s")) seed = strtoul(argv[opt + 1], NULL, 0);
+	}
+
+	printf("%lu boots per row, %u keyboards (%u in the known row), %u cache slots, seed %u\n\n",
+		boots, (unsigned int)MODEL_COUNT, KBPROF_SLOTS, KBPROF_SLOTS, seed);
+	printf("%-8s %7s %7s %7s %7s %9s %9s %8s %9s %6s\n",
+		"row", "boots", "cached", "probed", "absent", "avg ms", "max ms", "eeprom", "wdog ms", "wrong");
+
+	for (uint8_t row = 0; row < ROW_COUNT; row++) {
+		unsigned long outcomes[KBPROF_ABSENT + 2] = { 0 };
+		unsigned long wrong_count = 0;
+		uint64_t total_us = 0, max_us = 0, ready_us;
+		uint8_t models_used = row == ROW_KNOWN ? KBPROF_SLOTS : MODEL_COUNT;
+		uint8_t wrong;
+
+		srand(seed);
+		eeprom_erase();
+		if (row == ROW_KNOWN) {
+			for (uint8_t which = 0; which < models_used; which++) boot(0, which, &ready_us, &wrong);
+		}
+		sim_eepromWrites = 0;
+		kick_gap = 0;
+
+		for (unsigned long n = 0; n < boots; n++) {
+			if (row == ROW_FIRST) eeprom_erase();
+
+			outcomes[boot(row == ROW_LEGACY, rand() % models_used, &ready_us, &wrong)]++;
+			wrong_count += wrong;
+			total_us += ready_us;
+			if (ready_us > max_us) max_us = ready_us;
+		}
+
+		printf("%-8s %7lu %7lu %7lu %7lu %9.1f %9.1f %8lu",
+			row_names[row], boots, outcomes[KBPROF_CACHED], outcomes[KBPROF_PROBED], outcomes[KBPROF_ABSENT],
+			boots ? total_us / 1000.0 / boots : 0.0, max_us / 1000.0, (unsigned long)sim_eepromWrites);
+		if (row == ROW_LEGACY) {
+			printf(" %9s %6lu\n", "-", wrong_count); // Keyboards starting in another set stay there
+			continue;
+		}
+		printf(" %9.1f %6lu", kick_gap / 1000.0, wrong_count);
+
+		if (wrong_count || (row == ROW_KNOWN && outcomes[KBPROF_PROBED]) || kick_gap >= WDOG_GAP_MAX_MS * 1000UL) {
+			printf("  FAIL");
+			failed = 1;
+		}
+		printf("\n");
+	}
+
+	return failed;
+}
@@ -0,0 +1,297 @@
+// Fault injection benchmark of the PS/2 receive path, on the host.
+//
+//   faults [-n keystrokes] [-r rate] [-j jitter_us] [-s seed] [-t max_bad | -t kind=max_bad,...]
+//
+// Types random keystrokes (make, then break) on a simulated keyboard with 12.5kHz clock
+// and timed edges, once per fault kind, injecting faults in a fraction (rate) of the frames:
+//   glitch  a 2us low pulse on the clock, somewhere in the frame: one spurious bit
+//   drop    one clock pulse missing: one bit less
+//   flip    one bit with the wrong data level
+//   jitter  every clock edge of the frame moved by up to +/- jitter_us: a falling edge
+//           that moves before the data change samples the previous bit
+//   mixed   any of the above
+// and reports, against what the host should have seen:
+//   frames lost     frames sent minus valid frames accepted by the decoder, per thousand sent
+//   keys dropped    keystrokes the host did not see at all, per thousand
+//   keys corrupted  keystrokes the host saw wrong (missing half, other keys), per thousand
+//   recovery        simulated time from a fault to the next keystroke seen right: average,
+//                   worst, and the faults never recovered from until the end of the run
+// With -t, exits with 1 if a row has more than max_bad dropped + corrupted keys per thousand:
+// every row with -t N, only the rows named with -t none=0,flip=80 (rows not named are not checked).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "convtable.h"
+#include "ps2_converter.h"
+#include "ps2_proto.h"
+
+#define BIT_US        80    // 12.5kHz
+#define DATA_US       10    // Data changes this long after the rising edge...
+#define FALL_US       40    // ... and is read on the falling edge
+#define GLITCH_US     2
+#define BYTE_GAP_US   200   // Between the bytes of a sequence
+#define KEY_HOLD_US   50000 // Make to break
+#define KEY_GAP_US    50000 // Break to the next make
+
+#define MAX_EVENTS 64
+#define MAX_CODES  16
+
+enum { FAULT_NONE, FAULT_GLITCH, FAULT_DROP, FAULT_FLIP, FAULT_JITTER, FAULT_MIXED };
+static const char * const fault_names[] = { "none", "glitch", "drop", "flip", "jitter", "mixed" };
+
+typedef struct {
+	uint32_t t;
+	uint8_t clock; // Which line
+	uint8_t level;
+} line_event_t;
+
+typedef struct {
+	uint8_t code;
+	uint8_t extended;
+} fault_key_t;
+
+static fault_key_t keys[256];
+static uint16_t key_count;
+
+static uint32_t now; // Simulated time, us
+static uint8_t clock_level, data_level;
+
+static uint8_t seen[MAX_CODES];
+static uint8_t seen_count;
+static uint8_t seen_overflow;
+
+static double rate = 0.01;
+static uint32_t jitter_us = 45;
+
+static void fault_code(uint8_t code) {
+	if (seen_count < MAX_CODES) seen[seen_count++] = code;
+	else seen_overflow = 1;
+}
+
+static const sim_sink_t fault_sink = { fault_code, NULL, NULL };
+
+static void fault_addKey(uint8_t code, uint8_t extended, uint8_t key_code) {
+	// Plain keys only: no macros, resets or locks, so every keystroke is one make and one break
+	if (key_code == CONV_UNMAPPED || key_code == CONV_RESET_CODE || key_code == CONV_READOUT_CODE) return;
+	if (CONV_IS_MACRO(key_code) || key_code == CONV_CAPSLOCK_CODE) return;
+
+	keys[key_count].code = code;
+	keys[key_count].extended = extended;
+	key_count++;
+}
+
+static void fault_keys(void) {
+	const uint8_t *entry;
+
+	for (uint16_t code = 1; code < CONV_NORMAL_SIZE; code++) fault_addKey(code, 0, pgm_read_byte(&ps2_normal_convtable[code]));
+	for (entry = ps2_extended_convtable; pgm_read_byte(entry); entry += 2) fault_addKey(pgm_read_byte(entry), 1, pgm_read_byte(entry + 1));
+}
+
+static uint8_t fault_convert(const fault_key_t *key) {
+	const uint8_t *entry = ps2_extended_convtable;
+
+	if (!key->extended) return pgm_read_byte(&ps2_normal_convtable[key->code]);
+
+	while (pgm_read_byte(entry) != key->code) entry += 2;
+	return pgm_read_byte(entry + 1);
+}
+
+static int fault_cmp(const void *a, const void *b) {
+	const line_event_t *ea = a, *eb = b;
+
+	if (ea->t != eb->t) return ea->t < eb->t ? -1 : 1;
+	return (ea > eb) - (ea < eb); // Keep the generation order: data before clock at the same time
+}
+
+static int32_t fault_jitter(void) {
+	return (int32_t)(rand() % (2 * jitter_us + 1)) - (int32_t)jitter_us;
+}
+
+// One frame on the lines, with the given fault. Returns 1 if a fault was injected
+static uint8_t fault_sendByte(uint8_t value, uint8_t fault) {
+	line_event_t ev[MAX_EVENTS];
+	uint8_t count = 0, idx;
+	uint16_t bits = ((uint16_t)value << 1) | ((uint16_t)sim_parity(value) << 9) | (1 << 10);
+	uint8_t victim = rand() % 11;
+	uint32_t t0 = now, rise, fall, last = now;
+
+	if (fault == FAULT_MIXED) fault = FAULT_GLITCH + rand() % 4;
+	if (fault != FAULT_NONE && (double)rand() / RAND_MAX >= rate) fault = FAULT_NONE;
+
+	for (idx = 0; idx < 11; idx++) {
+		uint8_t bit = (bits >> idx) & 1;
+
+		rise = t0 + idx * BIT_US;
+		if (fault == FAULT_FLIP && idx == victim) bit = !bit;
+
+		ev[count++] = (line_event_t){ rise + DATA_US, 0, bit };
+		if (fault == FAULT_DROP && idx == victim) continue;
+
+		fall = rise + FALL_US;
+		rise += BIT_US;
+		if (fault == FAULT_JITTER) {
+			// Edges move, but keep their order: the clock still alternates
+			fall += fault_jitter();
+			rise += fault_jitter();
+			if (fall <= last) fall = last + 1;
+			if (rise <= fall) rise = fall + 1;
+		}
+		ev[count++] = (line_event_t){ fall, 1, 0 };
+		ev[count++] = (line_event_t){ rise, 1, 1 };
+		last = rise;
+	}
+	ev[count++] = (line_event_t){ t0 + 11 * BIT_US + DATA_US, 0, 1 }; // Back to idle
+
+	if (fault == FAULT_GLITCH) {
+		// In the high phase of the victim bit, after its data change: a glitch while the clock is low is not seen
+		uint32_t t = t0 + victim * BIT_US + DATA_US + 1 + rand() % (FALL_US - DATA_US - GLITCH_US - 2);
+
+		ev[count++] = (line_event_t){ t, 1, 0 };
+		ev[count++] = (line_event_t){ t + GLITCH_US, 1, 1 };
+	}
+
+	qsort(ev, count, sizeof(ev[0]), fault_cmp);
+
+	for (idx = 0; idx < count; idx++) {
+		if (ev[idx].clock) clock_level = ev[idx].level;
+		else data_level = ev[idx].level;
+		if (ev[idx].t > now) now = ev[idx].t;
+		sim_now = now;
+		sim_lines(clock_level, data_level);
+	}
+	now += BYTE_GAP_US;
+
+	return fault != FAULT_NONE;
+}
+
+typedef struct {
+	uint32_t frames_sent;
+	uint32_t keys, dropped, corrupted;
+	uint32_t faults, recovered, unrecovered; // unrecovered: faults with no keystroke seen right after them
+	double recovery_total, recovery_max;
+} fault_stats_t;
+
+static void fault_run(uint8_t fault, unsigned long count, unsigned int seed, fault_stats_t *st) {
+	uint32_t fault_time = 0;
+	uint32_t pending = 0; // Faults waiting for a keystroke seen right
+	uint8_t injected, make, brk;
+
+	memset(st, 0, sizeof(*st));
+	sim_init(&fault_sink);
+	srand(seed);
+	now = 0;
+	clock_level = data_level = 1;
+
+	for (unsigned long n = 0; n < count; n++) {
+		const fault_key_t *key = &keys[rand() % key_count];
+		uint32_t start = now;
+
+		seen_count = 0;
+		seen_overflow = 0;
+		injected = 0;
+
+		if (key->extended) injected |= fault_sendByte(PS2_SCANCODE_EXTENDED, fault);
+		injected |= fault_sendByte(key->code, fault);
+		sim_drain();
+		now += KEY_HOLD_US;
+
+		if (key->extended) injected |= fault_sendByte(PS2_SCANCODE_EXTENDED, fault);
+		injected |= fault_sendByte(PS2_SCANCODE_RELEASE, fault);
+		injected |= fault_sendByte(key->code, fault);
+		sim_drain();
+		now += KEY_GAP_US;
+
+		st->frames_sent += key->extended ? 5 : 3;
+		st->keys++;
+
+		make = fault_convert(key);
+		brk = make | 0x80;
+
+		if (seen_count == 2 && !seen_overflow && seen[0] == make && seen[1] == brk) {
+			if (pending && !injected) {
+				double ms = (start - fault_time) / 1000.0;
+
+				st->recovered++;
+				st->recovery_total += ms;
+				if (ms > st->recovery_max) st->recovery_max = ms;
+				pending = 0;
+			}
+		} else if (seen_count == 0) {
+			st->dropped++;
+		} else {
+			st->corrupted++;
+		}
+
+		if (injected) {
+			st->faults++;
+			if (!pending) fault_time = start; // Recovery counts from the first fault not yet recovered from
+			pending++;
+		}
+	}
+
+	st->unrecovered = pending;
+}
+
+// -t N for every row, or kind=N,kind=N for some: a negative bound is no bound
+static void fault_bounds(const char *arg, double *max_bad) {
+	const char *eq;
+
+	if (!strchr(arg, '=')) {
+		for (uint8_t fault = FAULT_NONE; fault <= FAULT_MIXED; fault++) max_bad[fault] = atof(arg);
+		return;
+	}
+
+	while (arg && (eq = strchr(arg, '='))) {
+		for (uint8_t fault = FAULT_NONE; fault <= FAULT_MIXED; fault++) {
+			if (strlen(fault_names[fault]) == (size_t)(eq - arg) && !strncmp(arg, fault_names[fault], eq - arg)) max_bad[fault] = atof(eq + 1);
+		}
+		arg = strchr(eq, ',');
+		if (arg) arg++;
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned long count = 20000;
+	unsigned int seed = 1;
+	double max_bad[FAULT_MIXED + 1] = { -1, -1, -1, -1, -1, -1 };
+	int failed = 0;
+	fault_stats_t st;
+
+	for (int opt = 1; opt + 1 < argc; opt += 2) {
+		if (!strcmp(argv[opt], "-n")) count = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-r")) rate = atof(argv[opt + 1]);
+		else if (!strcmp(argv[opt], "-j")) jitter_us = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-s")) seed = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-t")) fault_bounds(argv[opt + 1], max_bad);
+	}
+
+	fault_keys();
+	printf("%lu keystrokes per row, %.2f%% of the frames faulty, jitter +/-%uus, seed %u\n\n",
+		count, rate * 100, jitter_us, seed);
+	printf("%-7s %8s %8s %8s %8s %8s %12s %10s %8s\n",
+		"fault", "frames", "faults", "lost/1k", "drop/1k", "corr/1k", "recover avg", "worst", "never");
+
+	for (uint8_t fault = FAULT_NONE; fault <= FAULT_MIXED; fault++) {
+		uint32_t received;
+		double bad;
+
+		fault_run(fault, count, seed, &st);
+		received = sim_framesReceived;
+		bad = 1000.0 * (st.dropped + st.corrupted) / st.keys;
+
+		printf("%-7s %8u %8u %8.1f %8.1f %8.1f %10.1fms %8.1fms %8u%s\n",
+			fault_names[fault], st.frames_sent, st.faults,
+			received < st.frames_sent ? 1000.0 * (st.frames_sent - received) / st.frames_sent : 0.0,
+			1000.0 * st.dropped / st.keys, 1000.0 * st.corrupted / st.keys,
+			st.recovered ? st.recovery_total / st.recovered : 0.0, st.recovery_max,
+			st.unrecovered, (max_bad[fault] >= 0 && bad > max_bad[fault]) ? "  FAIL" : "");
+
+		if (max_bad[fault] >= 0 && bad > max_bad[fault]) failed = 1;
+	}
+
+	return failed;
+}
@@ -0,0 +1,218 @@
+// Fuzz target for the PS/2 decoder (ps2_keyb.c) and the converter (ps2_converter.c, conv_core.c,
+// key_macro.c). Builds as a libFuzzer target, or with fuzz_main.c as a standalone/AFL driver.
+//
+// Input: the first byte picks the mode, the rest drives the keyboard.
+//   bits 0-1 00: byte stream, every byte goes out as a well formed PS/2 frame
+//   bit 0 set:   waveform, every byte is one sample of the lines: bit 0 clock, bit 1 data,
+//                bits 2-7 the time since the last sample, in 4us steps (for the PS2_RX=icp receiver)
+//   bits 0-1 10: core stream, the bytes go straight to convcore_stream(), in chunks to either
+//                keyboard, chunk lengths and devices drawn from bits 2-7 as a seed
+// The main loop runs after every frame (or every 8 samples), as the firmware's would.
+//
+// In core stream mode the same bytes are also put together into sequences the way the decoder
+// does (kb_pushScancode()), and converted by convcore_sequence() on a second convcore_t:
+// the actions, the keys held and the LEDs of both must be the same.
+//
+// Afterwards the keyboard is plugged again and releases every key it has. Checks:
+//   - the host never sees a make for a key it holds, nor a break for a key it doesn't hold
+//     (a make for a held key is fine on the PC/XT output: it's a typematic repeat)
+//   - nothing is held at the end (the Amiga Caps Lock is latched, so it may be)
+//   - the queue and the macro engine go idle
+//   - the commands sent to the keyboard are LED settings or resets
+// Out of bounds accesses are left to the sanitizers.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "output.h"
+#include "convtable.h"
+#include "key_macro.h"
+#include "ps2_proto.h"
+#include "conv_core.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static uint8_t host_held[128];
+
+static void fuzz_fail(const char *what, uint8_t code) {
+	fprintf(stderr, "fuzz_conv: %s (code 0x%02X)\n", what, code);
+	abort();
+}
+
+static void fuzz_code(uint8_t code) {
+	uint8_t key = code & 0x7F;
+
+	if (code & 0x80) {
+		if (!host_held[key]) fuzz_fail("break for a key the host does not hold", code);
+		host_held[key] = 0;
+	} else {
+#if !defined (AKAB_OUTPUT_XT)
+		if (host_held[key]) fuzz_fail("make for a key the host already holds", code);
+#endif
+		host_held[key] = 1;
+	}
+}
+
+static void fuzz_hostReset(void) {
+	memset(host_held, 0, sizeof(host_held));
+}
+
+static void fuzz_command(const uint8_t *command, uint8_t length) {
+	if (length == 1 && command[0] == PS2_HTD_RESET) return;
+	if (length == 2 && command[0] == PS2_HTD_LEDCONTROL && command[1] <= 0x07) return;
+
+	fuzz_fail("unexpected keyboard command", command[0]);
+}
+
+static const sim_sink_t fuzz_sink = { fuzz_code, fuzz_hostReset, fuzz_command };
+
+// Every key of a real keyboard is released: the break of every code the tables know
+static void fuzz_releaseAll(void) {
+	const uint8_t *entry;
+
+	for (uint16_t code = 1; code < CONV_NORMAL_SIZE; code++) {
+		sim_sendByte(PS2_SCANCODE_RELEASE);
+		sim_sendByte(code);
+		sim_drain();
+	}
+
+	for (entry = ps2_extended_convtable; pgm_read_byte(entry); entry += 2) {
+		sim_sendByte(PS2_SCANCODE_EXTENDED);
+		sim_sendByte(PS2_SCANCODE_RELEASE);
+		sim_sendByte(pgm_read_byte(entry));
+		if (pgm_read_byte(entry) == 0x7C) { // Print Screen break ends with a fake Shift release
+			sim_sendByte(PS2_SCANCODE_EXTENDED);
+			sim_sendByte(PS2_SCANCODE_RELEASE);
+			sim_sendByte(0x12);
+		}
+		sim_drain();
+	}
+}
+
+#define FUZZ_CHUNK_MAX 16 // Core stream: bytes per convcore_stream() chunk, at most
+
+static convcore_t stream_ctx, sequence_ctx;
+static uint8_t ref_code[CONVCORE_DEVICES][9]; // Sequences put together as kb_pushScancode() does
+static uint8_t ref_count[CONVCORE_DEVICES];
+
+static uint8_t fuzz_refByte(uint8_t device, uint8_t code, convcore_action_t *out) {
+	uint8_t *seq = ref_code[device];
+	uint8_t actions;
+
+	if (ref_count[device] >= sizeof(ref_code[0])) ref_count[device] = 0;
+
+	seq[ref_count[device]] = code;
+	if (code == PS2_SCANCODE_RELEASE || code == PS2_SCANCODE_EXTENDED || code == PS2_SCANCODE_PAUSE ||
+		(seq[0] == PS2_SCANCODE_PAUSE && ref_count[device] < 7)) {
+		ref_count[device]++;
+		return 0;
+	}
+
+	actions = convcore_sequence(&sequence_ctx, device, seq, ref_count[device], out);
+	if (actions > CONVCORE_ACTIONS_MAX) fuzz_fail("more actions than CONVCORE_ACTIONS_MAX", code);
+	ref_count[device] = 0;
+
+	return actions;
+}
+
+static void fuzz_stream(const uint8_t *data, size_t size, uint8_t seed) {
+	uint32_t rng = seed;
+	size_t idx = 0;
+	uint8_t check;
+
+	convcore_init(&stream_ctx);
+	convcore_init(&sequence_ctx);
+	memset(ref_count, 0, sizeof(ref_count));
+
+	while (idx < size) {
+		convcore_action_t got[4 * FUZZ_CHUNK_MAX], want[CONVCORE_ACTIONS_MAX * FUZZ_CHUNK_MAX];
+		size_t got_count = 0, want_count = 0, used = 0, chunk, out_size;
+		uint8_t device;
+
+		rng = rng * 1103515245 + 12345;
+		device = (rng >> 16) % CONVCORE_DEVICES;
+		chunk = 1 + (rng >> 20) % FUZZ_CHUNK_MAX;
+		out_size = CONVCORE_ACTIONS_MAX + (rng >> 24) % 8; // Small outputs, so it stops early too
+		if (chunk > size - idx) chunk = size - idx;
+
+		while (used < chunk) {
+			size_t actions, n;
+
+			n = convcore_stream(&stream_ctx, device, &data[idx + used], chunk - used, &got[got_count], out_size, &actions);
+			if (!n && !actions) fuzz_fail("convcore_stream() makes no progress", data[idx + used]);
+			used += n;
+			got_count += actions;
+		}
+
+		for (used = 0; used < chunk; used++) want_count += fuzz_refByte(device, data[idx + used], &want[want_count]);
+
+		if (got_count != want_count || memcmp(got, want, got_count * sizeof(got[0])))
+			fuzz_fail("convcore_stream() and convcore_sequence() convert differently", data[idx]);
+		idx += chunk;
+	}
+
+	if (memcmp(stream_ctx.held, sequence_ctx.held, sizeof(stream_ctx.held)) ||
+		convcore_leds(&stream_ctx) != convcore_leds(&sequence_ctx))
+		fuzz_fail("convcore_stream() and convcore_sequence() end in different states", 0);
+
+	// A watchdog restart keeps the held keys and the locks, checked by convcore_checksum(), and nothing else
+	check = convcore_checksum(&sequence_ctx);
+	sequence_ctx.options ^= CONVCORE_OPT_RESET_CHORD;
+	convcore_remap(&sequence_ctx, 0x1C, 0, 0x21);
+	if (convcore_checksum(&sequence_ctx) != check) fuzz_fail("convcore_checksum() covers the options or remaps", 0);
+
+	convcore_restore(&sequence_ctx);
+	if (memcmp(stream_ctx.held, sequence_ctx.held, sizeof(stream_ctx.held)) || convcore_leds(&stream_ctx) != convcore_leds(&sequence_ctx))
+		fuzz_fail("convcore_restore() lost the held keys or the locks", 0);
+	if (convcore_options(&sequence_ctx) != CONVCORE_OPTS_DEFAULT || convcore_map(&sequence_ctx, 0x1C, 0) != convcore_map(&stream_ctx, 0x1C, 0))
+		fuzz_fail("convcore_restore() kept the options or remaps", 0);
+
+	rng = rng * 1103515245 + 12345;
+	sequence_ctx.held[(rng >> 16) % CONVCORE_DEVICES][(rng >> 20) % CONVCORE_HELD_BYTES] ^= 1 << ((rng >> 28) & 0x07);
+	if (convcore_checksum(&sequence_ctx) == check) fuzz_fail("convcore_checksum() misses a key written over", 0);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	size_t idx;
+
+	memset(host_held, 0, sizeof(host_held));
+	sim_init(&fuzz_sink);
+
+	if (size == 0) return 0;
+
+	if ((data[0] & 0x03) == 0x02) {
+		fuzz_stream(&data[1], size - 1, data[0] >> 2);
+		return 0;
+	}
+
+	if (data[0] & 1) {
+		for (idx = 1; idx < size; idx++) {
+			sim_now += (data[idx] >> 2) * 4;
+			sim_lines(data[idx] & 1, (data[idx] >> 1) & 1);
+			if (!(idx & 7)) sim_task();
+		}
+	} else {
+		for (idx = 1; idx < size; idx++) {
+			sim_sendByte(data[idx]);
+			sim_task();
+		}
+	}
+	sim_drain();
+
+	sim_resync();
+	fuzz_releaseAll();
+
+	if (!out_queueEmpty() || kmacro_running()) fuzz_fail("queue or macro engine not idle", 0);
+
+	for (idx = 0; idx < sizeof(host_held); idx++) {
+#if !defined (AKAB_OUTPUT_XT)
+		if (idx == CONV_CAPSLOCK_CODE) continue;
+#endif
+		if (host_held[idx]) fuzz_fail("key stuck after everything was released", idx);
+	}
+
+	return 0;
+}
@@ -0,0 +1,86 @@
+// Standalone driver for fuzz_conv.c, when libFuzzer is not at hand (gcc, AFL):
+//   fuzz_conv file...          runs every file as one input (AFL: fuzz_conv @@)
+//   fuzz_conv -r N [seed]      runs N random inputs, a third each byte streams, waveforms and core streams
+//   fuzz_conv                  runs stdin as one input
+// A random input that fails is saved as crash-random.bin, to be replayed as a file.
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#define FUZZ_MAX_INPUT 4096
+
+static uint8_t input[FUZZ_MAX_INPUT];
+static size_t input_size;
+
+static void fuzz_save(int sig) {
+	FILE *f = fopen("crash-random.bin", "wb");
+
+	if (f) {
+		fwrite(input, 1, input_size, f);
+		fclose(f);
+		fprintf(stderr, "fuzz_conv: input saved as crash-random.bin\n");
+	}
+
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+static size_t fuzz_read(FILE *f) {
+	return fread(input, 1, sizeof(input), f);
+}
+
+// Random inputs lean towards the codes that matter: prefixes, mapped keys, the reset chord
+static const uint8_t interesting[] = {
+	0xE0, 0xF0, 0xE1, 0x12, 0x14, 0x1F, 0x27, 0x58, 0x7C, 0x77, 0x78, 0x07, 0x7D, 0x7A, 0x11, 0xAA, 0xFA, 0x00, 0xFF
+};
+
+static size_t fuzz_random(void) {
+	size_t size = 1 + rand() % 512;
+
+	input[0] = (rand() % 3) | (rand() & 0xFC); // Byte stream, waveform or core stream, and a core stream seed
+	for (size_t idx = 1; idx < size; idx++) {
+		if (input[0] & 1) input[idx] = rand() & 0x03;
+		else if (rand() & 1) input[idx] = interesting[rand() % sizeof(interesting)];
+		else input[idx] = rand() & 0xFF;
+	}
+
+	return size;
+}
+
+int main(int argc, char **argv) {
+	FILE *f;
+
+	if (argc >= 3 && !strcmp(argv[1], "-r")) {
+		long runs = atol(argv[2]);
+
+		srand(argc >= 4 ? atoi(argv[3]) : 1);
+		signal(SIGABRT, fuzz_save);
+		for (long run = 0; run < runs; run++) {
+			input_size = fuzz_random();
+			LLVMFuzzerTestOneInput(input, input_size);
+		}
+		printf("fuzz_conv: %ld random inputs, no failure\n", runs);
+		return 0;
+	}
+
+	if (argc < 2) {
+		LLVMFuzzerTestOneInput(input, fuzz_read(stdin));
+		return 0;
+	}
+
+	for (int arg = 1; arg < argc; arg++) {
+		if (!(f = fopen(argv[arg], "rb"))) {
+			perror(argv[arg]);
+			return 1;
+		}
+		LLVMFuzzerTestOneInput(input, fuzz_read(f));
+		fclose(f);
+	}
+
+	return 0;
+}
@@ -0,0 +1,304 @@
+// Two keyboards at once (AKAB_KEYB2), on the host: the INT0 keyboard and the one on the PD7/PD6
+// pin change interrupt typing together, their frames interleaved bit by bit.
+//
+//   keyb2 [-n rounds] [-s seed]
+//
+// Runs the PS/2 decoder with both receivers, the converter and the macro engine on sim.c.
+// In every round both keyboards send a few keystrokes, each on its own clock (a phase of 30 to
+// 50us, a random offset from the other), their edges coming in time order with the main loop
+// run in between:
+//   apart    random keys on each keyboard
+//   shared   a handful of keys, pressed and released on both keyboards in any order
+//   stall    as apart, with the host stalled through the round (sim_stall()): the queue overflows
+//   overrun  keys held on both, then an overrun code (0x00 or 0xFF) from one of them
+// Checks, on what the host sees:
+//   bad      a make for a key the host holds (a typematic repeat on the PC/XT is fine),
+//            or a break for a key it does not hold
+//   stuck    keys down on the host, once it has caught up, held on neither keyboard
+//   missed   (apart, shared) keys held on a keyboard and not down on the host: both keyboards
+//            merge into one host key stream, and neither starves the other
+//   errors   frames with a bad start, stop or parity bit: the receivers must not disturb each other
+// Prints for each row the keystrokes from each keyboard, and exits with 1 if a row has any of those.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "output.h"
+#include "convtable.h"
+#include "key_macro.h"
+#include "ps2_converter.h"
+#include "ps2_keyb.h"
+#include "ps2_proto.h"
+#include "common/timing.h"
+
+#define KEYBS        2
+#define STROKES_MIN  4  // Keystrokes from each keyboard in a round, at least...
+#define STROKES_MAX  12 // ... at most
+#define SHARED_KEYS  6  // Keys both keyboards use in the shared row
+#define GAP_US       100 // After each frame, at least
+#define TASK_ONE_IN  6   // Main loop runs, one clock edge in this many
+#define BUFFER       64 // Bytes on their way from a keyboard
+
+enum { CASE_APART, CASE_SHARED, CASE_STALL, CASE_OVERRUN, CASE_COUNT };
+static const char * const case_names[] = { "apart", "shared", "stall", "overrun" };
+
+typedef struct {
+	uint8_t code;
+	uint8_t extended;
+	uint8_t key_code; // What the host gets
+} kb2_key_t;
+
+// A keyboard: what it still has to send, the frame on the wire, and the keys held on it
+typedef struct {
+	uint8_t out[BUFFER];
+	uint8_t out_count, out_idx;
+	uint16_t frame; // Bits left of the frame being sent, LSB first
+	uint8_t frame_bits;
+	uint8_t clock_low; // 1: the bit is on the wire and the clock is down
+	uint8_t phase_us; // Its clock
+	uint32_t next; // sim_now of its next edge
+	uint8_t held[256]; // By index in keys[]
+	unsigned long strokes;
+} kb2_keyb_t;
+
+static kb2_key_t keys[256];
+static uint16_t key_count;
+
+static kb2_keyb_t keybs[KEYBS];
+static uint8_t host_held[128];
+static unsigned long host_codes, bad;
+
+static void kb2_code(uint8_t code) {
+	uint8_t key = code & 0x7F;
+
+	host_codes++;
+	if (code & 0x80) {
+		if (!host_held[key]) bad++;
+		host_held[key] = 0;
+	} else {
+#if !defined (AKAB_OUTPUT_XT)
+		if (host_held[key]) bad++;
+#endif
+		host_held[key] = 1;
+	}
+}
+
+static void kb2_hostReset(void) {
+	memset(host_held, 0, sizeof(host_held));
+}
+
+static const sim_sink_t kb2_sink = { kb2_code, kb2_hostReset, NULL };
+
+static void kb2_addKey(uint8_t code, uint8_t extended, uint8_t key_code) {
+	// Plain keys only: no macros, resets or locks, so every keystroke is one make and one break
+	if (key_code == CONV_UNMAPPED || key_code == CONV_RESET_CODE || key_code == CONV_READOUT_CODE) return;
+	if (CONV_IS_MACRO(key_code) || key_code == CONV_CAPSLOCK_CODE) return;
+#if defined (AKAB_OUTPUT_XT)
+	if (key_code == CONV_NUMLOCK_CODE || key_code == CONV_SCROLLLOCK_CODE) return;
+#endif
+	// One key for each host code: a keyboard holds a host code, not the keys behind it (both Ctrl keys
+	// on the Amiga), so letting go of one of two lets go of it
+	for (uint16_t idx = 0; idx < key_count; idx++) {
+		if (keys[idx].key_code == key_code) return;
+	}
+
+	keys[key_count].code = code;
+	keys[key_count].extended = extended;
+	keys[key_count].key_code = key_code;
+	key_count++;
+}
+
+static void kb2_keys(void) {
+	const uint8_t *entry;
+
+	for (uint16_t code = 1; code < CONV_NORMAL_SIZE; code++) kb2_addKey(code, 0, pgm_read_byte(&ps2_normal_convtable[code]));
+	for (entry = ps2_extended_convtable; pgm_read_byte(entry); entry += 2) kb2_addKey(pgm_read_byte(entry), 1, pgm_read_byte(entry + 1));
+}
+
+static void kb2_put(kb2_keyb_t *kb, uint8_t value) {
+	if (kb->out_count < BUFFER) kb->out[kb->out_count++] = value;
+}
+
+// A keystroke on a keyboard, press or release: its bytes wait for the wire
+static void kb2_stroke(uint8_t device, uint16_t idx) {
+	kb2_keyb_t *kb = &keybs[device];
+
+	if (kb->out_count + 3 > BUFFER) return;
+
+	if (keys[idx].extended) kb2_put(kb, PS2_SCANCODE_EXTENDED);
+	if (kb->held[idx]) kb2_put(kb, PS2_SCANCODE_RELEASE);
+	kb2_put(kb, keys[idx].code);
+	kb->held[idx] = !kb->held[idx];
+	kb->strokes++;
+}
+
+static void kb2_lines(uint8_t device, uint8_t clock, uint8_t data) {
+	if (device) sim_lines2(clock, data);
+	else sim_lines(clock, data);
+}
+
+// The next edge of a keyboard: the bit goes on the wire with the clock falling, then the clock rises.
+// Returns 0 if it has nothing left to send
+static uint8_t kb2_phase(uint8_t device) {
+	kb2_keyb_t *kb = &keybs[device];
+
+	if (!kb->frame_bits) {
+		uint8_t value;
+
+		if (kb->out_idx == kb->out_count) return 0;
+		value = kb->out[kb->out_idx++];
+		kb->frame = ((uint16_t)value << 1) | ((uint16_t)sim_parity(value) << 9) | (1 << 10); // Start, data, parity, stop
+		kb->frame_bits = 11;
+	}
+
+	kb->next += kb->phase_us;
+	if (!kb->clock_low) {
+		kb2_lines(device, 1, kb->frame & 1);
+		kb2_lines(device, 0, kb->frame & 1);
+		kb->clock_low = 1;
+	} else {
+		kb2_lines(device, 1, kb->frame & 1);
+		kb->clock_low = 0;
+		kb->frame >>= 1;
+		if (!--kb->frame_bits) {
+			kb2_lines(device, 1, 1); // Idle after the stop bit
+			kb->next += GAP_US + rand() % GAP_US;
+		}
+	}
+
+	return 1;
+}
+
+// Both keyboards send what they have, at their own pace: the next edge of either one comes first
+static void kb2_send(void) {
+	uint8_t busy = (1 << KEYBS) - 1;
+
+	for (uint8_t device = 0; device < KEYBS; device++) {
+		keybs[device].phase_us = TIMING_PS2_PHASE_MIN_US + rand() % (TIMING_PS2_PHASE_MAX_US - TIMING_PS2_PHASE_MIN_US + 1);
+		keybs[device].next = sim_now + rand() % (4 * keybs[device].phase_us);
+	}
+
+	while (busy) {
+		uint8_t device = KEYBS;
+
+		for (uint8_t idx = 0; idx < KEYBS; idx++) {
+			if ((busy & (1 << idx)) && (device == KEYBS || keybs[idx].next < keybs[device].next)) device = idx;
+		}
+
+		sim_now = keybs[device].next;
+		if (!kb2_phase(device)) busy &= ~(1 << device);
+		if (!(rand() % TASK_ONE_IN)) sim_task();
+	}
+
+	for (uint8_t device = 0; device < KEYBS; device++) keybs[device].out_idx = keybs[device].out_count = 0;
+}
+
+static uint8_t kb2_userHolds(uint8_t key_code) {
+	for (uint8_t device = 0; device < KEYBS; device++) {
+		for (uint16_t idx = 0; idx < key_count; idx++) {
+			if (keybs[device].held[idx] && keys[idx].key_code == key_code) return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Keys down on the host that no keyboard holds, and (with check_missed) the other way round
+static unsigned long kb2_compare(uint8_t check_missed, unsigned long *missed) {
+	unsigned long stuck = 0;
+
+	sim_stall(0);
+	sim_drain();
+
+	for (uint8_t key = 0; key < 128; key++) {
+		uint8_t user = kb2_userHolds(key);
+
+#if !defined (AKAB_OUTPUT_XT)
+		if (key == CONV_CAPSLOCK_CODE) continue; // Latched
+#endif
+		if (host_held[key] && !user) stuck++;
+		if (check_missed && !host_held[key] && user) (*missed)++;
+	}
+
+	return stuck;
+}
+
+static void kb2_releaseAll(void) {
+	for (uint8_t device = 0; device < KEYBS; device++) {
+		for (uint16_t idx = 0; idx < key_count; idx++) {
+			if (keybs[device].held[idx]) kb2_stroke(device, idx);
+		}
+	}
+	kb2_send();
+}
+
+static unsigned long kb2_round(uint8_t which, unsigned long *missed) {
+	uint16_t shared[SHARED_KEYS];
+	unsigned long stuck = 0;
+
+	for (uint8_t n = 0; n < SHARED_KEYS; n++) shared[n] = rand() % key_count;
+
+	if (which == CASE_STALL) sim_stall(1);
+
+	for (uint8_t device = 0; device < KEYBS; device++) {
+		for (uint8_t n = STROKES_MIN + rand() % (STROKES_MAX - STROKES_MIN + 1); n; n--) {
+			kb2_stroke(device, which == CASE_SHARED ? shared[rand() % SHARED_KEYS] : rand() % key_count);
+		}
+	}
+	kb2_send();
+
+	if (which == CASE_OVERRUN) {
+		uint8_t device = rand() % KEYBS;
+
+		kb2_compare(0, NULL);
+		kb2_put(&keybs[device], rand() & 1 ? PS2_SCANCODE_OVERRUN : PS2_SCANCODE_OVERRUN_SET1);
+		kb2_send();
+		sim_drain();
+		for (uint8_t key = 0; key < 128; key++) stuck += host_held[key] && key != CONV_CAPSLOCK_CODE; // All of them let go
+	} else {
+		stuck += kb2_compare(which != CASE_STALL, missed);
+	}
+
+	kb2_releaseAll();
+	return stuck + kb2_compare(which != CASE_STALL && which != CASE_OVERRUN, missed);
+}
+
+int main(int argc, char **argv) {
+	unsigned long rounds = 1000;
+	unsigned int seed = 1;
+	int failed = 0;
+
+	for (int opt = 1; opt + 1 < argc; opt += 2) {
+		if (!strcmp(argv[opt], "-n")) rounds = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-s")) seed = strtoul(argv[opt + 1], NULL, 0);
+	}
+
+	kb2_keys();
+	printf("%lu rounds per row, seed %u\n\n", rounds, seed);
+	printf("%-8s %8s %8s %8s %8s %6s %6s %6s\n", "case", "codes", "strokes1", "strokes2", "errors", "stuck", "missed", "bad");
+
+	for (uint8_t which = 0; which < CASE_COUNT; which++) {
+		unsigned long stuck = 0, missed = 0;
+		uint16_t frames, errors;
+
+		memset(keybs, 0, sizeof(keybs));
+		memset(host_held, 0, sizeof(host_held));
+		host_codes = bad = 0;
+		sim_init(&kb2_sink);
+		ps2k_setOptions(PS2K_OPT_CAPS_LATCH); // No reset chord: random keys would hit it
+		srand(seed);
+
+		for (unsigned long n = 0; n < rounds; n++) stuck += kb2_round(which, &missed);
+
+		ps2keyb_frameCounts(&frames, &errors);
+		printf("%-8s %8lu %8lu %8lu %8u %6lu %6lu %6lu%s\n", case_names[which], host_codes,
+			keybs[0].strokes, keybs[1].strokes, errors, stuck, missed, bad, (errors || stuck || missed || bad) ? "  FAIL" : "");
+
+		if (errors || stuck || missed || bad) failed = 1;
+	}
+
+	return failed;
+}
@@ -0,0 +1,58 @@
+#!/bin/sh
+# akabctl through every command against mgmt_sim, checking what it prints.
+#
+#   mgmt_check.sh <out dir> <akabctl>
+#
+# Starts <out dir>/mgmt_sim on a pty. The conversion table values of 1C and E0 1C are read
+# first, so the same script runs for every OUTPUT; every remap must read back, leave the other
+# key alone, and unmap must bring the table values back. Exits with 1 on the first mismatch.
+
+out=$1
+akabctl=$2
+
+$out/mgmt_sim > $out/mgmt_sim.tty 2> /dev/null &
+sim=$!
+trap 'kill $sim 2> /dev/null' EXIT
+sleep 0.5
+tty=$(cat $out/mgmt_sim.tty)
+
+# run <args>: akabctl's output in $reply, fails on an error
+run() {
+	echo "akabctl $*"
+	reply=$($akabctl -d $tty "$@") || { echo "  failed"; exit 1; }
+	[ -n "$reply" ] && echo "$reply" | sed 's/^/  /'
+	return 0
+}
+
+# expect <what>: the reply must be exactly that
+expect() {
+	[ "$reply" = "$1" ] || { echo "  expected: $1"; exit 1; }
+}
+
+run ping
+case "$reply" in "version 1, "*) ;; *) echo "  expected: version 1, ..."; exit 1 ;; esac
+
+run counters
+echo "$reply" | grep -q '^frame errors *0$' || { echo "  expected: frame errors 0"; exit 1; }
+
+run options;                     expect "chord=1 caps=1"
+run options caps=0;              expect "chord=1 caps=0"
+run options chord=0;             expect "chord=0 caps=0"
+run options chord=1 caps=1;      expect "chord=1 caps=1"
+
+run map 1c;   table=$reply
+run map 1c e; table_e=$reply
+case "$table" in "1C -> "??) ;; *) echo "  expected: 1C -> <code>"; exit 1 ;; esac
+
+run map 1c 21;   expect "1C -> 21"
+run map 1c;      expect "1C -> 21"
+run map 1c e 7;  expect "E0 1C -> 07"
+run map 1c e;    expect "E0 1C -> 07"
+run map 1c;      expect "1C -> 21"
+
+run unmap
+run map 1c;      expect "$table"
+run map 1c e;    expect "$table_e"
+
+run reinit
+run ping
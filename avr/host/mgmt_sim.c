@@ -0,0 +1,142 @@
+// Management port of the adapter on a pty, on the host.
+//
+//   mgmt_sim
+//
+// Runs the firmware's management port (mgmt.c, uart.c) with the decoder and the converter on
+// sim.c, USART0 being a pty: prints the path of its other side, then answers host/akabctl until
+// killed. Simulated time follows the wall clock. Types a few keys at start, so that the counters
+// move; the codes that reach the host and the commands sent to the keyboard go to stderr.
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <avr/io.h>
+
+#include "sim.h"
+#include "mgmt.h"
+#include "ps2_proto.h"
+
+#define MAX_TX 64 // Bytes written to UDR0 in one main loop round
+
+void sim_usart_rx_vect(void);
+
+static uint8_t rx_byte, in_rx;
+static volatile uint8_t tx_bytes[MAX_TX];
+static uint8_t tx_count;
+
+// Firmware pieces that are not built here
+uint16_t instr_stackFreeMin(void) { return 0; }
+uint16_t instr_latencyMax(void) { return 0; }
+uint8_t wdog_restarts(void) { return 0; }
+
+volatile uint8_t *sim_udr0(void) {
+	if (in_rx) return &rx_byte;
+	if (tx_count < MAX_TX) return &tx_bytes[tx_count++];
+	return &tx_bytes[MAX_TX - 1];
+}
+
+static void mgmt_simCode(uint8_t code) {
+	fprintf(stderr, "host: %02X\n", code);
+}
+
+static void mgmt_simCommand(const uint8_t *command, uint8_t length) {
+	fprintf(stderr, "keyboard:");
+	while (length--) fprintf(stderr, " %02X", *command++);
+	fprintf(stderr, "\n");
+}
+
+static const sim_sink_t mgmt_sink = { mgmt_simCode, NULL, mgmt_simCommand };
+
+static uint32_t mgmt_simClock(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static int mgmt_simPty(void) {
+	struct termios tio;
+	int pty = posix_openpt(O_RDWR | O_NOCTTY), peer;
+
+	if (pty < 0 || grantpt(pty) || unlockpt(pty)) return -1;
+
+	// Held open, raw, so that the pty stays up and unmangled between two clients
+	peer = open(ptsname(pty), O_RDWR | O_NOCTTY);
+	if (peer < 0 || tcgetattr(peer, &tio)) return -1;
+	cfmakeraw(&tio);
+	tcsetattr(peer, TCSANOW, &tio);
+
+	fcntl(pty, F_SETFL, O_NONBLOCK);
+	return pty;
+}
+
+int main(int argc, char **argv) {
+	static const uint8_t keys[] = { 0x1C, 0x32, 0x21 }; // A, B, C
+	uint32_t start = mgmt_simClock();
+	uint8_t buf[16];
+	int pty = mgmt_simPty();
+
+	if (pty < 0) {
+		perror("mgmt_sim: pty");
+		return 1;
+	}
+
+	sim_init(&mgmt_sink);
+	mgmt_init();
+
+	for (uint8_t idx = 0; idx < sizeof(keys); idx++) {
+		sim_sendByte(keys[idx]);
+		sim_drain();
+		sim_sendByte(PS2_SCANCODE_RELEASE);
+		sim_sendByte(keys[idx]);
+		sim_drain();
+	}
+
+	printf("%s\n", ptsname(pty));
+	fflush(stdout);
+
+	for (;;) {
+		struct pollfd pfd = { pty, POLLIN, 0 };
+		ssize_t count;
+
+		poll(&pfd, 1, 5);
+		sim_now = mgmt_simClock() - start;
+
+		// No more than the ring takes: the real USART would not go faster than the main loop either
+		count = read(pty, buf, sizeof(buf));
+		if (count < 0 && errno != EAGAIN) {
+			perror("mgmt_sim: read");
+			return 1;
+		}
+		for (ssize_t idx = 0; idx < count; idx++) {
+			rx_byte = buf[idx];
+			in_rx = 1;
+			UCSR0A &= ~((1 << FE0) | (1 << DOR0));
+			sim_usart_rx_vect();
+			in_rx = 0;
+		}
+
+		UCSR0A |= (1 << UDRE0); // The transmitter is done with the last round's bytes
+		sim_task();
+		mgmt_task();
+
+		for (uint8_t idx = 0; idx < tx_count; idx++) {
+			uint8_t c = tx_bytes[idx];
+
+			if (write(pty, &c, 1) != 1) perror("mgmt_sim: write");
+		}
+		tx_count = 0;
+	}
+
+	return 0;
+}
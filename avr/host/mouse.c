@@ -0,0 +1,249 @@
+// Amiga mouse output and PS/2 mouse input, on the host.
+//
+//   mouse [-n rounds] [-s seed]
+//
+// Runs the quadrature generator (amiga_mouse.c) on its Timer2 handler, and the PS/2 mouse
+// receiver (ps2_mouse.c) on its pin change handler, with the mouse lines played here:
+//   phases    random reports, one a report period, then the generator ticked until idle. Every
+//             change of H/HQ (PC2/PC3) and V/VQ (PC4/PC5) must be one step of the Gray sequence,
+//             forward or back, at most one a tick, and the steps must add up to the movement
+//             (Y the other way round: the Amiga counts down the screen). A report from idle
+//             must be out within a report period, or at full speed if it is more than that
+//   saturate  reports of 255 counts with no tick in between, one way then the other: exactly
+//             AMIMOUSE_PENDING_MAX steps must come out, the right way, and no wrap around
+//   bat       packets with AA 00 inside (dx -86 or 170, dy 0) must come out as movement, and
+//             only an AA 00 where a packet starts (a mouse plugged again) enables it again
+// Prints the counts of each row, and exits with 1 if a row has any error.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "amiga_mouse.h"
+#include "ps2_mouse.h"
+#include "ps2_keyb.h"
+
+#define PERIOD_TICKS (AMIMOUSE_TICK_HZ / AMIMOUSE_REPORT_HZ)
+
+#define MS_CLK_PNUM  0 // PC0
+#define MS_DATA_PNUM 1 // PC1
+
+#define PS2_MOUSE_ACK    0xFA
+#define PS2_MOUSE_BAT_OK 0xAA
+#define PS2_MOUSE_ENABLE 0xF4
+#define PS2_MOUSE_RESET  0xFF
+
+void sim_timer2_compa_vect(void);
+void sim_pcint1_vect(void);
+
+enum { ROW_PHASES, ROW_SATURATE, ROW_BAT, ROW_COUNT };
+static const char * const row_names[] = { "phases", "saturate", "bat" };
+
+// Gray sequence position of the two lines of an axis (bit 0 H or V, bit 1 HQ or VQ): 00, 01, 11, 10
+static const uint8_t quad_index[4] = { 0, 1, 3, 2 };
+
+static uint8_t quad_x, quad_y; // Sequence position last seen
+static long steps_x, steps_y;
+static unsigned long errors;
+
+volatile uint8_t PINC = (1 << MS_CLK_PNUM) | (1 << MS_DATA_PNUM); // Mouse lines (SIM_PINC_LINES), idle high
+static unsigned long resets, enables;
+
+static int16_t moved_dx, moved_dy;
+static uint8_t moved_buttons, moved;
+
+// No mouse to clock the command in: it is taken as sent
+void ps2keyb_sendCommandTo(const ps2_lines_t *lines, uint8_t *command, uint8_t length) {
+	if (length == 1 && command[0] == PS2_MOUSE_RESET) resets++;
+	else if (length == 1 && command[0] == PS2_MOUSE_ENABLE) enables++;
+	else errors++;
+}
+
+static void mouse_moved(int16_t dx, int16_t dy, uint8_t buttons) {
+	moved_dx = dx;
+	moved_dy = dy;
+	moved_buttons = buttons;
+	moved++;
+}
+
+// ---- Generator side
+
+static int8_t mouse_step(uint8_t *last, uint8_t lines) {
+	uint8_t now = quad_index[lines & 0x03];
+	uint8_t diff = (now - *last) & 0x03;
+
+	*last = now;
+	if (diff == 2) errors++; // A phase skipped: the Amiga cannot tell which way
+	return diff == 1 ? 1 : diff == 3 ? -1 : 0;
+}
+
+static void mouse_tick(void) {
+	sim_timer2_compa_vect();
+	steps_x += mouse_step(&quad_x, PORTC >> 2);
+	steps_y += mouse_step(&quad_y, PORTC >> 4);
+}
+
+// Ticks until the generator has nothing left, returns how many it took
+static unsigned long mouse_idle(void) {
+	unsigned long ticks = 0, quiet = 0;
+
+	// Nothing moves for two report periods: idle
+	while (quiet < 2 * PERIOD_TICKS) {
+		long x = steps_x, y = steps_y;
+
+		mouse_tick();
+		ticks++;
+		if (x != steps_x || y != steps_y) quiet = 0;
+		else quiet++;
+	}
+
+	return ticks - quiet;
+}
+
+static int16_t mouse_delta(void) {
+	return (rand() % 511) - 255; // What a PS/2 packet carries
+}
+
+static void mouse_phases(void) {
+	long want_x = 0, want_y = 0;
+	int16_t dx = mouse_delta(), dy = mouse_delta();
+	unsigned long ticks, bound;
+
+	steps_x = steps_y = 0;
+
+	// From idle: out within a period, or one step a tick
+	amimouse_report(dx, dy, 0);
+	ticks = mouse_idle();
+	bound = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+	if (bound < PERIOD_TICKS) bound = PERIOD_TICKS;
+	if (ticks > bound) errors++;
+	want_x += dx;
+	want_y -= dy;
+
+	// A stream of reports, one a period
+	for (uint8_t n = 1 + rand() % 8; n; n--) {
+		dx = mouse_delta();
+		dy = mouse_delta();
+		amimouse_report(dx, dy, 0);
+		want_x += dx;
+		want_y -= dy;
+		for (uint16_t tick = 0; tick < PERIOD_TICKS; tick++) mouse_tick();
+	}
+	mouse_idle();
+
+	if (steps_x != want_x || steps_y != want_y) errors++;
+}
+
+static void mouse_saturate(void) {
+	int8_t sign = rand() & 1 ? 1 : -1;
+
+	steps_x = steps_y = 0;
+	for (uint16_t n = 0; n < 2 * AMIMOUSE_PENDING_MAX / 255 + 10; n++) amimouse_report(sign * 255, sign * 255, 0);
+	mouse_idle();
+	if (steps_x != sign * AMIMOUSE_PENDING_MAX || steps_y != -sign * AMIMOUSE_PENDING_MAX) errors++;
+
+	// Back the other way, not saturated: in full
+	steps_x = steps_y = 0;
+	amimouse_report(-sign * 200, -sign * 200, 0);
+	mouse_idle();
+	if (steps_x != -sign * 200 || steps_y != sign * 200) errors++;
+}
+
+// ---- Receiver side
+
+static void mouse_clock(uint8_t level) {
+	if (level) PINC |= (1 << MS_CLK_PNUM);
+	else PINC &= ~(1 << MS_CLK_PNUM);
+	sim_pcint1_vect();
+}
+
+static void mouse_sendByte(uint8_t value) {
+	uint16_t frame = (uint16_t)value << 1 | (1 << 10); // Start (0), 8 data bits, parity, stop (1)
+	uint8_t ones = 0;
+
+	for (uint8_t bit = 0; bit < 8; bit++) ones += (value >> bit) & 1;
+	if (!(ones & 1)) frame |= 1 << 9; // Odd parity
+
+	for (uint8_t bit = 0; bit < 11; bit++, frame >>= 1) {
+		if (frame & 1) PINC |= (1 << MS_DATA_PNUM);
+		else PINC &= ~(1 << MS_DATA_PNUM);
+		mouse_clock(0); // The host reads the data on the falling edge
+		mouse_clock(1);
+	}
+	PINC |= (1 << MS_DATA_PNUM);
+}
+
+// A mouse plugged: self test passed, ID 0, then the ACK of the enable command
+static void mouse_plug(void) {
+	unsigned long was = enables;
+
+	mouse_sendByte(PS2_MOUSE_BAT_OK);
+	mouse_sendByte(0x00);
+	ps2mouse_task();
+	if (enables != was + 1) errors++;
+	mouse_sendByte(PS2_MOUSE_ACK);
+}
+
+static void mouse_bat(void) {
+	uint8_t packet[3];
+	unsigned long was;
+
+	if (!(rand() % 8)) mouse_plug();
+	was = enables;
+
+	// Overflow bits clear, so the first byte is never AA itself
+	packet[0] = 0x08 | (rand() & 0x37);
+	packet[1] = rand() & 1 ? PS2_MOUSE_BAT_OK : rand();
+	packet[2] = packet[1] == PS2_MOUSE_BAT_OK ? 0x00 : rand();
+
+	moved = 0;
+	for (uint8_t idx = 0; idx < 3; idx++) mouse_sendByte(packet[idx]);
+	ps2mouse_task();
+
+	if (enables != was || moved != 1) errors++;
+	else if (moved_dx != ((packet[0] & 0x10) ? packet[1] - 256 : packet[1]) ||
+			moved_dy != ((packet[0] & 0x20) ? packet[2] - 256 : packet[2]) || moved_buttons != (packet[0] & 0x07)) errors++;
+}
+
+int main(int argc, char **argv) {
+	unsigned long rounds = 1000;
+	unsigned int seed = 1;
+	int failed = 0;
+
+	for (int opt = 1; opt + 1 < argc; opt += 2) {
+		if (!strcmp(argv[opt], "-n")) rounds = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-s")) seed = strtoul(argv[opt + 1], NULL, 0);
+	}
+
+	printf("%lu rounds per row, seed %u, %lu generator ticks a report period\n\n", rounds, seed, (unsigned long)PERIOD_TICKS);
+	printf("%-8s %8s\n", "row", "errors");
+
+	for (uint8_t row = 0; row < ROW_COUNT; row++) {
+		srand(seed);
+		errors = resets = enables = 0;
+		PORTC = DDRC = 0;
+		quad_x = quad_y = 0;
+		amimouse_init();
+		ps2mouse_setCallback(mouse_moved);
+		ps2mouse_init();
+		if (resets != 1) errors++;
+		mouse_sendByte(PS2_MOUSE_ACK); // To the reset
+		mouse_plug();
+
+		for (unsigned long n = 0; n < rounds; n++) {
+			switch (row) {
+				case ROW_PHASES: mouse_phases(); break;
+				case ROW_SATURATE: mouse_saturate(); break;
+				case ROW_BAT: mouse_bat(); break;
+			}
+		}
+
+		printf("%-8s %8lu%s\n", row_names[row], errors, errors ? "  FAIL" : "");
+		if (errors) failed = 1;
+	}
+
+	return failed;
+}
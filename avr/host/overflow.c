@@ -0,0 +1,322 @@
+// Backpressure of the key pipeline, on the host: what the converter gives up, and what it must not,
+// when the host takes codes slower than the keyboard sends them.
+//
+//   overflow [-n rounds] [-s seed]
+//
+// Runs the PS/2 decoder, the converter and the macro engine on sim.c, with the host stalled
+// (sim_stall(): an Amiga that stopped handshaking) for a while in every round:
+//   burst    keys pressed and released at random during the stall, more than the queue holds
+//   hold     the same, but the keys still down when the host comes back are only released then
+//   repeat   a key held through the stall, with its typematic repeats
+//   macro    a macro key with the queue half full, and a macro cut short by an overflow (Amiga only)
+//   overrun  keys held, then a keyboard overrun code (0x00 or 0xFF), the host not stalled
+//   restart  more keys held than the queue takes, then a watchdog restart (sim_restart()): all of them go,
+//            and the options are back to the defaults
+//   reinit   the same with a keyboard re-init (ps2k_reinit(), the management port's), which must reset
+//            the keyboard once, after letting go of them and of the latched Caps Lock
+//   pause    keys held, then Pause: through the decoder, and through convcore_stream() on every device,
+//            in two chunks split anywhere, where it must give no action. Then an overrun, which must
+//            still give one
+// and prints the PS2K_DROP_* counters of each row. Checks, on what the host sees:
+//   bad      a make for a key the host holds (a typematic repeat on the PC/XT is fine),
+//            or a break for a key it does not hold, or a key let go that the user holds (pause),
+//            or convcore_stream() not giving what it must (pause)
+//   stuck    keys down on the host, once it has caught up, that the user does not hold
+// Exits with 1 if a row has any of either.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "output.h"
+#include "convtable.h"
+#include "key_macro.h"
+#include "ps2_converter.h"
+#include "conv_core.h"
+#include "ps2_proto.h"
+
+#define BURST_MIN   8  // Keystrokes during a stall, at least...
+#define BURST_RANGE 24 // ... and up to this many more
+#define REPEATS     30 // Typematic repeats through a stall
+#define HOLD_MIN    20 // Keys held through a restart, at least: more than the queue holds...
+#define HOLD_RANGE  24 // ... and up to this many more
+
+enum { CASE_BURST, CASE_HOLD, CASE_REPEAT, CASE_MACRO, CASE_OVERRUN, CASE_RESTART, CASE_REINIT, CASE_PAUSE, CASE_COUNT };
+static const char * const case_names[] = { "burst", "hold", "repeat", "macro", "overrun", "restart", "reinit", "pause" };
+
+static const uint8_t pause_seq[] = { 0xE1, 0x14, 0x77, 0xE1, 0xF0, 0x14, 0xF0, 0x77 };
+
+typedef struct {
+	uint8_t code;
+	uint8_t extended;
+	uint8_t key_code; // What the host gets
+} ovf_key_t;
+
+static ovf_key_t keys[256];
+static uint16_t key_count;
+static int16_t macro_key = -1; // PS/2 code of the first macro, if the table has one
+
+static uint8_t host_held[128];
+static uint8_t user_held[256]; // By index in keys[]
+static unsigned long host_codes, bad;
+static unsigned long keyb_resets;
+
+static void ovf_code(uint8_t code) {
+	uint8_t key = code & 0x7F;
+
+	host_codes++;
+	if (code & 0x80) {
+		if (!host_held[key]) bad++;
+		host_held[key] = 0;
+	} else {
+#if !defined (AKAB_OUTPUT_XT)
+		if (host_held[key]) bad++;
+#endif
+		host_held[key] = 1;
+	}
+}
+
+static void ovf_hostReset(void) {
+	memset(host_held, 0, sizeof(host_held));
+}
+
+static void ovf_command(const uint8_t *command, uint8_t length) {
+	if (length == 1 && command[0] == PS2_HTD_RESET) keyb_resets++;
+}
+
+static const sim_sink_t ovf_sink = { ovf_code, ovf_hostReset, ovf_command };
+
+static void ovf_addKey(uint8_t code, uint8_t extended, uint8_t key_code) {
+	if (key_code == CONV_MACRO_CODE(0) && !extended && macro_key < 0) macro_key = code;
+
+	// Plain keys only: no macros, resets or locks, so every keystroke is one make and one break
+	if (key_code == CONV_UNMAPPED || key_code == CONV_RESET_CODE || key_code == CONV_READOUT_CODE) return;
+	if (CONV_IS_MACRO(key_code) || key_code == CONV_CAPSLOCK_CODE) return;
+#if defined (AKAB_OUTPUT_XT)
+	if (key_code == CONV_NUMLOCK_CODE || key_code == CONV_SCROLLLOCK_CODE) return;
+#endif
+
+	keys[key_count].code = code;
+	keys[key_count].extended = extended;
+	keys[key_count].key_code = key_code;
+	key_count++;
+}
+
+static void ovf_keys(void) {
+	const uint8_t *entry;
+
+	for (uint16_t code = 1; code < CONV_NORMAL_SIZE; code++) ovf_addKey(code, 0, pgm_read_byte(&ps2_normal_convtable[code]));
+	for (entry = ps2_extended_convtable; pgm_read_byte(entry); entry += 2) ovf_addKey(pgm_read_byte(entry), 1, pgm_read_byte(entry + 1));
+}
+
+// A keystroke half on the wire, then a round of the main loop
+static void ovf_press(uint16_t idx) {
+	if (keys[idx].extended) sim_sendByte(PS2_SCANCODE_EXTENDED);
+	sim_sendByte(keys[idx].code);
+	user_held[idx] = 1;
+	sim_task();
+}
+
+static void ovf_release(uint16_t idx) {
+	if (keys[idx].extended) sim_sendByte(PS2_SCANCODE_EXTENDED);
+	sim_sendByte(PS2_SCANCODE_RELEASE);
+	sim_sendByte(keys[idx].code);
+	user_held[idx] = 0;
+	sim_task();
+}
+
+static void ovf_releaseAll(void) {
+	for (uint16_t idx = 0; idx < key_count; idx++) {
+		if (user_held[idx]) ovf_release(idx);
+	}
+}
+
+// Keys down on the host that the user does not hold, once the host has caught up
+static unsigned long ovf_stuck(void) {
+	uint8_t expected[128] = { 0 };
+	unsigned long stuck = 0;
+
+	sim_stall(0);
+	sim_drain();
+
+	for (uint16_t idx = 0; idx < key_count; idx++) {
+		if (user_held[idx]) expected[keys[idx].key_code] = 1;
+	}
+	for (uint8_t key = 0; key < 128; key++) {
+#if !defined (AKAB_OUTPUT_XT)
+		if (key == CONV_CAPSLOCK_CODE) continue; // Latched
+#endif
+		if (host_held[key] && !expected[key]) stuck++;
+	}
+
+	return stuck;
+}
+
+static void ovf_burst(void) {
+	uint8_t count = BURST_MIN + rand() % BURST_RANGE;
+
+	for (uint8_t n = 0; n < count; n++) {
+		uint16_t idx = rand() % key_count;
+
+		if (user_held[idx]) ovf_release(idx);
+		else ovf_press(idx);
+	}
+}
+
+// Pause then an overrun, through convcore_stream(): the first gives nothing, the second one OVERRUN
+static void ovf_streamPause(void) {
+	static convcore_t ctx;
+	convcore_action_t out[2 * CONVCORE_ACTIONS_MAX];
+	uint8_t overrun = rand() & 1 ? PS2_SCANCODE_OVERRUN : PS2_SCANCODE_OVERRUN_SET1;
+
+	convcore_init(&ctx);
+	for (uint8_t device = 0; device < CONVCORE_DEVICES; device++) {
+		size_t split = rand() % (sizeof(pause_seq) + 1);
+		size_t first, second, overruns;
+
+		if (convcore_stream(&ctx, device, pause_seq, split, out, sizeof(out) / sizeof(out[0]), &first) != split) bad++;
+		if (convcore_stream(&ctx, device, &pause_seq[split], sizeof(pause_seq) - split, out,
+						sizeof(out) / sizeof(out[0]), &second) != sizeof(pause_seq) - split) bad++;
+		if (first || second) bad++;
+
+		convcore_stream(&ctx, device, &overrun, 1, out, sizeof(out) / sizeof(out[0]), &overruns);
+		if (overruns != 1 || out[0].type != CONVCORE_OVERRUN) bad++;
+	}
+}
+
+static unsigned long ovf_round(uint8_t which) {
+	unsigned long stuck = 0;
+	uint16_t idx;
+
+	switch (which) {
+		case CASE_BURST:
+			sim_stall(1);
+			ovf_burst();
+			ovf_releaseAll();
+			break;
+		case CASE_HOLD:
+			sim_stall(1);
+			ovf_burst();
+			stuck += ovf_stuck();
+			ovf_releaseAll();
+			break;
+		case CASE_REPEAT:
+			idx = rand() % key_count;
+			sim_stall(1);
+			for (uint8_t n = 0; n < REPEATS; n++) ovf_press(idx);
+			stuck += ovf_stuck();
+			ovf_release(idx);
+			break;
+		case CASE_MACRO:
+			// Shed: the queue is half full when the macro key comes
+			sim_stall(1);
+			for (uint8_t n = 0; n < 10; n++) ovf_press(rand() % key_count);
+			sim_sendByte(macro_key);
+			sim_sendByte(PS2_SCANCODE_RELEASE);
+			sim_sendByte(macro_key);
+			ovf_releaseAll();
+			stuck += ovf_stuck();
+
+			// Cut short: the host stalls in the middle of the macro, and keys pile up behind it
+			sim_sendByte(macro_key);
+			sim_sendByte(PS2_SCANCODE_RELEASE);
+			sim_sendByte(macro_key);
+			sim_task();
+			sim_task();
+			sim_stall(1);
+			ovf_burst();
+			ovf_releaseAll();
+			break;
+		case CASE_OVERRUN:
+			for (uint8_t n = 1 + rand() % 6; n; n--) ovf_press(rand() % key_count);
+			sim_drain();
+			sim_sendByte(rand() & 1 ? PS2_SCANCODE_OVERRUN : PS2_SCANCODE_OVERRUN_SET1);
+			sim_drain();
+			for (uint8_t key = 0; key < 128; key++) stuck += host_held[key] && key != CONV_CAPSLOCK_CODE; // All of them let go
+			ovf_releaseAll();
+			break;
+		case CASE_RESTART:
+		case CASE_REINIT:
+			for (uint8_t n = HOLD_MIN + rand() % HOLD_RANGE; n; n--) {
+				idx = rand() % key_count;
+				if (!user_held[idx]) ovf_press(idx);
+			}
+			sim_drain();
+			keyb_resets = 0;
+			if (which == CASE_RESTART) {
+				// What was kept checks out, and the options are the build defaults again
+				if (!sim_restart() || ps2k_options() != CONVCORE_OPTS_DEFAULT) bad++;
+				ps2k_setOptions(PS2K_OPT_CAPS_LATCH);
+			} else {
+				ps2k_reinit();
+			}
+			sim_drain();
+			for (uint8_t key = 0; key < 128; key++) {
+				stuck += host_held[key] && (which == CASE_REINIT || key != CONV_CAPSLOCK_CODE); // All of them let go
+			}
+			if (keyb_resets != (which == CASE_REINIT)) bad++;
+			ovf_releaseAll(); // The core forgot them: the breaks go nowhere
+			break;
+		case CASE_PAUSE:
+			for (uint8_t n = 1 + rand() % 6; n; n--) ovf_press(rand() % key_count);
+			sim_drain();
+			for (uint8_t n = 0; n < sizeof(pause_seq); n++) sim_sendByte(pause_seq[n]);
+			sim_drain();
+			for (uint16_t idx = 0; idx < key_count; idx++) bad += user_held[idx] && !host_held[keys[idx].key_code];
+			ovf_streamPause();
+			ovf_releaseAll();
+			break;
+	}
+
+	return stuck + ovf_stuck();
+}
+
+int main(int argc, char **argv) {
+	unsigned long rounds = 1000; // The counters are 16 bit, as in the firmware
+	unsigned int seed = 1;
+	int failed = 0;
+
+	for (int opt = 1; opt + 1 < argc; opt += 2) {
+		if (!strcmp(argv[opt], "-n")) rounds = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-s")) seed = strtoul(argv[opt + 1], NULL, 0);
+	}
+
+	ovf_keys();
+	printf("%lu rounds per row, seed %u\n\n", rounds, seed);
+	printf("%-8s %8s %8s %8s %8s %9s %9s %6s %6s\n",
+		"case", "codes", "repeats", "macros", "presses", "overflows", "overruns", "stuck", "bad");
+
+	for (uint8_t which = 0; which < CASE_COUNT; which++) {
+		uint16_t before[PS2K_DROP_COUNT], after[PS2K_DROP_COUNT];
+		unsigned long stuck = 0;
+
+		if (which == CASE_MACRO && macro_key < 0) {
+			printf("%-8s %8s\n", case_names[which], "n/a");
+			continue;
+		}
+
+		memset(host_held, 0, sizeof(host_held));
+		memset(user_held, 0, sizeof(user_held));
+		host_codes = bad = 0;
+		sim_init(&ovf_sink);
+		ps2k_setOptions(PS2K_OPT_CAPS_LATCH); // No reset chord: random keys would hit it
+		srand(seed);
+		ps2k_dropCounts(before);
+
+		for (unsigned long n = 0; n < rounds; n++) stuck += ovf_round(which);
+
+		ps2k_dropCounts(after);
+		for (uint8_t idx = 0; idx < PS2K_DROP_COUNT; idx++) after[idx] -= before[idx];
+
+		printf("%-8s %8lu %8u %8u %8u %9u %9u %6lu %6lu%s\n",
+			case_names[which], host_codes, after[PS2K_DROP_REPEATS], after[PS2K_DROP_MACROS],
+			after[PS2K_DROP_PRESSES], after[PS2K_DROP_RELEASES], after[PS2K_DROP_OVERRUNS],
+			stuck, bad, (stuck || bad) ? "  FAIL" : "");
+
+		if (stuck || bad) failed = 1;
+	}
+
+	return failed;
+}
@@ -0,0 +1,242 @@
+// Amiga handshake pacing benchmark, on the host.
+//
+//   pacing [-n codes] [-s seed]
+//
+// Runs the real Amiga keyboard backend (amiga_keyb.c) against a simulated Amiga,
+// with simulated time: _delay_us() and Timer1 move a microsecond clock forward.
+// The Amiga reads KDAT on every rising edge of KCLK and, 8 bits later, after a
+// latency drawn from its profile, pulls KDAT low for the handshake:
+//   fast   20-40us
+//   slow   150-300us, past the 170us the backend used to wait
+//   busy   20-40us, but 5% of the handshakes 0.5-5ms late (interrupts off for a while)
+//   late   20-40us, but 1% of them 20-120ms late: still within the 143ms, so still no resync
+// For each profile it sends random codes back to back, amikbd_kProcessQueue() called as from
+// the main loop (a round every LOOP_US), and prints:
+//   code avg/max   time from the start of a code to the backend ready for the next one
+//   codes/s        throughput
+//   loop max       the longest amikbd_kProcessQueue() held the main loop
+//   wrong          codes the Amiga did not get as sent, per thousand
+//   extra bits     resync clocks the Amiga saw on top of the 8 bits of each code
+// Exits with 1 if a profile has any wrong code or extra bit: every one of them answers within
+// the 143ms the Amiga guarantees, so none may be taken for lost.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "amiga_keyb.h"
+#include "common/timing.h"
+
+#define KCLK_PNUM 0 // PB0
+#define KDAT_PNUM 3 // PD3, INT1
+
+#define HS_PULSE_US 85
+#define LOOP_US     10 // The rest of a main loop round
+
+#define MAX_RECEIVED 64
+
+void sim_int1_vect(void);
+
+typedef struct {
+	const char *name;
+	uint32_t min_us, max_us;     // Handshake latency, usually
+	uint16_t late_per_1000;      // Handshakes late by...
+	uint32_t late_min_us, late_max_us;
+} amiga_profile_t;
+
+static const amiga_profile_t profiles[] = {
+	{ "fast", 20, 40, 0, 0, 0 },
+	{ "slow", 150, 300, 0, 0, 0 },
+	{ "busy", 20, 40, 50, 500, 5000 },
+	{ "late", 20, 40, 10, 20000, 120000 },
+};
+
+static const amiga_profile_t *profile;
+
+static uint64_t now; // us
+static uint8_t in_handler;
+
+// The Amiga side
+static uint8_t kclk_low, kdat_level = 1;
+static uint8_t shift, bit_count;
+static uint64_t hs_start, hs_end; // 0: no handshake scheduled
+static uint8_t hs_active, hs_again;
+static uint8_t int1_flag;
+static uint32_t bits;
+
+static uint8_t received[MAX_RECEIVED];
+static uint8_t received_count;
+
+uint16_t sim_tcnt1(void);
+
+static uint32_t pacing_random(uint32_t min, uint32_t max) {
+	return min + (uint32_t)rand() % (max - min + 1);
+}
+
+static void amiga_handshake(void) {
+	uint32_t latency = pacing_random(profile->min_us, profile->max_us);
+
+	if (profile->late_per_1000 && (uint32_t)rand() % 1000 < profile->late_per_1000)
+		latency = pacing_random(profile->late_min_us, profile->late_max_us);
+
+	hs_start = now + latency;
+	hs_end = hs_start + HS_PULSE_US;
+}
+
+static void amiga_int1(void) {
+	uint8_t sense = EICRA & ((1 << ISC11) | (1 << ISC10));
+
+	if (EIFR & (1 << INTF1)) { // Writing a one clears the flag
+		int1_flag = 0;
+		EIFR = 0;
+	}
+
+	if (in_handler || !(EIMSK & (1 << INT1))) return;
+
+	if ((sense == 0 && !kdat_level) || (sense == (1 << ISC11) && int1_flag)) {
+		int1_flag = 0;
+		in_handler = 1;
+		sim_int1_vect();
+		in_handler = 0;
+	}
+}
+
+// What the lines look like now, from what both sides drive
+static void amiga_lines(void) {
+	uint8_t clk = (DDRB & (1 << KCLK_PNUM)) ? 1 : 0; // The keyboard pulls a line low by making it an output
+	uint8_t dat = !((DDRD & (1 << KDAT_PNUM)) || hs_active);
+
+	if (kclk_low && !clk) { // Rising edge: the Amiga shifts the (inverted) data bit in
+		shift = (shift << 1) | !dat;
+		bits++;
+		if (++bit_count == 8) {
+			if (received_count < MAX_RECEIVED) received[received_count++] = (shift >> 1) | (shift << 7); // Sent 6..0, then 7
+			bit_count = 0;
+			if (!hs_start) amiga_handshake();
+			else hs_again = 1; // Right after the one going on
+		}
+	}
+	kclk_low = clk;
+
+	if (kdat_level && !dat) int1_flag = 1;
+	kdat_level = dat;
+
+	if (dat) PIND |= (1 << KDAT_PNUM);
+	else PIND &= ~(1 << KDAT_PNUM);
+
+	amiga_int1();
+}
+
+static void pacing_advance(uint32_t us) {
+	uint64_t end = now + us;
+
+	amiga_lines();
+
+	while (hs_start && (hs_active ? hs_end : hs_start) <= end) {
+		now = hs_active ? hs_end : hs_start;
+		if (!hs_active) {
+			hs_active = 1;
+		} else {
+			hs_active = 0;
+			hs_start = 0;
+			if (hs_again) amiga_handshake();
+			hs_again = 0;
+		}
+		amiga_lines();
+	}
+
+	now = end;
+}
+
+void sim_delayUs(uint32_t us) {
+	pacing_advance(us);
+}
+
+uint16_t sim_tcnt1(void) {
+	pacing_advance(1); // A read in a polling loop: about 1us a round at 8MHz, taken as such at 16MHz too
+
+	return (TCCR1B & ((1 << CS12) | (1 << CS11) | (1 << CS10))) ? (uint16_t)TIMING_T1_TICKS(now) : 0; // Prescaler 8
+}
+
+static int pacing_run(const amiga_profile_t *prof, unsigned long count, unsigned int seed) {
+	uint64_t start, total = 0, code_max = 0, elapsed, call, loop_max = 0;
+	unsigned long wrong = 0, extra_bits = 0;
+	uint8_t code;
+	uint32_t bits_before;
+
+	profile = prof;
+	srand(seed);
+
+	now = 0;
+	DDRB = DDRD = PORTB = PORTD = 0;
+	PIND = 0xFF;
+	EICRA = EIMSK = EIFR = 0;
+	TCCR1A = TCCR1B = 0;
+
+	amikbd_setup(&PORTB, &DDRB, KCLK_PNUM, &PORTD, &DDRD, 0);
+	amikbd_kForceReset(); // Another Amiga: the backend forgets what it learnt about the last one
+
+	kclk_low = 0;
+	kdat_level = 1;
+	shift = bit_count = 0;
+	hs_start = hs_end = 0;
+	hs_active = hs_again = 0;
+	int1_flag = 0;
+	bits = 0;
+
+	amikbd_init(); // Sync and the power-up stream: not counted
+	pacing_advance(1000);
+
+	for (unsigned long n = 0; n < count; n++) {
+		code = rand() & 0xFF;
+		if (code == 0xFF) code = 0x7F; // Never sent
+
+		received_count = 0;
+		bits_before = bits;
+		start = now;
+
+		amikbd_kQueueCommand(code);
+		do {
+			call = now;
+			amikbd_kProcessQueue();
+			if (now - call > loop_max) loop_max = now - call;
+			if (!amikbd_kQueueEmpty()) pacing_advance(LOOP_US);
+		} while (!amikbd_kQueueEmpty());
+
+		elapsed = now - start;
+		total += elapsed;
+		if (elapsed > code_max) code_max = elapsed;
+
+		// The code itself, and nothing else: resync clocks shift the Amiga's next codes
+		extra_bits += bits - bits_before - 8;
+		if (received_count != 1 || received[0] != code || bits - bits_before != 8) wrong++;
+	}
+
+	printf("%-5s %10.1fus %10.1fus %10.0f %8.1fus %10.1f %10lu%s\n", prof->name,
+		(double)total / count, (double)code_max, count * 1e6 / total, (double)loop_max, 1000.0 * wrong / count,
+		extra_bits, (wrong || extra_bits) ? "  FAIL" : "");
+
+	return wrong || extra_bits;
+}
+
+int main(int argc, char **argv) {
+	unsigned long count = 20000;
+	unsigned int seed = 1;
+	int failed = 0;
+
+	for (int opt = 1; opt + 1 < argc; opt += 2) {
+		if (!strcmp(argv[opt], "-n")) count = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-s")) seed = strtoul(argv[opt + 1], NULL, 0);
+	}
+
+	printf("%lu codes per profile, seed %u\n\n", count, seed);
+	printf("%-5s %12s %12s %10s %10s %10s %10s\n", "amiga", "code avg", "code max", "codes/s", "loop max", "wrong/1k", "extra bits");
+
+	for (uint8_t idx = 0; idx < sizeof(profiles) / sizeof(profiles[0]); idx++)
+		if (pacing_run(&profiles[idx], count, seed)) failed = 1;
+
+	return failed;
+}
@@ -0,0 +1,16 @@
+// The registers of shim/avr/io.h, shared by every host build
+
+#include <avr/io.h>
+
+volatile uint8_t PORTB, DDRB, PINB;
+volatile uint8_t PORTC, DDRC;
+volatile uint8_t PORTD, DDRD, PIND;
+volatile uint8_t EICRA, EIMSK, EIFR;
+volatile uint8_t PCICR, PCIFR, PCMSK1, PCMSK2;
+volatile uint8_t SREG;
+volatile uint8_t CLKPR;
+volatile uint8_t TCCR1A, TCCR1B;
+volatile uint8_t TIMSK1, TIFR1;
+volatile uint16_t ICR1, OCR1B;
+volatile uint8_t TCCR2A, TCCR2B, OCR2A, TCNT2, TIMSK2, TIFR2;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UBRR0H, UBRR0L;
@@ -0,0 +1,16 @@
+#ifndef _HOST_SHIM_ARDUINO_H_
+#define _HOST_SHIM_ARDUINO_H_
+
+// Host stand-in for the Arduino core, as far as the pcxtkbd sketch's xt_tx.cpp uses it.
+// Handlers only run between two calls into the sketch, so interrupts need no masking
+
+#include <stdint.h>
+
+#include <avr/io.h>
+
+unsigned long millis(void); // Simulated time, kept by xttx.cpp
+
+#define noInterrupts() do { } while (0)
+#define interrupts()   do { } while (0)
+
+#endif
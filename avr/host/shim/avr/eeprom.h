@@ -0,0 +1,40 @@
+#ifndef _HOST_SHIM_EEPROM_H_
+#define _HOST_SHIM_EEPROM_H_
+
+// Host stand-in for <avr/eeprom.h>: EEMEM variables live in a section of their own, which a tool
+// can set to 0xFF (between __start_sim_eeprom and __stop_sim_eeprom) for an erased EEPROM.
+// Every byte that changes counts in sim_eepromWrites, and with SIM_TIME takes the time the AVR takes
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <util/delay.h>
+
+#define EEMEM __attribute__ ((section ("sim_eeprom")))
+
+#define SIM_EEPROM_WRITE_US 3400 // Erase and write of one byte
+
+extern uint32_t sim_eepromWrites;
+
+static inline uint8_t eeprom_read_byte(const uint8_t *addr) {
+	return *addr;
+}
+
+static inline void eeprom_read_block(void *dst, const void *src, size_t n) {
+	memcpy(dst, src, n);
+}
+
+static inline void eeprom_update_byte(uint8_t *addr, uint8_t value) {
+	if (*addr == value) return;
+
+	*addr = value;
+	sim_eepromWrites++;
+	_delay_us(SIM_EEPROM_WRITE_US);
+}
+
+static inline void eeprom_update_block(const void *src, void *dst, size_t n) {
+	for (size_t idx = 0; idx < n; idx++) eeprom_update_byte((uint8_t *)dst + idx, ((const uint8_t *)src)[idx]);
+}
+
+#endif
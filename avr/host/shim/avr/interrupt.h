@@ -0,0 +1,20 @@
+#ifndef _HOST_SHIM_INTERRUPT_H_
+#define _HOST_SHIM_INTERRUPT_H_
+
+// Handlers become plain functions, called by sim.c when the simulated hardware would
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+#define INT0_vect   sim_int0_vect
+#define INT1_vect   sim_int1_vect
+#define PCINT1_vect sim_pcint1_vect
+#define PCINT2_vect sim_pcint2_vect
+#define TIMER1_CAPT_vect sim_timer1_capt_vect
+#define TIMER1_COMPB_vect sim_timer1_compb_vect
+#define TIMER2_COMPA_vect sim_timer2_compa_vect
+#define USART_RX_vect sim_usart_rx_vect
+
+#define sei() do { } while (0)
+#define cli() do { } while (0)
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _HOST_SHIM_IO_H_
+#define _HOST_SHIM_IO_H_
+
+// Host stand-in for <avr/io.h>: the ATmega328P registers the PS/2 side touches, as plain
+// variables (defined in sim.c). Bit numbers are the real ones.
+
+#include <stdint.h>
+
+#define _BV(b) (1 << (b))
+
+extern volatile uint8_t PORTB, DDRB, PINB;
+extern volatile uint8_t PORTC, DDRC;
+extern volatile uint8_t PORTD, DDRD, PIND;
+extern volatile uint8_t EICRA, EIMSK, EIFR;
+extern volatile uint8_t PCICR, PCIFR, PCMSK1, PCMSK2;
+extern volatile uint8_t SREG;
+extern volatile uint8_t CLKPR;
+#define CLKPR CLKPR
+extern volatile uint8_t TCCR1A, TCCR1B;
+extern volatile uint8_t TIMSK1, TIFR1;
+extern volatile uint16_t ICR1; // Set by sim.c on a captured edge
+extern volatile uint16_t OCR1B; // Compared by xtpacing.c
+extern volatile uint8_t TCCR2A, TCCR2B, OCR2A, TCNT2, TIMSK2, TIFR2;
+
+// Timer1 counts simulated time (SIM_TIME builds only)
+uint16_t sim_tcnt1(void);
+#define TCNT1 (sim_tcnt1())
+
+// USART0. UDR0 goes through mgmt_sim.c: reads in the receive handler give the byte received,
+// every other access is a byte sent
+extern volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UBRR0H, UBRR0L;
+volatile uint8_t *sim_udr0(void);
+#define UDR0 (*sim_udr0())
+
+// Writing ones to PINC toggles pins (the trace markers): every write lands in its own slot,
+// so two markers in one handler both reach sim.c, which counts them.
+// With SIM_PINC_LINES, a plain register instead, read for the PORTC input lines (the PS/2 mouse)
+#ifdef SIM_PINC_LINES
+extern volatile uint8_t PINC;
+#else
+volatile uint8_t *sim_pincWrite(void);
+#define PINC (*sim_pincWrite())
+#endif
+
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+#define INT0  0
+#define INT1  1
+#define INTF0 0
+#define INTF1 1
+#define PCIE1 1
+#define PCIE2 2
+#define PCIF1 1
+#define PCIF2 2
+#define PCINT8  0
+#define PCINT23 7
+#define CS10  0
+#define CS11  1
+#define CS12  2
+#define ICES1 6
+#define ICNC1 7
+#define ICIE1 5
+#define ICF1  5
+#define OCIE1B 2
+#define OCF1B  2
+#define WGM21  1
+#define CS21   1
+#define OCIE2A 1
+#define OCF2A  1
+#define U2X0   1
+#define DOR0   3
+#define FE0    4
+#define UDRE0  5
+#define TXEN0  3
+#define RXEN0  4
+#define RXCIE0 7
+
+#endif
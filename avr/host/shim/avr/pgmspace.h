@@ -0,0 +1,11 @@
+#ifndef _HOST_SHIM_PGMSPACE_H_
+#define _HOST_SHIM_PGMSPACE_H_
+
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+
+#endif
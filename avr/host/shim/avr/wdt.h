@@ -0,0 +1,19 @@
+#ifndef _HOST_SHIM_WDT_H_
+#define _HOST_SHIM_WDT_H_
+
+// Host stand-in for <avr/wdt.h>: no watchdog on the host. With SIM_TIME the kicks go to the
+// simulation, which can time the gaps between them
+
+#define WDTO_1S 6
+
+#ifdef SIM_TIME
+void sim_wdtReset(void);
+
+#define wdt_reset()   sim_wdtReset()
+#else
+#define wdt_reset()   do { } while (0)
+#endif
+#define wdt_enable(t) do { } while (0)
+#define wdt_disable() do { } while (0)
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _HOST_SHIM_ATOMIC_H_
+#define _HOST_SHIM_ATOMIC_H_
+
+// Handlers are called synchronously on the host: nothing can interrupt a block
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+#define ATOMIC_BLOCK(type) for (uint8_t _atomic_once = 1; _atomic_once; _atomic_once = 0)
+
+#endif
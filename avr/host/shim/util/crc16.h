@@ -0,0 +1,22 @@
+#ifndef _HOST_SHIM_CRC16_H_
+#define _HOST_SHIM_CRC16_H_
+
+// Host stand-in for <util/crc16.h>: the C equivalent avr-libc documents for its assembler version
+
+#include <stdint.h>
+
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data) {
+	crc ^= (uint16_t)data << 8;
+	for (uint8_t bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+
+	return crc;
+}
+
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data) {
+	crc ^= data;
+	for (uint8_t bit = 0; bit < 8; bit++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+
+	return crc;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _HOST_SHIM_DELAY_H_
+#define _HOST_SHIM_DELAY_H_
+
+#include <stdint.h>
+
+#ifdef SIM_TIME
+// The simulation keeps a clock: waits move it forward (and run what happens meanwhile)
+void sim_delayUs(uint32_t us);
+
+#define _delay_us(us) sim_delayUs(us)
+#define _delay_ms(ms) sim_delayUs((ms) * 1000UL)
+#else
+// No waiting on the host: the simulation has no notion of time
+#define _delay_us(us) do { } while (0)
+#define _delay_ms(ms) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,266 @@
+#include "sim.h"
+
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "output.h"
+#include "ps2_keyb.h"
+#include "ps2_converter.h"
+#include "key_macro.h"
+#include "instrument.h"
+#include "common/trace.h"
+#include "common/timing.h"
+
+#ifdef AKAB_PS2_ICP
+#define SIM_CLK_PIN   PINB
+#define SIM_CLK_PNUM  0 // PB0, ICP1
+#else
+#define SIM_CLK_PIN   PIND
+#define SIM_CLK_PNUM  2 // PD2, INT0
+#endif
+#define SIM_DATA_PNUM 1 // PB1
+#define SIM_CLK2_PNUM  7 // PD7, second keyboard (AKAB_KEYB2)
+#define SIM_DATA2_PNUM 6 // PD6
+
+#define SIM_PHASE_US 40 // Clock phase of sim_sendFrame(): 12.5kHz
+#define SIM_GAP_US   100 // After each frame
+
+#define SIM_QUEUE_SIZE 16 // As the real backends
+#define SIM_PINC_WRITES 8 // Per INT0 handler run, at most
+
+void sim_int0_vect(void);
+void sim_timer1_capt_vect(void);
+void sim_pcint2_vect(void);
+
+static const sim_sink_t *sink;
+
+uint32_t sim_framesReceived;
+uint32_t sim_now;
+
+static volatile uint8_t pinc_writes[SIM_PINC_WRITES];
+static uint8_t pinc_count;
+
+static uint8_t queue[SIM_QUEUE_SIZE];
+static uint8_t q_in, q_out;
+static uint8_t stalled;
+
+// ---- Output backend, both flavours: output.h picks one at build time
+
+static uint8_t sim_queue(uint8_t code) {
+	if (code == 0xFF) return 1;
+	if (((q_in + 1) & (SIM_QUEUE_SIZE - 1)) == q_out) return 0;
+
+	queue[q_in] = code;
+	q_in = (q_in + 1) & (SIM_QUEUE_SIZE - 1);
+	return 1;
+}
+
+static uint8_t sim_queueFree(void) {
+	return (q_out - q_in - 1) & (SIM_QUEUE_SIZE - 1);
+}
+
+static void sim_processQueue(void) {
+	uint8_t code;
+
+	if (q_in == q_out || stalled) return;
+
+	code = queue[q_out];
+	q_out = (q_out + 1) & (SIM_QUEUE_SIZE - 1);
+	if (sink && sink->code) sink->code(code);
+}
+
+void amikbd_setup(volatile uint8_t *clockPort, volatile uint8_t *clockDir, uint8_t clockPNum, volatile uint8_t *resetPort, volatile uint8_t *resetDir, uint8_t resetPNum) { }
+void amikbd_init(void) { }
+uint8_t amikbd_kQueueCommand(uint8_t command) { return sim_queue(command); }
+uint8_t amikbd_kQueueEmpty(void) { return q_in == q_out; }
+uint8_t amikbd_kQueueFree(void) { return sim_queueFree(); }
+void amikbd_kProcessQueue(void) { sim_processQueue(); }
+
+void amikbd_kForceReset(void) {
+	q_out = q_in;
+	if (sink && sink->hostReset) sink->hostReset();
+}
+
+void xtkbd_setup(volatile uint8_t *clockPort, volatile uint8_t *clockDir, volatile uint8_t *clockPin, uint8_t clockPNum,
+				volatile uint8_t *dataPort, volatile uint8_t *dataDir, volatile uint8_t *dataPin, uint8_t dataPNum) { }
+void xtkbd_init(void) { }
+uint8_t xtkbd_queueCommand(uint8_t command) { return sim_queue(command); }
+uint8_t xtkbd_queueEmpty(void) { return q_in == q_out; }
+uint8_t xtkbd_queueFree(void) { return sim_queueFree(); }
+void xtkbd_processQueue(void) { sim_processQueue(); }
+
+// ---- Firmware pieces that need the real hardware
+
+// Replaces the bit-banged sender of ps2_keyb.c (renamed away by the Makefile): there is no device to clock it
+void ps2keyb_sendCommand(uint8_t *command, uint8_t length) {
+	if (sink && sink->command) sink->command(command, length);
+}
+
+// instrument.c paints the real stack: not built here
+void instr_requestReadout(void) { }
+void instr_latencyStart(uint16_t stamp) { }
+
+// Timer1 at F_CPU / 8: 1us a tick at 8MHz, 0.5us at 16MHz
+static uint16_t sim_ticks(void) {
+	return (uint16_t)TIMING_T1_TICKS((uint64_t)sim_now);
+}
+
+uint16_t sim_tcnt1(void) {
+	return sim_ticks();
+}
+
+volatile uint8_t *sim_pincWrite(void) {
+	if (pinc_count < SIM_PINC_WRITES) return &pinc_writes[pinc_count++];
+	return &pinc_writes[SIM_PINC_WRITES - 1];
+}
+
+// ---- Lines and main loop
+
+void sim_init(const sim_sink_t *new_sink) {
+	sink = new_sink;
+	q_in = q_out = 0;
+	stalled = 0;
+	sim_framesReceived = 0;
+	sim_now = 0;
+
+	PORTB = DDRB = 0;
+	PORTC = DDRC = 0;
+	pinc_count = 0;
+	PORTD = DDRD = 0;
+	EICRA = EIMSK = EIFR = 0;
+	TCCR1A = TCCR1B = TIMSK1 = TIFR1 = 0;
+	PINB = PIND = 0;
+	PINB |= (1 << SIM_DATA_PNUM); // Idle lines are high
+	SIM_CLK_PIN |= (1 << SIM_CLK_PNUM);
+	PCICR = PCIFR = PCMSK2 = 0;
+
+	ps2keyb_init(&PORTB, &DDRB, &PINB, SIM_DATA_PNUM);
+	ps2keyb_setCallback(ps2k_callback);
+#ifdef AKAB_KEYB2
+	PIND |= (1 << SIM_CLK2_PNUM) | (1 << SIM_DATA2_PNUM);
+	ps2keyb_initSecond();
+#endif
+	ps2k_reset();
+
+	kmacro_abort();
+	sim_drain();
+}
+
+void sim_stall(uint8_t stall) {
+	stalled = stall;
+}
+
+void sim_resync(void) {
+	PINB |= (1 << SIM_DATA_PNUM);
+	SIM_CLK_PIN |= (1 << SIM_CLK_PNUM);
+	ps2keyb_init(&PORTB, &DDRB, &PINB, SIM_DATA_PNUM);
+#ifdef AKAB_KEYB2
+	PIND |= (1 << SIM_CLK2_PNUM) | (1 << SIM_DATA2_PNUM);
+	ps2keyb_initSecond();
+#endif
+}
+
+uint8_t sim_restart(void) {
+	q_in = q_out = 0; // Not kept: codes not clocked out yet are lost
+	sim_resync();
+	if (ps2k_restart()) return 1;
+
+	ps2k_reset(); // The firmware starts cold
+	return 0;
+}
+
+// The trace markers the handler just wrote
+static void sim_countFrames(void) {
+#ifdef AKAB_TRACE
+	for (uint8_t idx = 0; idx < pinc_count; idx++)
+		if (pinc_writes[idx] & (1 << TRACE_FRAME_PNUM)) sim_framesReceived++;
+#endif
+	pinc_count = 0;
+}
+
+void sim_lines(uint8_t clock, uint8_t data) {
+	uint8_t was = (SIM_CLK_PIN >> SIM_CLK_PNUM) & 1;
+
+	if (data) PINB |= (1 << SIM_DATA_PNUM);
+	else PINB &= ~(1 << SIM_DATA_PNUM);
+
+	if (clock) SIM_CLK_PIN |= (1 << SIM_CLK_PNUM);
+	else SIM_CLK_PIN &= ~(1 << SIM_CLK_PNUM);
+
+#ifdef AKAB_PS2_ICP
+	// Falling edges only (ICES1 clear), captured now: the handler runs right away
+	if (!(TIMSK1 & (1 << ICIE1)) || (TCCR1B & (1 << ICES1)) || was == !!clock || clock) return;
+
+	ICR1 = sim_ticks();
+	sim_timer1_capt_vect();
+#else
+	uint8_t sense = EICRA & ((1 << ISC01) | (1 << ISC00));
+
+	if (!(EIMSK & (1 << INT0)) || was == !!clock) return;
+
+	if ((!clock && sense == (1 << ISC01)) || (clock && sense == ((1 << ISC01) | (1 << ISC00))))
+		sim_int0_vect();
+#endif
+
+	sim_countFrames();
+}
+
+#ifdef AKAB_KEYB2
+void sim_lines2(uint8_t clock, uint8_t data) {
+	uint8_t was = (PIND >> SIM_CLK2_PNUM) & 1;
+
+	if (data) PIND |= (1 << SIM_DATA2_PNUM);
+	else PIND &= ~(1 << SIM_DATA2_PNUM);
+
+	if (clock) PIND |= (1 << SIM_CLK2_PNUM);
+	else PIND &= ~(1 << SIM_CLK2_PNUM);
+
+	if (!(PCICR & (1 << PCIE2)) || !(PCMSK2 & (1 << PCINT23)) || was == !!clock) return;
+
+	sim_pcint2_vect();
+	sim_countFrames();
+}
+#endif
+
+void sim_sendFrame(uint16_t bits, uint8_t count) {
+	while (count--) {
+		sim_lines(1, bits & 1);
+		sim_now += SIM_PHASE_US;
+		sim_lines(0, bits & 1); // The device changes data while the clock is high, the host reads it on the falling edge
+		sim_now += SIM_PHASE_US;
+		sim_lines(1, bits & 1);
+		bits >>= 1;
+	}
+	sim_lines(1, 1);
+	sim_now += SIM_GAP_US;
+}
+
+uint8_t sim_parity(uint8_t value) {
+	uint8_t ones = 0;
+
+	while (value) {
+		ones += value & 1;
+		value >>= 1;
+	}
+
+	return !(ones & 1);
+}
+
+void sim_sendByte(uint8_t value) {
+	// Start (0), 8 data bits, odd parity, stop (1)
+	sim_sendFrame(((uint16_t)value << 1) | ((uint16_t)sim_parity(value) << 9) | (1 << 10), 11);
+}
+
+void sim_task(void) {
+	ps2k_task();
+	kmacro_task();
+	out_task();
+}
+
+void sim_drain(void) {
+	uint16_t rounds = 0;
+
+	// A macro is a few codes long: anything that takes longer is stuck, and the checks will say so
+	while ((!out_queueEmpty() || kmacro_running() || ps2k_releasing()) && ++rounds < 1000) sim_task();
+}
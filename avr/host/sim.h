@@ -0,0 +1,45 @@
+#ifndef _HOST_SIM_HEADER_
+#define _HOST_SIM_HEADER_
+
+#include <stdint.h>
+
+// Host simulation of the adapter around the firmware's PS/2 decoder and converter:
+// the keyboard lines (PS/2 data on PB1, clock on PD2 with INT0 as the hardware would
+// fire it, or on PB0 with the Timer1 input capture in a PS2_RX=icp build), the main
+// loop, and an output backend that hands every code to a sink instead of clocking it out.
+
+typedef struct {
+	void (*code)(uint8_t code);   // A code reaches the host (bit 7 set for a release)
+	void (*hostReset)(void);      // The converter resets the host
+	void (*command)(const uint8_t *command, uint8_t length); // Host to keyboard command
+} sim_sink_t;
+
+void sim_init(const sim_sink_t *sink); // Power on: registers, decoder, converter and queues
+void sim_resync(void);                 // Keyboard unplugged and plugged again: the decoder starts over
+uint8_t sim_restart(void);             // Watchdog restart: the queue and the decoder start over, the converter's held keys and locks are kept. 0: they did not check out
+void sim_stall(uint8_t stall);         // 1: the host stops taking codes, as an Amiga that no longer handshakes. 0: it takes them again
+
+// Simulated time in microseconds, what Timer1 counts (1us a tick) and captures.
+// Only the PS2_RX=icp receiver looks at it
+extern uint32_t sim_now;
+
+// Drives the lines at sim_now: data first, then the clock. INT0 fires on the edge it is set up for
+void sim_lines(uint8_t clock, uint8_t data);
+
+#ifdef AKAB_KEYB2
+// The second keyboard: clock on PD7 (PCINT23, the pin change handler fires on both edges), data on PD6
+void sim_lines2(uint8_t clock, uint8_t data);
+#endif
+
+void sim_sendByte(uint8_t value);                // A well formed device-to-host frame
+void sim_sendFrame(uint16_t bits, uint8_t count); // count bits, LSB first, each one 80us clock pulse, then a gap
+void sim_task(void);                             // One main loop round
+void sim_drain(void);                            // Main loop until the queue, the macros and a release of every key are idle
+
+uint8_t sim_parity(uint8_t value); // Odd parity bit of a byte
+
+// Valid frames the decoder accepted since sim_init(), counted on its TRACE_FRAME() marker.
+// Only counts in a build with AKAB_TRACE
+extern uint32_t sim_framesReceived;
+
+#endif /* _HOST_SIM_HEADER_ */
@@ -0,0 +1,192 @@
+// A PC/XT host on simulated time: see xthost.h
+
+#include "xthost.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define US 1000ULL
+#define MS 1000000ULL
+
+static const uint64_t phase_ns[XTHOST_PHASES] = { 120 * US, 66 * US, 30 * US, 66 * US, 30 * US };
+
+static uint64_t xthost_random(uint64_t min, uint64_t max) {
+	return min + ((uint64_t)rand() * RAND_MAX + rand()) % (max - min + 1);
+}
+
+// The next inhibit or reset, on average every_ms from now
+static uint64_t xthost_next(uint64_t now, uint32_t every_ms) {
+	return every_ms ? now + xthost_random(0, 2 * every_ms * MS) : UINT64_MAX;
+}
+
+void xthost_init(xthost_t *host, const xthost_profile_t *profile, uint64_t now) {
+	memset(host, 0, sizeof(*host));
+	host->profile = profile;
+	host->clk = host->dat = 1;
+	host->gap_min = host->selftest_min = UINT64_MAX;
+	for (uint8_t idx = 0; idx < XTHOST_PHASES; idx++) host->phase_min[idx] = UINT64_MAX;
+
+	host->inhibit_start = xthost_next(now, profile->inhibit_every_ms);
+	host->reset_start = xthost_next(now, profile->reset_every_ms);
+}
+
+void xthost_quiet(xthost_t *host) {
+	host->inhibit_start = host->reset_start = UINT64_MAX;
+}
+
+void xthost_expect(xthost_t *host, uint8_t value, uint64_t now) {
+	host->expect[host->exp_in] = value;
+	host->expect_at[host->exp_in] = now;
+	host->exp_in = (host->exp_in + 1) & (XTHOST_EXPECT_SIZE - 1);
+}
+
+static uint16_t xthost_expected(const xthost_t *host) {
+	return (host->exp_in - host->exp_out) & (XTHOST_EXPECT_SIZE - 1);
+}
+
+static void xthost_phase(xthost_t *host, uint8_t phase, uint64_t length) {
+	if (length < host->phase_min[phase]) host->phase_min[phase] = length;
+	if (length > host->phase_max[phase]) host->phase_max[phase] = length;
+	if (length + XTHOST_PHASE_SLACK_NS < phase_ns[phase] || length > phase_ns[phase] + XTHOST_PHASE_SLACK_NS) host->timing++;
+}
+
+static void xthost_received(xthost_t *host, uint8_t value, uint64_t now) {
+	uint16_t idx;
+
+	host->bytes++;
+
+	if (host->reset_pending) { // 0xAA first, then the bytes expected so far may have been flushed
+		uint64_t elapsed = now - host->reset_end;
+
+		host->reset_pending = 0;
+		if (value != 0xAA || elapsed < XTHOST_SELFTEST_MIN_MS * MS || elapsed > XTHOST_SELFTEST_MAX_MS * MS) host->selftest_bad++;
+		if (elapsed < host->selftest_min) host->selftest_min = elapsed;
+		if (elapsed > host->selftest_max) host->selftest_max = elapsed;
+		if (value == 0xAA) { // The bytes taken before it started are flushed, the ones after it go out
+			while (host->exp_in != host->exp_out && host->expect_at[host->exp_out] < host->frame_start) {
+				host->exp_out = (host->exp_out + 1) & (XTHOST_EXPECT_SIZE - 1);
+				host->flushed++;
+			}
+			return;
+		}
+	}
+
+	if (host->exp_in != host->exp_out && host->expect[host->exp_out] == value) {
+		host->exp_out = (host->exp_out + 1) & (XTHOST_EXPECT_SIZE - 1);
+		return;
+	}
+
+	// Not the next one: missing ones in between, or a byte never sent
+	host->wrong++;
+	for (idx = host->exp_out; idx != host->exp_in; idx = (idx + 1) & (XTHOST_EXPECT_SIZE - 1)) {
+		if (host->expect[idx] == value) {
+			host->exp_out = (idx + 1) & (XTHOST_EXPECT_SIZE - 1);
+			break;
+		}
+	}
+}
+
+void xthost_finish(xthost_t *host) {
+	if (host->reset_pending) host->selftest_bad++;
+	host->wrong += xthost_expected(host);
+	host->exp_out = host->exp_in;
+}
+
+uint8_t xthost_failed(const xthost_t *host) {
+	return host->short_frames || host->wrong || host->selftest_bad || host->timing || host->data_moved;
+}
+
+// The host takes the clock: a frame under way is cut, the keyboard sends it again
+static void xthost_takeClock(xthost_t *host) {
+	host->clk_low = 1;
+	if (host->edges && host->edges < 10) host->cut++;
+	host->edges = 0;
+	host->gap_valid = 0;
+}
+
+// What the host does at now: inhibits, resets, and releasing data once a byte is read
+static void xthost_act(xthost_t *host, uint64_t now) {
+	const xthost_profile_t *prof = host->profile;
+
+	if (host->dat_low && now >= host->busy_end) host->dat_low = 0;
+
+	if (host->clk_low) {
+		if (host->resetting && now >= host->reset_end) { // Released: 0xAA is due
+			host->clk_low = host->resetting = 0;
+			host->reset_pending = 1;
+			host->resets++;
+			host->reset_start = xthost_next(now, prof->reset_every_ms);
+		} else if (!host->resetting && now >= host->inhibit_end) {
+			host->clk_low = 0;
+			host->inhibit_start = xthost_next(now, prof->inhibit_every_ms);
+		}
+		return;
+	}
+
+	if (now >= host->reset_start) {
+		xthost_takeClock(host);
+		host->dat_low = 0; // The BIOS clears the keyboard shift register too: the 0xAA goes out on time
+		host->resetting = 1;
+		host->reset_end = now + XTHOST_RESET_MS * MS;
+		host->reset_start = UINT64_MAX;
+	} else if (now >= host->inhibit_start && !host->reset_pending) { // Not while it waits for 0xAA, as the BIOS
+		xthost_takeClock(host);
+		host->inhibit_end = now + xthost_random(prof->inhibit_min_us, prof->inhibit_max_us) * US;
+		host->inhibit_start = UINT64_MAX;
+	}
+}
+
+void xthost_step(xthost_t *host, uint64_t now, uint8_t clk, uint8_t dat) {
+	const xthost_profile_t *prof = host->profile;
+
+	if (clk != host->clk) {
+		host->clk = clk;
+
+		if (host->clk_low) {
+			// Our own edge
+		} else if (!clk) {
+			if (!host->edges) { // Start of a frame: data released, at least a gap after the last one
+				if (!dat) host->timing++;
+				host->frame_start = now;
+				if (host->gap_valid) {
+					if (now - host->last_rise < host->gap_min) host->gap_min = now - host->last_rise;
+					if (now - host->last_rise < XTHOST_GAP_NS) host->timing++;
+				}
+			} else {
+				xthost_phase(host, host->edges == 1 ? XTHOST_START_HIGH : XTHOST_BIT_HIGH, now - host->last_edge);
+			}
+
+			host->edges++;
+			if (host->edges > 2) host->shift = (host->shift >> 1) | (dat ? 0x80 : 0);
+			if (host->edges == 10) {
+				xthost_received(host, host->shift, now);
+				if (prof->busy_max_us) { // The XT holds data low until it has read the byte
+					host->dat_low = 1;
+					if ((uint32_t)rand() % 1000 < prof->stall_per_1000) host->busy_end = now + xthost_random(prof->stall_min_ms, prof->stall_max_ms) * MS;
+					else host->busy_end = now + xthost_random(prof->busy_min_us, prof->busy_max_us) * US;
+				}
+			}
+			host->last_edge = now;
+		} else {
+			if (host->edges)
+				xthost_phase(host, host->edges == 1 ? XTHOST_START_LOW : host->edges == 2 ? XTHOST_START2_LOW : XTHOST_BIT_LOW, now - host->last_edge);
+			if (host->edges == 10) { // Frame over, the gap starts
+				host->edges = 0;
+				host->gap_valid = 1;
+			}
+			host->last_edge = host->last_rise = now;
+		}
+	}
+
+	if (dat != host->dat) {
+		host->dat = dat;
+		if (!clk && !host->clk_low && !host->dat_low && host->edges >= 2) host->data_moved++;
+	}
+
+	if (host->edges && clk && now - host->last_edge > XTHOST_FRAME_NS) { // Stopped in the middle
+		host->short_frames++;
+		host->edges = 0;
+	}
+
+	xthost_act(host, now);
+}
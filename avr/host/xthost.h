@@ -0,0 +1,83 @@
+#ifndef _HOST_XTHOST_HEADER_
+#define _HOST_XTHOST_HEADER_
+
+#include <stdint.h>
+
+// A PC/XT host on simulated time, for the tests of the XT keyboard senders: the firmware's
+// xt_keyb.c (xtpacing) and the pcxtkbd sketch's xt_tx.cpp (xttx).
+//
+// The test calls xthost_step() every time the lines may have changed, with their levels on the
+// wire. The host reads the frames off them the way the XT does, a bit on each falling clock edge
+// (two start edges, then 8 data bits, LSB first), and times every phase of every frame. It pulls
+// the lines low itself as its profile says: clk_low and dat_low, which the test puts on the wire.
+//
+// The test hands the bytes the keyboard side took to xthost_expect(): they must come in order,
+// once each. After a reset the first byte must be 0xAA, and the bytes taken before its frame
+// started are lost: the keyboard flushes its queue when it queues 0xAA, and sends it right away.
+
+#define XTHOST_START_LOW  0 // Phases of a frame: 120us
+#define XTHOST_START_HIGH 1 // 66us
+#define XTHOST_START2_LOW 2 // 30us
+#define XTHOST_BIT_HIGH   3 // 66us
+#define XTHOST_BIT_LOW    4 // 30us
+#define XTHOST_PHASES     5
+
+#define XTHOST_PHASE_SLACK_NS 5000UL    // Every phase within 5us of its length
+#define XTHOST_GAP_NS         995000UL  // Clock high between two frames, at least (1ms, less the slack of a timer tick)
+#define XTHOST_FRAME_NS       500000UL  // Clock high this long in the middle of a frame: it stopped short
+#define XTHOST_RESET_MS       20        // The XT BIOS holds the clock low this long for a reset
+#define XTHOST_SELFTEST_MIN_MS 10       // 0xAA expected this long after the reset at least...
+#define XTHOST_SELFTEST_MAX_MS 500      // ... at most
+
+#define XTHOST_EXPECT_SIZE 256 // Power of 2
+
+typedef struct {
+	const char *name;
+	uint32_t busy_min_us, busy_max_us;   // Data held low after each byte, as the XT does until it has read it (0: never)
+	uint16_t stall_per_1000;             // Bytes after which data stays low much longer...
+	uint32_t stall_min_ms, stall_max_ms; // ... for this long
+	uint32_t inhibit_every_ms;           // Clock held low at random times, on average this often (0: never)...
+	uint32_t inhibit_min_us, inhibit_max_us; // ... for this long
+	uint32_t reset_every_ms;             // Clock held low XTHOST_RESET_MS, on average this often (0: never)
+} xthost_profile_t;
+
+typedef struct {
+	const xthost_profile_t *profile;
+	uint8_t clk_low, dat_low; // The host pulls the line low: the test puts it on the wire
+
+	// Results
+	unsigned long bytes;        // Frames read whole
+	unsigned long cut;          // Frames the host cut short itself, by an inhibit or a reset
+	unsigned long short_frames; // Frames that stopped short by themselves
+	unsigned long wrong;        // Bytes that are not the ones expected: out of order, twice, or missing
+	unsigned long flushed;      // Bytes taken before the 0xAA of a reset and never sent, as they should be
+	unsigned long resets;       // Resets, each answered by 0xAA...
+	unsigned long selftest_bad; // ... or not: another byte first, or too early or too late
+	unsigned long timing;       // Phases or gaps out of bounds, frames started with data low
+	unsigned long data_moved;   // Data changed while the keyboard held the clock low in a frame
+	uint64_t phase_min[XTHOST_PHASES], phase_max[XTHOST_PHASES]; // ns
+	uint64_t gap_min, selftest_min, selftest_max;                // ns
+
+	// Lines and decoder
+	uint8_t clk, dat, edges, shift, gap_valid; // gap_valid: last_rise ended a frame, no inhibit since
+	uint64_t last_edge, last_rise;
+
+	// What the host does next, in ns
+	uint64_t busy_end, inhibit_start, inhibit_end, reset_start, reset_end;
+	uint8_t resetting, reset_pending; // The clock held low for a reset, released and 0xAA not in yet
+
+	uint64_t frame_start; // Of the frame being read
+
+	uint8_t expect[XTHOST_EXPECT_SIZE];
+	uint64_t expect_at[XTHOST_EXPECT_SIZE]; // When the keyboard side took it
+	uint16_t exp_in, exp_out;
+} xthost_t;
+
+void xthost_init(xthost_t *host, const xthost_profile_t *profile, uint64_t now);
+void xthost_step(xthost_t *host, uint64_t now, uint8_t clk, uint8_t dat); // now in ns, the line levels on the wire
+void xthost_quiet(xthost_t *host);   // No more inhibits or resets: the test drains the keyboard side
+void xthost_expect(xthost_t *host, uint8_t value, uint64_t now);
+void xthost_finish(xthost_t *host);  // Drained: what is still expected is missing
+uint8_t xthost_failed(const xthost_t *host); // Anything wrong but the allowed flushes
+
+#endif /* _HOST_XTHOST_HEADER_ */
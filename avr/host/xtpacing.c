@@ -0,0 +1,231 @@
+// XT frame timing of the firmware's PC/XT backend, on the host.
+//
+//   xtpacing [-n bytes] [-s seed]
+//
+// Runs the real XT keyboard backend (xt_keyb.c) against an XT host stand-in (xthost.c), with
+// simulated time: Timer1 counts its ticks (1us at 8MHz, 0.5us at 16MHz) and fires the compare B
+// handler on OCR1B, which clocks the frames out. xtkbd_processQueue() is called as from the
+// main loop, a round every LOOP_US, and the PS/2 side queues a key every KEY_US while the queue
+// has room: plain keys, and every eighth one an E0 key, sent as two frames.
+// The host times every phase of every frame against the 120/66/30us start and the 66/30us bits,
+// and the gap between frames against 1ms. Its profiles:
+//   ready    always ready
+//   busy     holds data low for 0.2-3ms after each byte, as the XT does until it has read it
+//   inhibit  on average every 20ms holds the clock low for 0.2-8ms, cutting frames short
+//   reset    on average every 150ms holds the clock low for 20ms, and times the 0xAA answer
+//   stall    now and then holds data low for 300-400ms
+//   mixed    all of the above
+// For each profile it prints the bytes read, the frames cut short by the host, the resets, the
+// bytes flushed by a reset, the bytes wrong (out of order, twice or missing), the phases out of
+// bounds, and the longest xtkbd_processQueue() held the main loop; then every phase's shortest
+// and longest, the shortest gap and the 0xAA delay.
+// Exits with 1 if a profile has a wrong byte, a phase or gap out of bounds, a frame stopped
+// short, a reset not answered by 0xAA first, or a main loop round longer than LOOP_MAX_US.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "xt_keyb.h"
+#include "common/timing.h"
+#include "xthost.h"
+
+#define XT_CLK_PNUM 3 // PD3
+#define XT_DAT_PNUM 0 // PB0
+
+#define TICK_NS     (8000000000ULL / F_CPU) // Timer1 at F_CPU / 8
+#define LOOP_US     10   // The rest of a main loop round
+#define KEY_US      1000 // A key from the PS/2 side this often, if there is room: more than the XT takes
+#define LOOP_MAX_US 100  // xtkbd_processQueue() may hold the main loop this long at most
+#define DRAIN_MS    2000
+
+void sim_timer1_compb_vect(void);
+
+static const xthost_profile_t profiles[] = {
+	{ "ready",   0,   0,    0, 0,   0,   0,  0,   0,    0 },
+	{ "busy",    200, 3000, 0, 0,   0,   0,  0,   0,    0 },
+	{ "inhibit", 0,   0,    0, 0,   0,   20, 200, 8000, 0 },
+	{ "reset",   0,   0,    0, 0,   0,   0,  0,   0,    150 },
+	{ "stall",   200, 1000, 10, 300, 400, 0,  0,   0,    0 },
+	{ "mixed",   200, 3000, 5, 300, 400, 20, 200, 8000, 150 },
+};
+
+// Wire scancodes of XTKBD_E0_RCTRL ... XTKBD_E0_DELETE, as the XT gets them after the E0
+static const uint8_t e0_codes[XTKBD_E0_COUNT] = {
+	0x1D, 0x38, 0x1C, 0x35, 0x37, 0x47, 0x48, 0x49, 0x4B, 0x4D, 0x4F, 0x50, 0x51, 0x52, 0x53
+};
+
+static uint64_t ticks;
+static uint8_t ocf; // Compare B flag
+static xthost_t host;
+
+uint16_t sim_tcnt1(void) {
+	return (TCCR1B & ((1 << CS12) | (1 << CS11) | (1 << CS10))) ? (uint16_t)ticks : 0; // Prescaler 8
+}
+
+// Open drain: a line is low if either side pulls it
+static uint8_t xtpacing_line(volatile uint8_t *ddr, volatile uint8_t *port, uint8_t pnum, uint8_t host_low) {
+	return !((*ddr & (1 << pnum)) && !(*port & (1 << pnum))) && !host_low;
+}
+
+static void xtpacing_lines(void) {
+	for (uint8_t round = 0; round < 2; round++) { // Again if the host pulled a line on this step
+		uint8_t clk = xtpacing_line(&DDRD, &PORTD, XT_CLK_PNUM, host.clk_low);
+		uint8_t dat = xtpacing_line(&DDRB, &PORTB, XT_DAT_PNUM, host.dat_low);
+
+		PIND = clk ? (PIND | (1 << XT_CLK_PNUM)) : (PIND & ~(1 << XT_CLK_PNUM));
+		PINB = dat ? (PINB | (1 << XT_DAT_PNUM)) : (PINB & ~(1 << XT_DAT_PNUM));
+		xthost_step(&host, ticks * TICK_NS, clk, dat);
+	}
+}
+
+// Timer1 compare B: the flag is set on a match, writing a one clears it, the handler runs
+// while it is set and enabled
+static void xtpacing_tick(void) {
+	if (TIFR1 & (1 << OCF1B)) {
+		ocf = 0;
+		TIFR1 = 0;
+	}
+
+	ticks++;
+	if (sim_tcnt1() == OCR1B) ocf = 1;
+
+	if (ocf && (TIMSK1 & (1 << OCIE1B))) {
+		ocf = 0;
+		sim_timer1_compb_vect();
+		xtpacing_lines();
+	}
+}
+
+static void xtpacing_advance(uint32_t us) {
+	uint64_t end = ticks + TIMING_T1_TICKS((uint64_t)us);
+
+	while (ticks < end) xtpacing_tick();
+}
+
+void sim_delayUs(uint32_t us) { // A wait in the backend holds the main loop: loop max shows it
+	xtpacing_advance(us);
+	xtpacing_lines();
+}
+
+static void xtpacing_print(const char *name, const xthost_t *h) {
+	printf("%-8s", name);
+	for (uint8_t idx = 0; idx < XTHOST_PHASES; idx++)
+		printf(" %5.1f-%5.1f", h->phase_min[idx] / 1000.0, h->phase_max[idx] / 1000.0);
+	printf(" %8.1f", h->gap_min == UINT64_MAX ? 0.0 : h->gap_min / 1000.0);
+	if (h->resets) printf(" %7.1f-%5.1fms", h->selftest_min / 1e6, h->selftest_max / 1e6);
+	printf("\n");
+}
+
+// The key for the n-th press or release, and what the XT gets for it
+static uint8_t xtpacing_key(unsigned long n) {
+	uint8_t release = (n & 1) ? 0x80 : 0;
+
+	n >>= 1;
+	if (n % 8 == 7) return (XTKBD_E0_BASE + (n / 8) % XTKBD_E0_COUNT) | release;
+	return (1 + n % 0x58) | release;
+}
+
+static void xtpacing_expect(uint8_t key) {
+	uint8_t code = key & 0x7F;
+
+	if (code < XTKBD_E0_BASE) {
+		xthost_expect(&host, key, ticks * TICK_NS);
+		return;
+	}
+	xthost_expect(&host, 0xE0, ticks * TICK_NS);
+	xthost_expect(&host, e0_codes[code - XTKBD_E0_BASE] | (key & 0x80), ticks * TICK_NS);
+}
+
+static uint64_t xtpacing_round(void) {
+	uint64_t call = ticks;
+
+	xtkbd_processQueue();
+	xtpacing_lines();
+	return ticks - call;
+}
+
+static int xtpacing_run(const xthost_profile_t *prof, unsigned long count, unsigned int seed, xthost_t *result) {
+	unsigned long keys = 0;
+	uint64_t start, elapsed, quiet, key_due = 0, spent, loop_max = 0;
+	uint8_t failed;
+
+	srand(seed);
+
+	ticks = 0;
+	ocf = 0;
+	DDRB = DDRD = PORTB = PORTD = 0;
+	PINB = PIND = 0xFF;
+	TCCR1A = TCCR1B = TIMSK1 = TIFR1 = 0;
+	OCR1B = 0;
+
+	xthost_init(&host, prof, 0);
+	xtkbd_setup(&PORTD, &DDRD, &PIND, XT_CLK_PNUM, &PORTB, &DDRB, &PINB, XT_DAT_PNUM);
+	xtpacing_lines();
+	xtkbd_init(); // Power up 0xAA: not counted
+	xthost_expect(&host, 0xAA, 0);
+	start = ticks;
+
+	while (host.bytes < count) {
+		xtpacing_advance(LOOP_US);
+
+		spent = xtpacing_round();
+		if (spent > loop_max) loop_max = spent;
+
+		if (ticks >= key_due && xtkbd_queueFree()) { // Else it waits in the keyboard's buffer
+			uint8_t key = xtpacing_key(keys++);
+
+			xtkbd_queueCommand(key);
+			xtpacing_expect(key);
+			key_due = ticks + TIMING_T1_TICKS((uint64_t)KEY_US);
+		}
+		xtpacing_lines();
+	}
+	elapsed = ticks - start;
+
+	// Drained once the host stopped and nothing moved for a while
+	xthost_quiet(&host);
+	quiet = ticks;
+	while (ticks - start < elapsed + TIMING_T1_TICKS(DRAIN_MS * 1000ULL) && ticks - quiet < TIMING_T1_TICKS(5000ULL)) {
+		xtpacing_advance(LOOP_US);
+		spent = xtpacing_round();
+		if (spent > loop_max) loop_max = spent;
+		if (!xtkbd_queueEmpty() || (TIMSK1 & (1 << OCIE1B)) || host.clk_low || host.dat_low || host.reset_pending) quiet = ticks;
+	}
+	xthost_finish(&host);
+
+	failed = xthost_failed(&host) || loop_max > TIMING_T1_TICKS((uint64_t)LOOP_MAX_US);
+	printf("%-8s %7lu %8.0f %6lu %6lu %7lu %6lu %6lu %6lu %8.1fus%s\n", prof->name, host.bytes, host.bytes * 1e9 / (elapsed * TICK_NS),
+		host.cut, host.resets, host.flushed, host.wrong, host.timing, host.short_frames + host.selftest_bad + host.data_moved,
+		loop_max * TICK_NS / 1000.0, failed ? "  FAIL" : "");
+
+	*result = host;
+	return failed;
+}
+
+int main(int argc, char **argv) {
+	const uint8_t rows = sizeof(profiles) / sizeof(profiles[0]);
+	xthost_t results[sizeof(profiles) / sizeof(profiles[0])];
+	unsigned long count = 2000;
+	unsigned int seed = 1;
+	int failed = 0;
+
+	for (int opt = 1; opt + 1 < argc; opt += 2) {
+		if (!strcmp(argv[opt], "-n")) count = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-s")) seed = strtoul(argv[opt + 1], NULL, 0);
+	}
+
+	printf("%lu bytes per profile, seed %u, %luMHz\n\n", count, seed, F_CPU / 1000000UL);
+	printf("%-8s %7s %8s %6s %6s %7s %6s %6s %6s %10s\n", "host", "bytes", "bytes/s", "cut", "resets", "flushed", "wrong", "timing", "bad", "loop max");
+	for (uint8_t idx = 0; idx < rows; idx++)
+		if (xtpacing_run(&profiles[idx], count, seed, &results[idx])) failed = 1;
+
+	printf("\nshortest-longest, us\n");
+	printf("%-8s %11s %11s %11s %11s %11s %8s %13s\n", "host", "start low", "start high", "start2 low", "bit high", "bit low", "gap", "0xAA after");
+	for (uint8_t idx = 0; idx < rows; idx++) xtpacing_print(profiles[idx].name, &results[idx]);
+
+	return failed;
+}
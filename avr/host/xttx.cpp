@@ -0,0 +1,187 @@
+// XT frame timing of the pcxtkbd sketch's transmitter, on the host.
+//
+//   xttx [-n bytes] [-s seed]
+//
+// Runs pcxtkbd/XT_KEYBOARD/xt_tx.cpp as it is, at the Uno's 16MHz, against an XT host stand-in
+// (xthost.c), with simulated time: Timer2 counts 0.5us ticks and fires its compare handler,
+// loop() polls the transmitter every LOOP_US and writes a byte every KEY_US, as soon as
+// xt_tx_ready() lets it.
+// The host times every phase of every frame against the 120/66/30us start and the 66/30us bits,
+// and the gap between frames against 1ms. Its profiles:
+//   ready    always ready
+//   busy     holds data low for 0.2-3ms after each byte, as the XT does until it has read it
+//   inhibit  on average every 20ms holds the clock low for 0.2-8ms, cutting frames short
+//   reset    on average every 150ms holds the clock low for 20ms, and times the 0xAA answer
+//   stall    now and then holds data low for 300-400ms: past XT_HOST_TIMEOUT_MS, bytes are dropped
+//   mixed    all of the above
+// For each profile it prints the bytes read, the frames cut short by the host, the resets,
+// the bytes flushed by a reset and dropped for want of room, the bytes wrong (out of order,
+// twice or missing) and the phases out of bounds; then every phase's shortest and longest,
+// the shortest gap and the 0xAA delay.
+// Exits with 1 if a profile has a wrong byte, a phase or gap out of bounds, a frame stopped
+// short, a reset not answered by 0xAA first, or bytes dropped without a stall.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "xt_tx.h"
+
+extern "C" {
+#include "xthost.h"
+}
+
+#define XT_CLK_BIT 3 // PD3, pin 3
+#define XT_DAT_BIT 0 // PB0, pin 8
+
+#define TICK_NS  500 // Timer2 at F_CPU / 8
+#define LOOP_US  20  // A loop() round
+#define KEY_US   1000 // A byte from the PS/2 side this often: more than the XT takes
+#define DRAIN_MS 2000
+
+void sim_timer2_compa_vect(void);
+
+static const xthost_profile_t profiles[] = {
+	{ "ready",   0,   0,    0, 0,   0,   0,  0,   0,    0 },
+	{ "busy",    200, 3000, 0, 0,   0,   0,  0,   0,    0 },
+	{ "inhibit", 0,   0,    0, 0,   0,   20, 200, 8000, 0 },
+	{ "reset",   0,   0,    0, 0,   0,   0,  0,   0,    150 },
+	{ "stall",   200, 1000, 10, 300, 400, 0,  0,   0,    0 },
+	{ "mixed",   200, 3000, 5, 300, 400, 20, 200, 8000, 150 },
+};
+
+static uint64_t ticks;
+static xthost_t host;
+
+unsigned long millis(void) {
+	return ticks * TICK_NS / 1000000;
+}
+
+// Open drain: a line is low if either side pulls it
+static uint8_t xttx_line(volatile uint8_t &ddr, volatile uint8_t &port, uint8_t bit, uint8_t host_low) {
+	return !((ddr & _BV(bit)) && !(port & _BV(bit))) && !host_low;
+}
+
+static void xttx_lines(void) {
+	for (uint8_t round = 0; round < 2; round++) { // Again if the host pulled a line on this step
+		uint8_t clk = xttx_line(DDRD, PORTD, XT_CLK_BIT, host.clk_low);
+		uint8_t dat = xttx_line(DDRB, PORTB, XT_DAT_BIT, host.dat_low);
+
+		PIND = clk ? (PIND | _BV(XT_CLK_BIT)) : (PIND & ~_BV(XT_CLK_BIT));
+		PINB = dat ? (PINB | _BV(XT_DAT_BIT)) : (PINB & ~_BV(XT_DAT_BIT));
+		xthost_step(&host, ticks * TICK_NS, clk, dat);
+	}
+}
+
+// Timer2 in CTC mode: a compare match every OCR2A + 1 ticks
+static void xttx_tick(void) {
+	ticks++;
+	if (!(TCCR2B & _BV(CS21))) return;
+
+	if (TCNT2 != OCR2A) {
+		TCNT2++;
+		return;
+	}
+
+	TCNT2 = 0;
+	if (TIMSK2 & _BV(OCIE2A)) {
+		sim_timer2_compa_vect();
+		xttx_lines();
+	}
+}
+
+static void xttx_advance(uint64_t until) {
+	while (ticks < until) xttx_tick();
+}
+
+static void xttx_print(const char *name, const xthost_t *h) {
+	printf("%-8s", name);
+	for (uint8_t idx = 0; idx < XTHOST_PHASES; idx++)
+		printf(" %5.1f-%5.1f", h->phase_min[idx] / 1000.0, h->phase_max[idx] / 1000.0);
+	printf(" %8.1f", h->gap_min == UINT64_MAX ? 0.0 : h->gap_min / 1000.0);
+	if (h->resets) printf(" %7.1f-%5.1fms", h->selftest_min / 1e6, h->selftest_max / 1e6);
+	printf("\n");
+}
+
+static int xttx_run(const xthost_profile_t *prof, unsigned long count, unsigned int seed, xthost_t *result) {
+	unsigned long written = 0, dropped = 0;
+	uint64_t start, elapsed, quiet, key_due = 0;
+	uint8_t value = 1, failed;
+
+	srand(seed);
+
+	ticks = 0;
+	DDRB = DDRD = PORTB = PORTD = 0;
+	PINB = PIND = 0xFF;
+	TCCR2A = TCCR2B = TCNT2 = OCR2A = TIMSK2 = 0;
+
+	xthost_init(&host, prof, 0);
+	xt_tx_begin();
+	xttx_lines();
+	start = ticks;
+
+	while (written < count) {
+		xttx_advance(ticks + LOOP_US * 1000 / TICK_NS);
+
+		xt_tx_poll();
+		if (ticks >= key_due && xt_tx_ready(2)) { // Else it waits in the PS/2 library's buffer
+			if (xt_tx_write(value)) {
+				xthost_expect(&host, value, ticks * TICK_NS);
+				written++;
+			} else {
+				dropped++;
+			}
+			value = value % 0x7F + 1; // 01-7F: never 0xAA
+			key_due += KEY_US * 1000 / TICK_NS;
+		}
+		xt_tx_events();
+		xttx_lines();
+	}
+	elapsed = ticks - start;
+
+	// Drained once the host stopped and nothing moved for a while
+	xthost_quiet(&host);
+	quiet = ticks;
+	while (ticks - start < elapsed + DRAIN_MS * 1000000ULL / TICK_NS && ticks - quiet < 5000000ULL / TICK_NS) {
+		xttx_advance(ticks + LOOP_US * 1000 / TICK_NS);
+		xt_tx_poll();
+		xttx_lines();
+		if (xt_tx_busy() || host.clk_low || host.dat_low || host.reset_pending) quiet = ticks;
+	}
+	xthost_finish(&host);
+
+	failed = xthost_failed(&host) || (dropped && !prof->stall_per_1000);
+	printf("%-8s %7lu %8.0f %6lu %6lu %7lu %7lu %6lu %6lu %6lu%s\n", prof->name, host.bytes, host.bytes * 1e9 / (elapsed * TICK_NS),
+		host.cut, host.resets, host.flushed, dropped, host.wrong, host.timing, host.short_frames + host.selftest_bad + host.data_moved,
+		failed ? "  FAIL" : "");
+
+	*result = host;
+	return failed;
+}
+
+int main(int argc, char **argv) {
+	const uint8_t rows = sizeof(profiles) / sizeof(profiles[0]);
+	xthost_t results[rows];
+	unsigned long count = 2000;
+	unsigned int seed = 1;
+	int failed = 0;
+
+	for (int opt = 1; opt + 1 < argc; opt += 2) {
+		if (!strcmp(argv[opt], "-n")) count = strtoul(argv[opt + 1], NULL, 0);
+		else if (!strcmp(argv[opt], "-s")) seed = strtoul(argv[opt + 1], NULL, 0);
+	}
+
+	printf("%lu bytes per profile, seed %u\n\n", count, seed);
+	printf("%-8s %7s %8s %6s %6s %7s %7s %6s %6s %6s\n", "host", "bytes", "bytes/s", "cut", "resets", "flushed", "dropped", "wrong", "timing", "bad");
+	for (uint8_t idx = 0; idx < rows; idx++)
+		if (xttx_run(&profiles[idx], count, seed, &results[idx])) failed = 1;
+
+	printf("\nshortest-longest, us\n");
+	printf("%-8s %11s %11s %11s %11s %11s %8s %13s\n", "host", "start low", "start high", "start2 low", "bit high", "bit low", "gap", "0xAA after");
+	for (uint8_t idx = 0; idx < rows; idx++) xttx_print(profiles[idx].name, &results[idx]);
+
+	return failed;
+}
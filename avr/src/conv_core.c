@@ -0,0 +1,339 @@
+#include "conv_core.h"
+
+#include <string.h>
+
+#include "convtable.h"
+#include "ps2_proto.h"
+
+// Inspiration...
+// https://github.com/ali1234/avr-amiga-controller
+
+// The PS/2 to host tables live in convtable_amiga.c / convtable_xt.c
+
+#define CONV_SEQ_MAX   9 // As the decoder: no valid sequence is longer than Pause (8 codes)
+#define CONV_PAUSE_LEN 7 // Prefixes before the last code of Pause
+
+static inline uint8_t conv_normal(uint8_t ps2_code) {
+	if (ps2_code >= CONV_NORMAL_SIZE) return CONV_UNMAPPED;
+
+	return pgm_read_byte(&ps2_normal_convtable[ps2_code]);
+}
+
+static uint8_t conv_extended(uint8_t ps2_code) {
+	const uint8_t *entry = ps2_extended_convtable;
+	uint8_t cur;
+
+	while ((cur = pgm_read_byte(entry))) {
+		if (cur == ps2_code) return pgm_read_byte(entry + 1);
+		entry += 2;
+	}
+
+	return CONV_UNMAPPED;
+}
+
+static inline uint8_t conv_table(uint8_t ps2_code, uint8_t extended) {
+	return extended ? conv_extended(ps2_code) : conv_normal(ps2_code);
+}
+
+static inline uint8_t conv_action(convcore_action_t *out, uint8_t type, uint8_t value) {
+	out->type = type;
+	out->value = value;
+	return 1;
+}
+
+// Records a make (bit 7 clear) or break (bit 7 set) key code coming from a keyboard.
+// Returns 1 when the merged state changed and the code has to be forwarded to the host,
+// 0 for a typematic repeat, a release of a key not held, or a key also held on another keyboard
+static uint8_t conv_update(convcore_t *ctx, uint8_t device, uint8_t key_code) {
+	uint8_t idx = (key_code & 0x7F) >> 3;
+	uint8_t mask = 1 << (key_code & 0x07);
+	uint8_t others = 0;
+
+	for (uint8_t dev = 0; dev < CONVCORE_DEVICES; dev++) {
+		if (dev != device) others |= ctx->held[dev][idx];
+	}
+
+	if (key_code & 0x80) { // Break
+		if (!(ctx->held[device][idx] & mask)) return 0;
+		ctx->held[device][idx] &= ~mask;
+	} else { // Make
+		if (ctx->held[device][idx] & mask) return 0; // Typematic repeat
+		ctx->held[device][idx] |= mask;
+	}
+
+	return !(others & mask);
+}
+
+void convcore_init(convcore_t *ctx) {
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->options = CONVCORE_OPTS_DEFAULT;
+}
+
+void convcore_reset(convcore_t *ctx) {
+	memset(ctx->held, 0, sizeof(ctx->held)); // After the reset the host sees no key held
+	ctx->leds = 0;
+}
+
+uint8_t convcore_checksum(const convcore_t *ctx) {
+	const uint8_t *state = &ctx->held[0][0];
+	uint8_t sum = 0xA5 ^ ctx->leds; // Not 0 over all zeros, as RAM may come up
+
+	for (uint8_t idx = 0; idx < sizeof(ctx->held); idx++) sum = ((sum << 1) | (sum >> 7)) ^ state[idx];
+
+	return sum;
+}
+
+void convcore_restore(convcore_t *ctx) {
+	uint8_t held[CONVCORE_DEVICES][CONVCORE_HELD_BYTES];
+	uint8_t leds = ctx->leds;
+
+	memcpy(held, ctx->held, sizeof(held));
+	convcore_init(ctx);
+	memcpy(ctx->held, held, sizeof(held));
+	ctx->leds = leds;
+}
+
+uint8_t convcore_isHeld(const convcore_t *ctx, uint8_t key_code) {
+	uint8_t idx = (key_code & 0x7F) >> 3;
+	uint8_t mask = 1 << (key_code & 0x07);
+
+	for (uint8_t dev = 0; dev < CONVCORE_DEVICES; dev++) {
+		if (ctx->held[dev][idx] & mask) return 1;
+	}
+
+	return 0;
+}
+
+uint8_t convcore_anyHeld(const convcore_t *ctx) {
+	const uint8_t *state = &ctx->held[0][0];
+
+	for (uint8_t idx = 0; idx < sizeof(ctx->held); idx++) {
+		if (state[idx]) return 1;
+	}
+
+	return 0;
+}
+
+uint8_t convcore_leds(const convcore_t *ctx) {
+	return ctx->leds;
+}
+
+uint8_t convcore_options(const convcore_t *ctx) {
+	return ctx->options;
+}
+
+uint8_t convcore_setOptions(convcore_t *ctx, uint8_t options, convcore_action_t *out) {
+	uint8_t count = 0;
+
+#if !defined (AKAB_OUTPUT_XT)
+	if (!(options & CONVCORE_OPT_CAPS_LATCH) && (ctx->leds & CONVCORE_LED_CAPSLOCK)) {
+		ctx->leds &= ~CONVCORE_LED_CAPSLOCK;
+		count += conv_action(&out[count], CONVCORE_CODE, CONV_CAPSLOCK_CODE | 0x80);
+		count += conv_action(&out[count], CONVCORE_LEDS, ctx->leds);
+	}
+#endif
+	ctx->options = options;
+
+	return count;
+}
+
+uint8_t convcore_map(const convcore_t *ctx, uint8_t ps2_code, uint8_t extended) {
+#if CONVCORE_REMAPS
+	for (uint8_t idx = 0; idx < ctx->remap_count; idx++) {
+		if (ctx->remap_code[idx] == ps2_code && ctx->remap_extended[idx] == extended) return ctx->remap_key[idx];
+	}
+#endif
+
+	return conv_table(ps2_code, extended);
+}
+
+#if CONVCORE_REMAPS
+uint8_t convcore_remap(convcore_t *ctx, uint8_t ps2_code, uint8_t extended, uint8_t key_code) {
+	uint8_t idx;
+
+	extended = !!extended;
+
+	for (idx = 0; idx < ctx->remap_count; idx++) {
+		if (ctx->remap_code[idx] == ps2_code && ctx->remap_extended[idx] == extended) break;
+	}
+
+	if (key_code == conv_table(ps2_code, extended)) { // Back to the table: the last entry takes the place of this one
+		if (idx < ctx->remap_count) {
+			ctx->remap_count--;
+			ctx->remap_code[idx] = ctx->remap_code[ctx->remap_count];
+			ctx->remap_extended[idx] = ctx->remap_extended[ctx->remap_count];
+			ctx->remap_key[idx] = ctx->remap_key[ctx->remap_count];
+		}
+		return 1;
+	}
+
+	if (idx == CONVCORE_REMAPS) return 0;
+
+	ctx->remap_code[idx] = ps2_code;
+	ctx->remap_extended[idx] = extended;
+	ctx->remap_key[idx] = key_code;
+	if (idx == ctx->remap_count) ctx->remap_count++;
+
+	return 1;
+}
+
+void convcore_clearRemaps(convcore_t *ctx) {
+	ctx->remap_count = 0;
+}
+#endif
+
+// The host sees down every key held: release them.
+// A key the user keeps pressing comes back with the keyboard's typematic repeat
+uint8_t convcore_release(convcore_t *ctx, uint8_t locks, convcore_action_t *out, uint8_t size) {
+	uint8_t count = 0;
+
+#if !defined (AKAB_OUTPUT_XT)
+	if (locks && (ctx->leds & CONVCORE_LED_CAPSLOCK)) count += conv_action(&out[count], CONVCORE_CODE, CONV_CAPSLOCK_CODE | 0x80);
+#endif
+	if (locks) ctx->leds = 0;
+	if (count == size) return count;
+
+	for (uint8_t key_code = 0; key_code < 0x80; key_code++) {
+#if !defined (AKAB_OUTPUT_XT)
+		if (key_code == CONV_CAPSLOCK_CODE && (ctx->options & CONVCORE_OPT_CAPS_LATCH)) continue; // The Amiga caps lock is latched
+#endif
+		if (!convcore_isHeld(ctx, key_code)) continue;
+
+		for (uint8_t dev = 0; dev < CONVCORE_DEVICES; dev++) ctx->held[dev][key_code >> 3] &= ~(1 << (key_code & 0x07));
+		if (CONV_IS_MACRO(key_code)) continue; // Held to filter its repeats, never sent
+		count += conv_action(&out[count], CONVCORE_CODE, key_code | 0x80);
+		if (count == size) return count; // Picks up from the next key held on the next call
+	}
+
+	memset(ctx->held, 0, sizeof(ctx->held));
+
+	return count;
+}
+
+uint8_t convcore_kind(const uint8_t *code, uint8_t count) {
+	if (code[count] == PS2_SCANCODE_OVERRUN || code[count] == PS2_SCANCODE_OVERRUN_SET1) return CONVCORE_SEQ_OVERRUN;
+	if ((count == 1 && code[0] == PS2_SCANCODE_RELEASE) || count == 2) return CONVCORE_SEQ_RELEASE; // F0 xx, E0 F0 xx
+
+	return CONVCORE_SEQ_PRESS;
+}
+
+uint8_t convcore_sequence(convcore_t *ctx, uint8_t device, const uint8_t *code, uint8_t count, convcore_action_t *out) {
+#if defined (AKAB_OUTPUT_XT)
+	uint8_t repeat = 0;
+#endif
+
+	uint8_t key_code = 0;
+	uint8_t actions = 0;
+
+	// Not a key, whatever prefixes came first: the host may be missing releases now
+	if (convcore_kind(code, count) == CONVCORE_SEQ_OVERRUN) return conv_action(out, CONVCORE_OVERRUN, 0);
+
+	if (count == 0) { // Normal key pressed
+		key_code = convcore_map(ctx, code[0], 0);
+	} else if (count == 1 && code[0] == PS2_SCANCODE_RELEASE) { // Normal key depressed
+		key_code = convcore_map(ctx, code[1], 0) | 0x80;
+	} else if (count == 1 && code[0] == PS2_SCANCODE_EXTENDED) { // Extended key pressed
+		key_code = convcore_map(ctx, code[1], 1);
+	} else if (count == 2) { // Extended key depressed
+		key_code = convcore_map(ctx, code[2], 1) | 0x80;
+	} else {
+		return 0;
+	}
+
+	if (key_code == CONV_UNMAPPED) return 0; // Not mapped
+
+	if (key_code == CONV_READOUT_CODE) { // Make and break look the same: only act on the make
+		return count == 0 ? conv_action(out, CONVCORE_READOUT, 0) : 0;
+	}
+
+	if (key_code != CONV_RESET_CODE) {
+		// Typematic repeats, and keys already held on the other keyboard, are not sent again
+		if (!conv_update(ctx, device, key_code)) {
+#if defined (AKAB_OUTPUT_XT)
+			if (key_code & 0x80) return 0;
+			repeat = 1; // ... except to the PC, which has no typematic of its own: repeats go out as make codes
+#else
+			return 0;
+#endif
+		}
+
+#ifdef CONV_RESET_CHORD
+		if ((ctx->options & CONVCORE_OPT_RESET_CHORD) && !(key_code & 0x80) && convcore_isHeld(ctx, CONV_LCTRL_CODE) &&
+			convcore_isHeld(ctx, CONV_LGUI_CODE) && convcore_isHeld(ctx, CONV_RGUI_CODE)) { // Reset sequence completed
+			key_code = CONV_RESET_CODE; // Force a reset!
+		}
+#endif
+	}
+
+	if (key_code == CONV_RESET_CODE) {
+		convcore_reset(ctx);
+		actions += conv_action(&out[actions], CONVCORE_HOST_RESET, 0); // Force a reset on the host...
+		actions += conv_action(&out[actions], CONVCORE_KEYB_RESET, 0); // ... and on the keyboard
+		return actions;
+	}
+
+	if (!(key_code & 0x80) && !CONV_IS_MACRO(key_code)) actions += conv_action(&out[actions], CONVCORE_MACRO_ABORT, 0); // A live keypress interrupts a running macro
+
+	if (CONV_IS_MACRO(key_code)) { // Stored sequence, played back by the caller
+		if (!(key_code & 0x80)) actions += conv_action(&out[actions], CONVCORE_MACRO, key_code - CONV_MACRO_BASE);
+		return actions;
+	}
+
+#if defined (AKAB_OUTPUT_XT)
+	// The PC tracks the lock state itself, we just mirror it on the keyboard
+	if (!repeat && (key_code == CONV_CAPSLOCK_CODE || key_code == CONV_NUMLOCK_CODE || key_code == CONV_SCROLLLOCK_CODE)) {
+		ctx->leds ^= (key_code == CONV_CAPSLOCK_CODE) ? CONVCORE_LED_CAPSLOCK :
+					(key_code == CONV_NUMLOCK_CODE) ? CONVCORE_LED_NUMLOCK : CONVCORE_LED_SCROLLLOCK;
+
+		actions += conv_action(&out[actions], CONVCORE_LEDS, ctx->leds);
+	}
+
+	actions += conv_action(&out[actions], repeat ? CONVCORE_REPEAT : CONVCORE_CODE, key_code);
+#else
+	if (key_code == CONV_CAPSLOCK_CODE && (ctx->options & CONVCORE_OPT_CAPS_LATCH)) { // We need to manage the capslock differently: on the amiga it remains pressed until someone pushes it again
+		ctx->leds ^= CONVCORE_LED_CAPSLOCK; // Down if it was up, up if it was down
+
+		actions += conv_action(&out[actions], CONVCORE_CODE, (ctx->leds & CONVCORE_LED_CAPSLOCK) ? CONV_CAPSLOCK_CODE : CONV_CAPSLOCK_CODE | 0x80);
+		actions += conv_action(&out[actions], CONVCORE_LEDS, ctx->leds);
+	} else if (key_code != (CONV_CAPSLOCK_CODE | 0x80) || !(ctx->options & CONVCORE_OPT_CAPS_LATCH)) { // Every other key, except the latched capslock release, which we ignore
+		actions += conv_action(&out[actions], CONVCORE_CODE, key_code);
+	}
+#endif
+
+	return actions;
+}
+
+size_t convcore_stream(convcore_t *ctx, uint8_t device, const uint8_t *in, size_t length,
+					convcore_action_t *out, size_t out_size, size_t *out_count) {
+	uint8_t *seq = ctx->seq[device];
+	uint8_t seq_count = ctx->seq_count[device];
+	size_t used, actions = 0;
+
+	for (used = 0; used < length && out_size - actions >= CONVCORE_ACTIONS_MAX; used++) {
+		uint8_t code = in[used];
+
+		if (seq_count >= CONV_SEQ_MAX) seq_count = 0; // Prefixes that never end are noise, start over
+		if (seq_count < sizeof(ctx->seq[0])) seq[seq_count] = code; // Only the first codes tell what the sequence is
+
+		// Same rules as the decoder's: Pause comes as one 8 byte sequence
+		if (code == PS2_SCANCODE_RELEASE || code == PS2_SCANCODE_EXTENDED || code == PS2_SCANCODE_PAUSE ||
+			(seq[0] == PS2_SCANCODE_PAUSE && seq_count < CONV_PAUSE_LEN)) {
+			seq_count++;
+			continue;
+		}
+
+		// seq only holds the first codes: the longer sequences (Pause) convert to nothing, and only
+		// their last code, an overrun or not, tells convcore_sequence() anything
+		if (seq_count < sizeof(ctx->seq[0])) {
+			actions += convcore_sequence(ctx, device, seq, seq_count, &out[actions]);
+		} else if (convcore_kind(&code, 0) == CONVCORE_SEQ_OVERRUN) {
+			actions += conv_action(&out[actions], CONVCORE_OVERRUN, 0);
+		}
+		seq_count = 0;
+	}
+
+	ctx->seq_count[device] = seq_count;
+	*out_count = actions;
+
+	return used;
+}
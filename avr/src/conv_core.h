@@ -0,0 +1,117 @@
+#ifndef _CONV_CORE_HEADER_
+#define _CONV_CORE_HEADER_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// PS/2 set 2 scancodes to host key codes (convtable.h), with no hardware behind it.
+// Everything it knows lives in a convcore_t: the keys held on each keyboard, the lock state,
+// the options and the remaps. What a sequence does comes back as actions, for the caller to carry out:
+// ps2_converter.c queues them to the output backend and the PS/2 keyboard, a host tool can write them out.
+// Built into the firmware, and on Linux as a static library (host/Makefile, libakabconv.a), one per OUTPUT.
+
+#if defined (__AVR__) && !defined (AKAB_KEYB2)
+#define CONVCORE_DEVICES 1
+#else
+#define CONVCORE_DEVICES 2 // Keyboards merged into one host key stream
+#endif
+
+#if defined (__AVR__) && !defined (AKAB_UART)
+#define CONVCORE_REMAPS 0
+#else
+#define CONVCORE_REMAPS 8 // Keys converted to something else than the table says
+#endif
+
+// Options, all set by default
+#define CONVCORE_OPT_RESET_CHORD 0x01 // Ctrl + both GUI keys reset the Amiga
+#define CONVCORE_OPT_CAPS_LATCH  0x02 // Amiga Caps Lock goes down on one press and up on the next; else it follows the key
+#define CONVCORE_OPTS_DEFAULT (CONVCORE_OPT_RESET_CHORD | CONVCORE_OPT_CAPS_LATCH)
+
+// PS/2 LED bits, for PS2_HTD_LEDCONTROL
+#define CONVCORE_LED_SCROLLLOCK 0x01
+#define CONVCORE_LED_NUMLOCK    0x02
+#define CONVCORE_LED_CAPSLOCK   0x04
+
+// Action types
+#define CONVCORE_CODE        0 // value: key code for the host, bit 7 set for a release
+#define CONVCORE_LEDS        1 // value: PS/2 LED bits to send the keyboard
+#define CONVCORE_KEYB_RESET  2 // Reset the keyboard (PS2_HTD_RESET)
+#define CONVCORE_HOST_RESET  3 // Reset the host. The held keys and locks are forgotten already
+#define CONVCORE_MACRO       4 // value: stored macro to play (key_macro.h)
+#define CONVCORE_MACRO_ABORT 5 // A live key press stops the macro playing
+#define CONVCORE_READOUT     6 // Type the instrumentation readout
+#define CONVCORE_REPEAT      7 // value: key code, a typematic repeat of a key down. PC/XT only: the PC has no typematic of its own
+#define CONVCORE_OVERRUN     8 // The keyboard lost keystrokes, releases among them: convcore_release() lets go of what may be stuck
+
+#define CONVCORE_ACTIONS_MAX 3 // Most actions a sequence gives
+
+// What a sequence is, from its codes alone, before converting it: for the caller to tell whether
+// it has room for the codes it may give. The same arguments as convcore_sequence()
+#define CONVCORE_SEQ_PRESS   0 // A press, a typematic repeat, Pause, or anything not mapped
+#define CONVCORE_SEQ_RELEASE 1
+#define CONVCORE_SEQ_OVERRUN 2 // PS2_SCANCODE_OVERRUN or PS2_SCANCODE_OVERRUN_SET1, never converted
+
+typedef struct {
+	uint8_t type;
+	uint8_t value;
+} convcore_action_t;
+
+#define CONVCORE_HELD_BYTES 16 // 128 key codes
+
+typedef struct {
+	uint8_t held[CONVCORE_DEVICES][CONVCORE_HELD_BYTES]; // Host keys down, per keyboard. The host sees them all merged
+	uint8_t options;
+	uint8_t leds; // Lock state as PS/2 LED bits. On the Amiga only Caps Lock, when latched
+#if CONVCORE_REMAPS
+	uint8_t remap_count;
+	uint8_t remap_code[CONVCORE_REMAPS]; // PS/2 scancode...
+	uint8_t remap_extended[CONVCORE_REMAPS]; // ... 1 if E0 prefixed
+	uint8_t remap_key[CONVCORE_REMAPS]; // ... and what it converts to
+#endif
+	uint8_t seq[CONVCORE_DEVICES][3]; // convcore_stream(): sequence being put together, first codes only
+	uint8_t seq_count[CONVCORE_DEVICES]; // ... and how many codes so far
+} convcore_t;
+
+void convcore_init(convcore_t *ctx); // Power on: no key held, no lock, default options, no remaps
+void convcore_reset(convcore_t *ctx); // The keyboard and host were reset: forgets the held keys and the locks
+
+// What a restart of the adapter alone keeps, the held keys and the lock state: a checksum over it,
+// kept along to tell a context left intact from one the hang that caused the restart wrote over,
+// and the rest (options, remaps) back to the convcore_init() defaults
+uint8_t convcore_checksum(const convcore_t *ctx);
+void convcore_restore(convcore_t *ctx);
+
+// One whole scancode sequence from a keyboard, as ps2_keyb.c hands it over: code[count] is the
+// last code, the ones before are prefixes. Writes at most CONVCORE_ACTIONS_MAX actions, returns how many
+uint8_t convcore_sequence(convcore_t *ctx, uint8_t device, const uint8_t *code, uint8_t count, convcore_action_t *out);
+uint8_t convcore_kind(const uint8_t *code, uint8_t count);
+
+// Raw PS/2 bytes from a keyboard, in any chunks: sequences split over two calls are put together.
+// Converts until the input is used up or out has less than CONVCORE_ACTIONS_MAX actions left.
+// Returns the bytes used, and the actions written in *out_count
+size_t convcore_stream(convcore_t *ctx, uint8_t device, const uint8_t *in, size_t length,
+					convcore_action_t *out, size_t out_size, size_t *out_count);
+
+// Releases on the host the keys held (and with locks, the latched Amiga Caps Lock, forgetting the lock state):
+// writes up to size break codes. Call again while it returns size
+uint8_t convcore_release(convcore_t *ctx, uint8_t locks, convcore_action_t *out, uint8_t size);
+
+uint8_t convcore_isHeld(const convcore_t *ctx, uint8_t key_code); // On any keyboard
+uint8_t convcore_anyHeld(const convcore_t *ctx); // Any key, on any keyboard
+uint8_t convcore_leds(const convcore_t *ctx); // What the keyboard LEDs should show
+
+uint8_t convcore_options(const convcore_t *ctx);
+// Turning the latch off lets go of a latched Caps Lock: writes at most 2 actions, returns how many
+uint8_t convcore_setOptions(convcore_t *ctx, uint8_t options, convcore_action_t *out);
+
+// What a scancode converts to now (extended: E0 prefixed), remaps included
+uint8_t convcore_map(const convcore_t *ctx, uint8_t ps2_code, uint8_t extended);
+
+#if CONVCORE_REMAPS
+// Mapping a key back to its table entry drops the remap. Returns 0 if the remap table is full.
+// Best done with no key held: a key remapped while down is released as its new code
+uint8_t convcore_remap(convcore_t *ctx, uint8_t ps2_code, uint8_t extended, uint8_t key_code);
+void convcore_clearRemaps(convcore_t *ctx);
+#endif
+
+#endif /* _CONV_CORE_HEADER_ */
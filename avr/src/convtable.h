@@ -0,0 +1,63 @@
+#ifndef _AKAB_CONVTABLE_HEADER_
+#define _AKAB_CONVTABLE_HEADER_
+
+#include <stdint.h>
+#if defined (__AVR__)
+#include <avr/pgmspace.h>
+#elif __has_include(<avr/pgmspace.h>) // Host builds against the stand-in headers
+#include <avr/pgmspace.h>
+#else
+// Hardware-free build (conv_core.c as a host library): the tables are plain constants
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#endif
+
+#include "key_macro.h"
+
+// PS/2 set 2 scancode to output key code tables.
+// One pair per output backend: convtable_amiga.c or convtable_xt.c, picked by OUTPUT in the Makefile.
+// Key codes are 7 bit, bit 7 is set for a release. 0xFF means "not mapped".
+// Kept small for the ATtiny4313: normal keys stop at 0x83 (F7), the few extended keys are a list.
+
+#define CONV_NORMAL_SIZE 0x84
+
+extern const uint8_t ps2_normal_convtable[CONV_NORMAL_SIZE] PROGMEM;
+extern const uint8_t ps2_extended_convtable[] PROGMEM; // PS/2 code, key code pairs; a 0x00 PS/2 code ends the list
+
+#define CONV_UNMAPPED 0xFF
+
+#define CONV_RESET_CODE 0xFE // This is an 'artificial' code that is not used by normal keypresses. We use it to ask for a host reset
+#ifdef AKAB_DEBUG_READOUT
+#define CONV_READOUT_CODE 0xFD // 'Artificial' code: types the instrumentation readout on the host
+#else
+#define CONV_READOUT_CODE CONV_UNMAPPED
+#endif
+#define CONV_MACRO_BASE 0x70 // 'Artificial' codes 0x70-0x77 start the stored macro number (code - CONV_MACRO_BASE)
+
+#define CONV_MACRO_CODE(a) (CONV_MACRO_BASE + (a))
+#define CONV_IS_MACRO(a) ((((a) & 0x7F) >= CONV_MACRO_BASE) && (((a) & 0x7F) < CONV_MACRO_BASE + KMACRO_COUNT))
+
+#if defined (AKAB_OUTPUT_XT)
+
+// The PC keeps track of the lock keys by itself; we only light the PS/2 keyboard LEDs
+#define CONV_CAPSLOCK_CODE 0x3A
+#define CONV_NUMLOCK_CODE 0x45
+#define CONV_SCROLLLOCK_CODE 0x46
+
+#define CONV_SPACE_CODE 0x39
+#define CONV_DIGIT_CODE(a) ((a) ? (a) + 1 : 0x0B) // '1' to '9' are 0x02-0x0A, '0' is 0x0B
+
+#else
+
+#define CONV_CAPSLOCK_CODE 0x62 // This is used to manage the difference between PS/2 capslock and the amiga version
+#define CONV_LCTRL_CODE 0x63
+#define CONV_LGUI_CODE 0x66
+#define CONV_RGUI_CODE 0x67
+#define CONV_RESET_CHORD // CTRL + both GUI keys reset the Amiga
+
+#define CONV_SPACE_CODE 0x40
+#define CONV_DIGIT_CODE(a) ((a) ? (a) : 0x0A) // '1' to '9' are 0x01-0x09, '0' is 0x0A
+
+#endif /* AKAB_OUTPUT_XT */
+
+#endif /* _AKAB_CONVTABLE_HEADER_ */
@@ -0,0 +1,163 @@
+#include "convtable.h"
+
+// PS/2 set 2 scancodes to Amiga scancodes
+
+// PS2 scancodes
+// http://www.computer-engineering.org/ps2keyboard/scancodes2.html
+
+// Amiga scancodes
+// http://lxr.free-electrons.com/source/drivers/input/keyboard/amikbd.c
+
+const uint8_t ps2_normal_convtable[CONV_NORMAL_SIZE] PROGMEM = {
+	0xFF, // 00 
+	0x58, // 01 - F9
+	0xFF, // 02 
+	0x54, // 03 - F5
+	0x52, // 04 - F3
+	0x50, // 05 - F1
+	0x51, // 06 - F2
+	CONV_MACRO_CODE(KMACRO_LAMIGA_M), // 07 - F12 --- Not present in Amiga, cycles screens
+	0xFF, // 08
+	0x59, // 09 - F10
+	0x57, // 0A - F8
+	0x55, // 0B - F6
+	0x53, // 0C - F4
+	0x42, // 0D - 'TAB'
+	0x00, // 0E - '`'
+	0xFF, // 0F
+	0xFF, // 10
+	0x64, // 11 - 'LEFT ALT'
+	0x60, // 12 - 'LEFT SHIFT'
+	0xFF, // 13
+	CONV_LCTRL_CODE, // 14 - 'LEFT CTRL'
+	0x10, // 15 - 'Q'
+	0x01, // 16 - '1'
+	0xFF, // 17
+	0xFF, // 18
+	0xFF, // 19
+	0x31, // 1A - 'Z'
+	0x21, // 1B - 'S'
+	0x20, // 1C - 'A'
+	0x11, // 1D - 'W'
+	0x02, // 1E - '2'
+	0xFF, // 1F
+	0xFF, // 20
+	0x33, // 21 - 'C'
+	0x32, // 22 - 'X'
+	0x22, // 23 - 'D'
+	0x12, // 24 - 'E'
+	0x04, // 25 - '4'
+	0x03, // 26 - '3'
+	0xFF, // 27
+	0xFF, // 28
+	0x40, // 29 - 'SPACE'
+	0x34, // 2A - 'V'
+	0x23, // 2B - 'F'
+	0x14, // 2C - 'T'
+	0x13, // 2D - 'R'
+	0x05, // 2E - '5'
+	0xFF, // 2F
+	0xFF, // 30
+	0x36, // 31 - 'N'
+	0x35, // 32 - 'B'
+	0x25, // 33 - 'H'
+	0x24, // 34 - 'G'
+	0x15, // 35 - 'Y'
+	0x06, // 36 - '6'
+	0xFF, // 37
+	0xFF, // 38
+	0xFF, // 39 
+	0x37, // 3A - 'M'
+	0x26, // 3B - 'J'
+	0x16, // 3C - 'U' 
+	0x07, // 3D - '7'
+	0x08, // 3E - '8'
+	0xFF, // 3F
+	0xFF, // 40
+	0x38, // 41 - ','
+	0x27, // 42 - 'K'
+	0x17, // 43 - 'I'
+	0x18, // 44 - 'O'
+	0x0A, // 45 - '0'
+	0x09, // 46 - '9'
+	0xFF, // 47
+	0xFF, // 48
+	0x39, // 49 - '.'
+	0x3A, // 4A - '/'
+	0x28, // 4B - 'L'
+	0x29, // 4C - ';'
+	0x19, // 4D - 'P'
+	0x0B, // 4E - '-'
+	0xFF, // 4F
+	0xFF, // 50
+	0xFF, // 51
+	0x2A, // 52 - '
+	0xFF, // 53
+	0x1A, // 54 - '['
+	0x0C, // 55 - '='
+	0xFF, // 56
+	0xFF, // 57
+	CONV_CAPSLOCK_CODE, // 58 - CAPSLOCK
+	0x61, // 59 - RIGHT SHIFT
+	0x44, // 5A - ENTER
+	0x1B, // 5B - ']'
+	0xFF, // 5C
+	0x0D, // 5D - '\'
+	0xFF, // 5E
+	0xFF, // 5F
+	0xFF, // 60
+	0xFF, // 61
+	0xFF, // 62
+	0xFF, // 63
+	0xFF, // 64
+	0xFF, // 65
+	0x41, // 66 - 'BACKSPACE'
+	0xFF, // 67
+	0xFF, // 68
+	0x1D, // 69 - 'KP 1'
+	0xFF, // 6A
+	0x2D, // 6B - 'KP 4'
+	0x3D, // 6C - 'KP 7'
+	0xFF, // 6D
+	0xFF, // 6E
+	0xFF, // 6F
+	0x0F, // 70 - 'KP 0'
+	0x3C, // 71 - 'KP .'
+	0x1E, // 72 - 'KP 2'
+	0x2E, // 73 - 'KP 5'
+	0x2F, // 74 - 'KP 6'
+	0x3E, // 75 - 'KP 8'
+	0x45, // 76 - ESC
+	0xFF, // 77 - 'NUM' (Num lock???)
+	CONV_MACRO_CODE(KMACRO_LAMIGA_N), // 78 - F11 --- Not present in Amiga, Workbench to front
+	0x5E, // 79 - 'KP +'
+	0x1F, // 7A - 'KP 3'
+	0x4A, // 7B - 'KP -'
+	0x5D, // 7C - 'KP *'
+	0x3F, // 7D - 'KP 9'
+	CONV_READOUT_CODE, // 7E - 'SCROLL LOCK' ?
+	0xFF, // 7F
+	0xFF, // 80
+	0xFF, // 81
+	0xFF, // 82
+	0x56  // 83 - F7
+};
+
+// Extended (E0) keys: pairs of PS/2 code and key code, terminated by a 0x00 PS/2 code
+const uint8_t ps2_extended_convtable[] PROGMEM = {
+	0x11, 0x65, // 'RIGHT ALT'
+	0x14, 0x63, // 'RIGHT CTRL'
+	0x1F, CONV_LGUI_CODE, // 'LEFT GUI' (Windows button?)
+	0x27, CONV_RGUI_CODE, // 'RIGHT GUI' (Windows button?)
+	0x4A, 0x5C, // 'KP /'
+	0x5A, 0x43, // 'KP ENTER'
+	0x69, CONV_RESET_CODE, // 'END' // *** Use it as reset button???
+	0x6B, 0x4F, // 'LEFT ARROW'
+	0x6C, 0x5F, // 'HOME' // Used as HELP button
+	0x72, 0x4D, // 'DOWN ARROW'
+	0x74, 0x4E, // 'RIGHT ARROW'
+	0x75, 0x4C, // 'UP ARROW'
+	0x7A, CONV_MACRO_CODE(KMACRO_SHIFT_DOWN), // 'PAG DOWN'
+	0x7D, CONV_MACRO_CODE(KMACRO_SHIFT_UP), // 'PAG UP'
+	0x00
+};
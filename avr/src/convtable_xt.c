@@ -0,0 +1,173 @@
+#include "convtable.h"
+
+#include "xt_keyb.h"
+
+// PS/2 set 2 scancodes to PC/XT (set 1) scancodes.
+// Keys that need an E0 prefix on the wire use the XTKBD_E0_* codes, xt_keyb expands them.
+
+// PS2 scancodes
+// http://www.computer-engineering.org/ps2keyboard/scancodes2.html
+
+// Set 1 scancodes
+// http://www.computer-engineering.org/ps2keyboard/scancodes1.html
+
+#ifdef AKAB_DEBUG_READOUT
+#define XT_SCROLL_KEY CONV_READOUT_CODE
+#else
+#define XT_SCROLL_KEY CONV_SCROLLLOCK_CODE
+#endif
+
+const uint8_t ps2_normal_convtable[CONV_NORMAL_SIZE] PROGMEM = {
+	0xFF, // 00
+	0x43, // 01 - F9
+	0xFF, // 02
+	0x3F, // 03 - F5
+	0x3D, // 04 - F3
+	0x3B, // 05 - F1
+	0x3C, // 06 - F2
+	0x58, // 07 - F12
+	0xFF, // 08
+	0x44, // 09 - F10
+	0x42, // 0A - F8
+	0x40, // 0B - F6
+	0x3E, // 0C - F4
+	0x0F, // 0D - 'TAB'
+	0x29, // 0E - '`'
+	0xFF, // 0F
+	0xFF, // 10
+	0x38, // 11 - 'LEFT ALT'
+	0x2A, // 12 - 'LEFT SHIFT'
+	0xFF, // 13
+	0x1D, // 14 - 'LEFT CTRL'
+	0x10, // 15 - 'Q'
+	0x02, // 16 - '1'
+	0xFF, // 17
+	0xFF, // 18
+	0xFF, // 19
+	0x2C, // 1A - 'Z'
+	0x1F, // 1B - 'S'
+	0x1E, // 1C - 'A'
+	0x11, // 1D - 'W'
+	0x03, // 1E - '2'
+	0xFF, // 1F
+	0xFF, // 20
+	0x2E, // 21 - 'C'
+	0x2D, // 22 - 'X'
+	0x20, // 23 - 'D'
+	0x12, // 24 - 'E'
+	0x05, // 25 - '4'
+	0x04, // 26 - '3'
+	0xFF, // 27
+	0xFF, // 28
+	0x39, // 29 - 'SPACE'
+	0x2F, // 2A - 'V'
+	0x21, // 2B - 'F'
+	0x14, // 2C - 'T'
+	0x13, // 2D - 'R'
+	0x06, // 2E - '5'
+	0xFF, // 2F
+	0xFF, // 30
+	0x31, // 31 - 'N'
+	0x30, // 32 - 'B'
+	0x23, // 33 - 'H'
+	0x22, // 34 - 'G'
+	0x15, // 35 - 'Y'
+	0x07, // 36 - '6'
+	0xFF, // 37
+	0xFF, // 38
+	0xFF, // 39
+	0x32, // 3A - 'M'
+	0x24, // 3B - 'J'
+	0x16, // 3C - 'U'
+	0x08, // 3D - '7'
+	0x09, // 3E - '8'
+	0xFF, // 3F
+	0xFF, // 40
+	0x33, // 41 - ','
+	0x25, // 42 - 'K'
+	0x17, // 43 - 'I'
+	0x18, // 44 - 'O'
+	0x0B, // 45 - '0'
+	0x0A, // 46 - '9'
+	0xFF, // 47
+	0xFF, // 48
+	0x34, // 49 - '.'
+	0x35, // 4A - '/'
+	0x26, // 4B - 'L'
+	0x27, // 4C - ';'
+	0x19, // 4D - 'P'
+	0x0C, // 4E - '-'
+	0xFF, // 4F
+	0xFF, // 50
+	0xFF, // 51
+	0x28, // 52 - '
+	0xFF, // 53
+	0x1A, // 54 - '['
+	0x0D, // 55 - '='
+	0xFF, // 56
+	0xFF, // 57
+	CONV_CAPSLOCK_CODE, // 58 - CAPSLOCK
+	0x36, // 59 - RIGHT SHIFT
+	0x1C, // 5A - ENTER
+	0x1B, // 5B - ']'
+	0xFF, // 5C
+	0x2B, // 5D - '\'
+	0xFF, // 5E
+	0xFF, // 5F
+	0xFF, // 60
+	0x56, // 61 - '<>' (102 key keyboards)
+	0xFF, // 62
+	0xFF, // 63
+	0xFF, // 64
+	0xFF, // 65
+	0x0E, // 66 - 'BACKSPACE'
+	0xFF, // 67
+	0xFF, // 68
+	0x4F, // 69 - 'KP 1'
+	0xFF, // 6A
+	0x4B, // 6B - 'KP 4'
+	0x47, // 6C - 'KP 7'
+	0xFF, // 6D
+	0xFF, // 6E
+	0xFF, // 6F
+	0x52, // 70 - 'KP 0'
+	0x53, // 71 - 'KP .'
+	0x50, // 72 - 'KP 2'
+	0x4C, // 73 - 'KP 5'
+	0x4D, // 74 - 'KP 6'
+	0x48, // 75 - 'KP 8'
+	0x01, // 76 - ESC
+	CONV_NUMLOCK_CODE, // 77 - 'NUM'
+	0x57, // 78 - F11
+	0x4E, // 79 - 'KP +'
+	0x51, // 7A - 'KP 3'
+	0x4A, // 7B - 'KP -'
+	0x37, // 7C - 'KP *'
+	0x49, // 7D - 'KP 9'
+	XT_SCROLL_KEY, // 7E - 'SCROLL LOCK'
+	0xFF, // 7F
+	0xFF, // 80
+	0xFF, // 81
+	0xFF, // 82
+	0x41  // 83 - F7
+};
+
+// Extended (E0) keys: pairs of PS/2 code and key code, terminated by a 0x00 PS/2 code
+const uint8_t ps2_extended_convtable[] PROGMEM = {
+	0x11, XTKBD_E0_RALT, // 'RIGHT ALT'
+	0x14, XTKBD_E0_RCTRL, // 'RIGHT CTRL'
+	0x4A, XTKBD_E0_KP_DIV, // 'KP /'
+	0x5A, XTKBD_E0_KP_ENTER, // 'KP ENTER'
+	0x69, XTKBD_E0_END, // 'END'
+	0x6B, XTKBD_E0_LEFT, // 'LEFT ARROW'
+	0x6C, XTKBD_E0_HOME, // 'HOME'
+	0x70, XTKBD_E0_INSERT, // 'INSERT'
+	0x71, XTKBD_E0_DELETE, // 'DELETE'
+	0x72, XTKBD_E0_DOWN, // 'DOWN ARROW'
+	0x74, XTKBD_E0_RIGHT, // 'RIGHT ARROW'
+	0x75, XTKBD_E0_UP, // 'UP ARROW'
+	0x7A, XTKBD_E0_PGDN, // 'PAG DOWN'
+	0x7C, XTKBD_E0_PRTSCR, // 'PRINT SCREEN' (after a fake E0 12)
+	0x7D, XTKBD_E0_PGUP, // 'PAG UP'
+	0x00
+};
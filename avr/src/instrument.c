@@ -0,0 +1,134 @@
+#include "instrument.h"
+
+#include <stdio.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "key_macro.h"
+#include "convtable.h"
+#include "output.h"
+
+#include "common/hal.h"
+#include "common/timing.h"
+
+#define STACK_CANARY 0xC5
+
+// Provided by the linker script
+extern uint8_t _end;
+extern uint8_t __stack;
+
+void instr_paintStack(void) __attribute__ ((naked)) __attribute__ ((used)) __attribute__ ((section (".init1")));
+
+static volatile uint8_t readout_request = 0;
+static uint16_t stack_free_min = 0xFFFF;
+
+static volatile uint8_t latency_running = 0;
+static volatile uint16_t latency_start;
+static uint16_t latency_max = 0; // Timer1 ticks
+
+#define KEY_RELEASE(a) ((a) | 0x80)
+
+static uint8_t readout_seq[2 * (5 * 2 + 2) + 1]; // Two numbers of up to 5 digits and a space, make and break, KMACRO_END
+
+// Runs before the stack pointer and r1 are set up: plain assembler, no C
+void instr_paintStack(void) {
+	__asm volatile ("    ldi r30,lo8(_end)\n"
+					"    ldi r31,hi8(_end)\n"
+					"    ldi r24,%0\n"
+					"    ldi r25,hi8(__stack)\n"
+					"    rjmp 2f\n"
+					"1:\n"
+					"    st Z+,r24\n"
+					"2:\n"
+					"    cpi r30,lo8(__stack)\n"
+					"    cpc r31,r25\n"
+					"    brlo 1b\n"
+					"    breq 1b\n"
+					:: "M" (STACK_CANARY));
+}
+
+void instr_init(void) {
+	readout_request = 0;
+	stack_free_min = 0xFFFF;
+	latency_running = 0;
+	latency_max = 0;
+}
+
+uint16_t instr_stackFreeMin(void) {
+	const uint8_t *p = &_end;
+	uint16_t count = 0;
+
+	while ((p <= &__stack) && (*p == STACK_CANARY)) {
+		p++;
+		count++;
+	}
+
+	if (count < stack_free_min) stack_free_min = count;
+
+	return stack_free_min;
+}
+
+void instr_latencyStart(uint16_t stamp) {
+	if (latency_running) return;
+
+	latency_start = stamp;
+	latency_running = 1;
+}
+
+void instr_latencyCheck(void) {
+	uint16_t ticks;
+
+	if (!latency_running) return;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { // The PS/2 interrupt may queue a code and start another one in between
+		if (!out_queueEmpty()) return;
+
+		ticks = HAL_TIMEBASE() - latency_start;
+		latency_running = 0;
+	}
+
+	if (ticks > latency_max) latency_max = ticks;
+}
+
+uint16_t instr_latencyMax(void) {
+	uint32_t us = (uint32_t)latency_max * TIMING_T1_PRESCALER / (F_CPU / 1000000UL);
+
+	return us > 0xFFFF ? 0xFFFF : us;
+}
+
+void instr_requestReadout(void) {
+	readout_request = 1;
+}
+
+// Appends value in decimal and a space, as make and break codes
+static uint8_t instr_typeNumber(uint8_t idx, uint16_t value) {
+	uint8_t digits[5];
+	uint8_t count = 0;
+
+	do {
+		digits[count++] = value % 10;
+		value /= 10;
+	} while (value);
+
+	while (count--) {
+		readout_seq[idx++] = CONV_DIGIT_CODE(digits[count]);
+		readout_seq[idx++] = KEY_RELEASE(CONV_DIGIT_CODE(digits[count]));
+	}
+	readout_seq[idx++] = CONV_SPACE_CODE;
+	readout_seq[idx++] = KEY_RELEASE(CONV_SPACE_CODE);
+
+	return idx;
+}
+
+void instr_task(void) {
+	uint8_t idx;
+
+	if (!readout_request || kmacro_running()) return;
+	readout_request = 0;
+
+	idx = instr_typeNumber(0, instr_stackFreeMin());
+	idx = instr_typeNumber(idx, instr_latencyMax());
+	readout_seq[idx] = KMACRO_END;
+
+	kmacro_startBuffer(readout_seq);
+}
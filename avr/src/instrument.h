@@ -0,0 +1,28 @@
+#ifndef _INSTRUMENT_HEADER_
+#define _INSTRUMENT_HEADER_
+
+#include <stdint.h>
+
+// Runtime instrumentation.
+// The free RAM between the end of .bss/.noinit and the stack is painted at startup (.init1):
+// the painted bytes that survive give the stack high-water mark.
+
+void instr_init(void);
+
+uint16_t instr_stackFreeMin(void); // Scans the painted area: lowest amount of free stack seen since boot
+
+// End-to-end latency on Timer1: from the start bit of a scancode sequence (ps2keyb_seqStamp())
+// to the output queue empty again, the code clocked out to the host. One at a time: sequences
+// coming while one is measured are not. Up to 65535 timer ticks (65ms at 8MHz)
+void instr_latencyStart(uint16_t stamp); // From the converter, in the PS/2 interrupt, with a code queued
+void instr_latencyCheck(void); // From the main loop, right after out_task()
+uint16_t instr_latencyMax(void); // Worst one since boot, in microseconds
+
+// Types the minimum free stack (in bytes) and the worst latency (in microseconds), decimal,
+// on the host, through the macro engine.
+// Can be called from the PS/2 interrupt: the scan runs later, in instr_task()
+void instr_requestReadout(void);
+
+void instr_task(void); // To be called from the main loop
+
+#endif /* _INSTRUMENT_HEADER_ */
@@ -0,0 +1,164 @@
+#include "key_macro.h"
+
+#include <stdio.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "output.h"
+#include "ps2_converter.h"
+
+#include "common/hal.h"
+
+// Amiga scancodes used in the stored sequences. Only the Amiga conversion table starts them
+#define AMI_LSHIFT 0x60
+#define AMI_LAMIGA 0x66
+#define AMI_UP     0x4C
+#define AMI_DOWN   0x4D
+#define AMI_N      0x36
+#define AMI_M      0x37
+
+#define AMI_RELEASE(a) ((a) | 0x80)
+
+#define KMACRO_HELD_MAX 4 // Maximum number of keys a macro can keep pressed at the same time
+#define KMACRO_NONE 0xFF
+#define KMACRO_BUFFER 0xFE // Pseudo macro number: play req_buffer, from RAM
+
+static const uint8_t macro_lamiga_n[] PROGMEM = {AMI_LAMIGA, AMI_N, AMI_RELEASE(AMI_N), AMI_RELEASE(AMI_LAMIGA), KMACRO_END};
+static const uint8_t macro_lamiga_m[] PROGMEM = {AMI_LAMIGA, AMI_M, AMI_RELEASE(AMI_M), AMI_RELEASE(AMI_LAMIGA), KMACRO_END};
+static const uint8_t macro_shift_up[] PROGMEM = {AMI_LSHIFT, AMI_UP, AMI_RELEASE(AMI_UP), AMI_RELEASE(AMI_LSHIFT), KMACRO_END};
+static const uint8_t macro_shift_down[] PROGMEM = {AMI_LSHIFT, AMI_DOWN, AMI_RELEASE(AMI_DOWN), AMI_RELEASE(AMI_LSHIFT), KMACRO_END};
+
+static const uint8_t * const macro_table[KMACRO_COUNT] PROGMEM = {
+	macro_lamiga_n,    // KMACRO_LAMIGA_N
+	macro_lamiga_m,    // KMACRO_LAMIGA_M
+	macro_shift_up,    // KMACRO_SHIFT_UP
+	macro_shift_down   // KMACRO_SHIFT_DOWN
+};
+
+// Requests coming from the interrupt
+static volatile uint8_t req_macro = KMACRO_NONE;
+static volatile uint8_t req_abort = 0;
+static const uint8_t * volatile req_buffer = NULL;
+
+// Playback state, owned by kmacro_task()
+static const uint8_t *cur_step = NULL; // Next code to send, in flash or RAM. NULL when idle
+static uint8_t cur_inRam = 0;
+// Make codes sent by the macro and not yet released. Read by the interrupt, kept over a watchdog restart
+static uint8_t held[KMACRO_HELD_MAX] HAL_NOINIT;
+static volatile uint8_t held_count HAL_NOINIT;
+
+static uint8_t kmacro_send(uint8_t code);
+
+void kmacro_start(uint8_t macro) {
+	if (macro >= KMACRO_COUNT) return;
+
+	req_macro = macro;
+	req_abort = 1; // Anything still playing is cut short first
+}
+
+void kmacro_startBuffer(const uint8_t *sequence) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		req_buffer = sequence;
+		req_macro = KMACRO_BUFFER;
+		req_abort = 1;
+	}
+}
+
+void kmacro_abort(void) {
+	if (cur_step || held_count) req_abort = 1;
+}
+
+void kmacro_reset(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		held_count = 0; // The host has let go of everything
+		req_macro = KMACRO_NONE;
+		req_abort = 1; // kmacro_task() drops the sequence it was playing
+	}
+}
+
+void kmacro_restart(void) {
+	if (held_count > KMACRO_HELD_MAX) held_count = KMACRO_HELD_MAX;
+
+	while (held_count) out_queue(AMI_RELEASE(held[--held_count]));
+	req_macro = KMACRO_NONE;
+	req_abort = 0;
+}
+
+uint8_t kmacro_running(void) {
+	return (cur_step != NULL) || held_count || (req_macro != KMACRO_NONE);
+}
+
+uint8_t kmacro_holds(uint8_t key_code) {
+	for (uint8_t idx = 0; idx < held_count; idx++) {
+		if (held[idx] == key_code) return 1;
+	}
+
+	return 0;
+}
+
+// The host must see one make and one break per key, whoever presses it: a key the user
+// holds is not pressed again, and only keys the macro pressed itself are released,
+// unless the user has pressed them meanwhile. Returns 0 if the queue is full
+static uint8_t kmacro_send(uint8_t code) {
+	uint8_t key = code & 0x7F;
+	uint8_t idx, sent = 1;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { // The converter checks the held keys and held[] from the interrupt
+		if (!(code & 0x80)) {
+			if (!ps2k_isHeld(key) && held_count < KMACRO_HELD_MAX && !kmacro_holds(key)) {
+				sent = out_queue(code);
+				if (sent) held[held_count++] = key;
+			}
+		} else {
+			for (idx = 0; idx < held_count && held[idx] != key; idx++);
+
+			if (idx < held_count) {
+				if (!ps2k_isHeld(key)) sent = out_queue(code);
+				if (sent) held[idx] = held[--held_count];
+			}
+		}
+	}
+
+	return sent;
+}
+
+void kmacro_task(void) {
+	uint8_t code;
+	uint8_t releasing = 0;
+
+	// One code at a time, and only when live keystrokes are not waiting:
+	// a live key is never delayed by more than the macro frame currently on the wire
+	if (!out_queueEmpty()) return;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { // Requests are left by the PS/2 interrupt
+		if (req_abort) {
+			cur_step = NULL;
+
+			if (held_count) releasing = 1;
+			else req_abort = 0;
+		}
+
+		if (!req_abort && (req_macro != KMACRO_NONE)) {
+			cur_inRam = (req_macro == KMACRO_BUFFER);
+			cur_step = cur_inRam ? req_buffer : (const uint8_t *)pgm_read_ptr(&macro_table[req_macro]);
+			req_macro = KMACRO_NONE;
+		}
+	}
+
+	if (releasing) { // Release whatever the interrupted macro kept pressed
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { // held_count can drop to 0 meanwhile, on a reset
+			if (held_count) kmacro_send(AMI_RELEASE(held[held_count - 1]));
+		}
+		return;
+	}
+
+	if (!cur_step) return;
+
+	code = cur_inRam ? *cur_step : pgm_read_byte(cur_step);
+	if (code == KMACRO_END) {
+		cur_step = NULL;
+		return;
+	}
+
+	if (kmacro_send(code)) cur_step++;
+}
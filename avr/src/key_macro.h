@@ -0,0 +1,32 @@
+#ifndef _KEY_MACRO_HEADER_
+#define _KEY_MACRO_HEADER_
+
+#include <stdint.h>
+
+#define KMACRO_END 0xFF // Terminates a stored sequence of make/break key codes
+
+#define KMACRO_LAMIGA_N     0 // Left Amiga + N: Workbench to front
+#define KMACRO_LAMIGA_M     1 // Left Amiga + M: cycle screens
+#define KMACRO_SHIFT_UP     2 // Shift + Up: page up in most Amiga applications
+#define KMACRO_SHIFT_DOWN   3 // Shift + Down: page down
+#define KMACRO_COUNT        4
+
+// These two can be called from the PS/2 interrupt: they only leave a request for kmacro_task()
+void kmacro_start(uint8_t macro);
+void kmacro_abort(void);
+void kmacro_reset(void); // After a host reset: forget the keys held by the macro, without releasing them
+void kmacro_restart(void); // After a watchdog restart, before interrupts: queue the release of the keys the macro held
+
+// Plays a sequence kept in RAM (terminated by KMACRO_END). It must stay untouched until played
+void kmacro_startBuffer(const uint8_t *sequence);
+
+uint8_t kmacro_running(void);
+
+// 1 if a running (or aborted, not yet released) macro keeps this key pressed on the host.
+// The converter leaves such a key to the macro: the host already sees it down
+uint8_t kmacro_holds(uint8_t key_code);
+
+// To be called from the main loop. Feeds the output queue one code at a time, only when it's empty
+void kmacro_task(void);
+
+#endif /* _KEY_MACRO_HEADER_ */
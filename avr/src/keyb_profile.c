@@ -0,0 +1,151 @@
+#include "keyb_profile.h"
+
+#include <stddef.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <util/delay.h>
+
+#include "ps2_keyb.h"
+#include "ps2_proto.h"
+#include "watchdog.h"
+
+#define KBPROF_ID_TRIES    50  // ID queries, KBPROF_RETRY_MS apart at least, before giving up on the keyboard
+#define KBPROF_RETRY_MS    20
+#define KBPROF_BAT_READS   10  // Reads of KBPROF_BAT_READ_MS waiting for the 0xAA of a reset (500 to 750ms)
+#define KBPROF_BAT_READ_MS 100
+
+#define KBPROF_SET2_TRANSLATED 0x41 // Set 2 as some keyboards report it, translated to set 1
+#define KBPROF_TYPEMATIC_RATE  0x7F // 2 per second, after 1s
+
+#define KBPROF_CHECK_SEED 0xA5 // An erased slot (0xFF) or one from the .eep file (0x00) fails the check
+
+typedef struct {
+	uint8_t id[2]; // Zero padded
+	uint8_t id_length; // 0 to 2: an AT keyboard only acknowledges the ID query
+	uint8_t flags; // KBPROF_*
+	uint8_t check; // kbprof_check() of the bytes before
+} kbprof_entry_t;
+
+static kbprof_entry_t kbprof_cache[KBPROF_SLOTS] EEMEM;
+static uint8_t kbprof_next EEMEM; // Slot the next new keyboard takes, round robin
+
+static uint8_t kbprof_check(const kbprof_entry_t *entry) {
+	const uint8_t *bytes = (const uint8_t *)entry;
+	uint8_t crc = KBPROF_CHECK_SEED;
+
+	for (uint8_t idx = 0; idx < offsetof(kbprof_entry_t, check); idx++) crc = _crc8_ccitt_update(crc, bytes[idx]);
+
+	return crc;
+}
+
+// Slot holding the keyboard with the ID of entry, KBPROF_SLOTS if none
+static uint8_t kbprof_find(const kbprof_entry_t *entry, kbprof_entry_t *found) {
+	uint8_t slot;
+
+	for (slot = 0; slot < KBPROF_SLOTS; slot++) {
+		eeprom_read_block(found, &kbprof_cache[slot], sizeof(*found));
+
+		if (found->check == kbprof_check(found) && found->id_length == entry->id_length &&
+				found->id[0] == entry->id[0] && found->id[1] == entry->id[1]) break;
+	}
+
+	return slot;
+}
+
+static void kbprof_store(kbprof_entry_t *entry) {
+	kbprof_entry_t found;
+	uint8_t slot = kbprof_find(entry, &found);
+
+	if (slot == KBPROF_SLOTS) { // A new one
+		slot = eeprom_read_byte(&kbprof_next) % KBPROF_SLOTS;
+		eeprom_update_byte(&kbprof_next, (slot + 1) % KBPROF_SLOTS);
+	}
+
+	entry->check = kbprof_check(entry);
+	eeprom_update_block(entry, &kbprof_cache[slot], sizeof(*entry)); // Only the bytes that changed are written
+}
+
+// The profile in one burst. The LEDs are put out, as a reset would: the converter starts with no lock on
+static uint8_t kbprof_apply(uint8_t flags) {
+	uint8_t burst[7], length = 0;
+
+	burst[length++] = PS2_HTD_LEDCONTROL;
+	burst[length++] = 0;
+	if (flags & KBPROF_SET2) {
+		burst[length++] = PS2_HTD_SCANCODESET;
+		burst[length++] = 2;
+	}
+	if (flags & KBPROF_TYPEMATIC) {
+		burst[length++] = PS2_HTD_TYPEMATIC;
+		burst[length++] = KBPROF_TYPEMATIC_RATE;
+	}
+	burst[length++] = PS2_HTD_ENABLE;
+
+	return ps2keyb_query(burst, length, NULL, 0) != PS2KEYB_NOACK;
+}
+
+// Resets the keyboard, then finds out what it takes. Returns 0 if it does not take the reset
+static uint8_t kbprof_probe(kbprof_entry_t *entry) {
+	uint8_t command[2], answer;
+
+	entry->flags = 0;
+
+	command[0] = PS2_HTD_RESET;
+	if (ps2keyb_query(command, 1, NULL, 0) == PS2KEYB_NOACK) return 0;
+
+	for (uint8_t reads = KBPROF_BAT_READS; reads; reads--) {
+		wdog_kick();
+		if (ps2keyb_readByte(&answer, KBPROF_BAT_READ_MS) && answer == PS2_SCANCODE_BAT_OK) break;
+	}
+	wdog_kick();
+
+	// Keyboards that do not know the question are in set 2
+	command[0] = PS2_HTD_SCANCODESET;
+	command[1] = 0;
+	if (ps2keyb_query(command, 2, &answer, 1) == 1 && answer != 2 && answer != KBPROF_SET2_TRANSLATED) {
+		command[1] = 2;
+		if (ps2keyb_query(command, 2, NULL, 0) != PS2KEYB_NOACK) entry->flags |= KBPROF_SET2;
+	}
+
+#ifndef AKAB_OUTPUT_XT // The PC/XT has no typematic of its own: it gets the keyboard's
+	command[0] = PS2_HTD_TYPEMATIC;
+	command[1] = KBPROF_TYPEMATIC_RATE;
+	if (ps2keyb_query(command, 2, NULL, 0) != PS2KEYB_NOACK) entry->flags |= KBPROF_TYPEMATIC;
+#endif
+
+	command[0] = PS2_HTD_ENABLE; // Some keyboards stop scanning while they change sets
+	ps2keyb_query(command, 1, NULL, 0);
+
+	return 1;
+}
+
+uint8_t kbprof_boot(void) {
+	kbprof_entry_t entry, found;
+	uint8_t command = PS2_HTD_READID;
+	uint8_t count = PS2KEYB_NOACK;
+
+	// Not a word from the keyboard during its self test: the query is tried until it gets through
+	for (uint8_t tries = KBPROF_ID_TRIES; tries && count == PS2KEYB_NOACK; tries--) {
+		wdog_kick();
+		count = ps2keyb_query(&command, 1, entry.id, sizeof(entry.id));
+		if (count == PS2KEYB_NOACK) _delay_ms(KBPROF_RETRY_MS);
+	}
+	wdog_kick();
+
+	if (count != PS2KEYB_NOACK) {
+		entry.id_length = count;
+		for (; count < sizeof(entry.id); count++) entry.id[count] = 0;
+
+		if (kbprof_find(&entry, &found) < KBPROF_SLOTS && kbprof_apply(found.flags)) return KBPROF_CACHED;
+
+		if (kbprof_probe(&entry)) {
+			kbprof_store(&entry);
+			return KBPROF_PROBED;
+		}
+	}
+
+	command = PS2_HTD_RESET;
+	ps2keyb_sendCommand(&command, 1);
+
+	return KBPROF_ABSENT;
+}
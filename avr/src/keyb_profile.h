@@ -0,0 +1,28 @@
+#ifndef _KEYB_PROFILE_HEADER_
+#define _KEYB_PROFILE_HEADER_
+
+#include <stdint.h>
+
+// Keyboard start up with a cache of keyboards seen before (AKAB_KEYB_PROFILE).
+// The keyboard is asked for its ID (PS2_HTD_READID) as soon as it is out of its power on self test.
+// One found in the cache gets the commands it took last time, each sent as soon as the last one is
+// acknowledged: no reset, no second self test. Any other, or one refusing its profile, is reset
+// and probed, and goes in the cache, in EEPROM, in place of the oldest keyboard there.
+// The first keyboard only: with AKAB_KEYB2 the second one keeps the settings it powers up with.
+
+#define KBPROF_SLOTS 4 // Keyboards remembered
+
+// What a keyboard takes on top of its power on defaults
+#define KBPROF_SET2      0x01 // Starts in another scancode set: set 2 is selected
+#define KBPROF_TYPEMATIC 0x02 // Amiga only: the slowest typematic rate, the converter drops the repeats anyway
+
+// What kbprof_boot() did
+#define KBPROF_CACHED 0 // Known keyboard, profile applied
+#define KBPROF_PROBED 1 // New keyboard (or a profile refused): reset, probed and cached
+#define KBPROF_ABSENT 2 // No answer: reset the old way (ps2keyb_sendCommand()), in case it comes later
+
+// Cold start only, with interrupts still off, after ps2keyb_init(). Kicks the watchdog as it goes:
+// it takes up to a second waiting for the keyboard, and another one probing it
+uint8_t kbprof_boot(void);
+
+#endif /* _KEYB_PROFILE_HEADER_ */
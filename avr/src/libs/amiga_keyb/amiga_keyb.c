@@ -5,12 +5,46 @@
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "common/trace.h"
+#include "common/hal.h"
+#include "common/timing.h"
 
 #define AMI_KBDCODE_SELFTESTFAILED 0xFC
 #define AMI_KBDCODE_INITKEYSTREAM  0xFD
 #define AMI_KBDCODE_ENDKEYSTREAM   0xFE
 #define AMI_KBDCODE_LOSTSYNC       0xF9
 
+// Bit timing: KDAT set up, KCLK low, KCLK high, about 20us each as in the Amiga keyboard.
+// These are minimums: the Amiga clocks KDAT in on KCLK, so at a low F_CPU the port
+// accesses around the waits only make the phases a few us longer.
+#define AMI_BIT_SETUP_US 20
+#define AMI_CLK_LOW_US   20
+#define AMI_CLK_HIGH_US  20
+
+#define AMI_SYNC_PULSE_US  1   // KDAT pulse that starts a resync
+#define AMI_SYNC_SETTLE_US 20  // KDAT released before the handshake interrupt is armed
+#define AMI_SYNC_RETRY_US  120 // Wait for the handshake after each resync clock, at least...
+#define AMI_SYNC_RETRY_MAX_US 1000 // ... and at most: 255 of them stay well within the watchdog timeout
+#define AMI_RESET_MS       600 // KCLK and reset held low for a hard reset
+
+// Handshake pacing. The Amiga answers each code by pulling KDAT low for at least 85us, as soon
+// as its keyboard interrupt gets to it: tens of us on an idle machine, longer on a busy one,
+// at most 143ms. The INT1 falling edge timestamps the start of every handshake. The next code
+// goes out as soon as the Amiga releases KDAT, plus a margin. Only a handshake missing for the
+// whole 143ms is a lost one, answered with a resync (which costs the code).
+// The slowest handshake seen lately (times 4) only schedules the wait: that long it is polled
+// right after the code, for back to back codes; past it the main loop gets on with its work and
+// amikbd_kProcessQueue() polls it from there.
+#ifndef AMI_HS_MARGIN_US
+#define AMI_HS_MARGIN_US 10 // Makefile: HS_MARGIN
+#endif
+#define AMI_HS_WAIT_US        143000UL // The Amiga answers within this, or it lost the code
+#define AMI_HS_SPIN_MIN_US    170      // Polled right after the code, at least...
+#define AMI_HS_SPIN_MAX_US    1000     // ... at most. Also the spin until a first handshake has been timed
+#define AMI_HS_RELEASE_MAX_US 2000     // KDAT low for longer than this is not a handshake: go on
+
 // Data port
 static volatile uint8_t *dPort, *dDir;
 static volatile uint8_t dPNum; // Data port pin number
@@ -24,23 +58,32 @@ static volatile uint8_t *rPort, *rDir;
 static volatile uint8_t rPNum; // Reset port pin number
 
 static volatile uint8_t amikbd_synced = 0;
+static volatile uint16_t hs_stamp; // HAL_TIMEBASE() at the start of the last handshake
+
+// In HAL_TIMEBASE() ticks: the slowest recent handshake, counted from the end of its code, and the spin it gives
+static uint16_t hs_latency = 0;
+static uint32_t hs_window = TIMING_T1_TICKS(AMI_HS_SPIN_MAX_US);
+
+// A code went out and its handshake has not been seen yet: polled from amikbd_kProcessQueue()
+static uint8_t hs_pending = 0;
+static uint16_t hs_start, hs_last; // HAL_TIMEBASE() at the end of the code, and at the last poll
+static uint32_t hs_elapsed; // Ticks since the end of the code, as of the last poll
+
+#define AMI_QUEUE_SIZE 16 // Must be a power of two
+
+// Ring buffer of codes waiting to be clocked out to the Amiga
+static volatile uint8_t cmdQueue[AMI_QUEUE_SIZE];
+static volatile uint8_t q_in, q_out;
 
 static inline void amikbd_kClock(void);
 static inline void amikbd_kToggleData(uint8_t bit);
-uint8_t amikbd_kSync(void);
+static uint8_t amikbd_kSync(uint32_t window);
+static void amikbd_kFinish(void);
 
 void amikbd_setup(volatile uint8_t *clockPort, volatile uint8_t *clockDir, uint8_t clockPNum, volatile uint8_t *resetPort, volatile uint8_t *resetDir, uint8_t resetPNum) {
-#if defined (__AVR_ATmega128__)
-	dPort = &PORTD;
-	dDir = &DDRD;
-	dPNum = 1; // PD1, for INT1
-#elif defined (__AVR_ATtiny4313__) || defined (__AVR_ATmega328P__) || defined (__AVR_ATmega8A__)
 	dPort = &PORTD;
 	dDir = &DDRD;
-	dPNum = 3; // PD3, for INT1
-#else
-	// ???
-#endif
+	dPNum = HAL_INT1_PNUM; // KDAT is on INT1
 
 	rPort = resetPort;
 	rDir = resetDir;
@@ -67,26 +110,16 @@ void amikbd_setup(volatile uint8_t *clockPort, volatile uint8_t *clockDir, uint8
 	*rDir &= ~(1 << rPNum); // KB reset line set as input
 	*rPort &= ~(1 << rPNum); // Disable pull-up resistor in reset line
 
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-	EICRA &= ~((1 << ISC10) | (1 << ISC11)); // Trigger interrupt at LOW LEVEL (INT1)
-	EIMSK &= ~(1 << INT1); // Disable INT1
-	EIFR |= (1 << INTF1); // Clear interrupt flag
-#elif defined (__AVR_ATtiny4313__)
-	MCUCR &= ~((1 << ISC10) | (1 << ISC11)); // Trigger interrupt at LOW LEVEL (INT1)
-	GIMSK &= ~(1 << INT1); // Disable INT1
-	GIFR |= (1 << INTF1); // Clear interrupt flag
-#elif defined (__AVR_ATmega8A__)
-	MCUCR &= ~((1 << ISC10) | (1 << ISC11)); // Trigger interrupt at LOW LEVEL (INT1)
-	GICR &= ~(1 << INT1); // Disable INT1
-	GIFR |= (1 << INTF1); // Clear interrupt flag
-#else
-	// ???
-#endif
+	HAL_INT1_FALLING(); // Interrupt at the start of the handshake (INT1)
+	HAL_INT1_DISABLE();
+	HAL_INT1_CLEAR(); // Clear interrupt flag
+
+	HAL_TIMEBASE_INIT(); // Handshake timestamps
 }
 
 // http://amigadev.elowar.com/read/ADCD_2.1/Hardware_Manual_guide/node0177.html
 void amikbd_init(void) {
-	amikbd_kSync();
+	if (!amikbd_kSync(0)) return; // Nobody there to get the power-up stream
 
 	// We should send the "test failed" code here, if any problem is detected
 
@@ -100,27 +133,31 @@ void amikbd_init(void) {
 
 }
 
-ISR(INT1_vect) { // Manage INT1
+// http://amigadev.elowar.com/read/ADCD_2.1/Hardware_Manual_guide/node0176.html
+void amikbd_resume(void) {
+	// We may have stopped in the middle of a code: clock out ones until the Amiga
+	// answers, then tell it the last code was lost, as a keyboard that lost sync does
+	amikbd_kSync(0);
+	amikbd_kSendCommand(AMI_KBDCODE_LOSTSYNC);
+}
+
+ISR(INT1_vect) { // KDAT falling: the Amiga starts the handshake
+	hs_stamp = HAL_TIMEBASE();
 	amikbd_synced = 1;
+	TRACE_SYNC();
 
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-	EIMSK &= ~(1 << INT1); // Disable INT1
-#elif defined (__AVR_ATtiny4313__)
-	GIMSK &= ~(1 << INT1); // Disable INT1
-#elif defined (__AVR_ATmega8A__)
-	GICR  &= ~(1 << INT1); // Disable INT1
-#endif
+	HAL_INT1_DISABLE();
 }
 
 // Clock the keyboard line
 static inline void amikbd_kClock(void) {
-	_delay_us(20);
+	_delay_us(AMI_BIT_SETUP_US);
 	*cDir |= (1 << cPNum); // KB Clock line set as output (thus pulling the line low)
 	
-	_delay_us(20);
+	_delay_us(AMI_CLK_LOW_US);
 	*cDir &= ~(1 << cPNum); // KB Clock line set as input (thus letting the resistors pull the line high)
 	
-	_delay_us(20);
+	_delay_us(AMI_CLK_HIGH_US);
 }
 
 void amikbd_kForceReset(void) {
@@ -129,11 +166,16 @@ void amikbd_kForceReset(void) {
 
 	// Send a reset signal through the clock port too...
 	*cDir |= (1 << cPNum); // KB Clock line set as output (thus pulling the line low)
-	_delay_ms(600);
+	_delay_ms(AMI_RESET_MS);
 	*cDir &= ~(1 << cPNum); // KB Clock line set as input (thus letting the resistors pull the line high)
 
 	// Set reset line as floating again...
 	*rDir &= ~(1 << rPNum); // KB reset line set as input
+
+	// The Amiga boots now: no handshake to wait for, and time them again
+	hs_pending = 0;
+	hs_latency = 0;
+	hs_window = TIMING_T1_TICKS(AMI_HS_SPIN_MAX_US);
 }
 
 static inline void amikbd_kToggleData(uint8_t bit) {
@@ -145,42 +187,68 @@ static inline void amikbd_kToggleData(uint8_t bit) {
 	amikbd_kClock();
 }
 
-uint8_t amikbd_kSync(void) {
-	uint8_t retries = 0xFF;
+// Arms INT1 for the next handshake. Our own KDAT edges are cleared; a handshake that
+// already began is caught on the line level
+static void amikbd_kArm(void) {
+	amikbd_synced = 0;
+	HAL_INT1_CLEAR(); // Clear interrupt flag
+	HAL_INT1_ENABLE();
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (!amikbd_synced && HAL_INT1_IS_LOW()) {
+			hs_stamp = HAL_TIMEBASE();
+			amikbd_synced = 1;
+			HAL_INT1_DISABLE();
+		}
+	}
+}
 
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-	EIMSK &= ~(1 << INT1); // Disable INT1
-#elif defined (__AVR_ATtiny4313__)
-	GIMSK &= ~(1 << INT1); // Disable INT1
-#elif defined (__AVR_ATmega8A__)
-	GICR  &= ~(1 << INT1); // Disable INT1
-#endif
+// Polls until the handshake starts, or ticks have gone by
+static void amikbd_kWaitSync(uint32_t ticks) {
+	uint16_t last = HAL_TIMEBASE(), now;
+	uint32_t elapsed = 0;
+
+	while (!amikbd_synced && elapsed < ticks) {
+		now = HAL_TIMEBASE();
+		elapsed += (uint16_t)(now - last);
+		last = now;
+	}
+}
+
+static void amikbd_kLearn(uint16_t latency) {
+	if (latency >= hs_latency) hs_latency = latency;
+	else hs_latency -= (hs_latency - latency + 255) >> 8; // A slow one is forgotten over a thousand codes or so
+
+	hs_window = 4UL * hs_latency + TIMING_T1_TICKS(AMI_HS_MARGIN_US);
+	if (hs_window < TIMING_T1_TICKS(AMI_HS_SPIN_MIN_US)) hs_window = TIMING_T1_TICKS(AMI_HS_SPIN_MIN_US);
+	if (hs_window > TIMING_T1_TICKS(AMI_HS_SPIN_MAX_US)) hs_window = TIMING_T1_TICKS(AMI_HS_SPIN_MAX_US);
+}
+
+// Lets go of KDAT after a code (or a resync clock) and arms INT1 for the handshake
+static void amikbd_kStartSync(void) {
+	HAL_INT1_DISABLE();
 	
 	*dDir |= (1 << dPNum); // Set the data pin to output, and pull the line low
-	_delay_us(1);
+	_delay_us(AMI_SYNC_PULSE_US);
 	*dDir &= ~(1 << dPNum); // KB Data line set as input
-	_delay_us(20);
-
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-	EIMSK |= (1 << INT1); // Enable INT1
-#elif defined (__AVR_ATtiny4313__)
-	GIMSK |= (1 << INT1); // Enable INT1
-#elif defined (__AVR_ATmega8A__)
-	GICR  |= (1 << INT1); // Enable INT1
-#endif
-	
-	_delay_us(170);
+	hs_start = hs_last = HAL_TIMEBASE();
+	hs_elapsed = 0;
+	_delay_us(AMI_SYNC_SETTLE_US);
+
+	amikbd_kArm();
+}
+
+// Clocks out ones until the Amiga answers: it lost the last code, or we stopped in the middle of one
+static uint8_t amikbd_kResync(void) {
+	uint8_t retries = 0xFF;
+	uint32_t retry_window;
 
-	if (amikbd_synced) return 1; // The keyboard got synced
+	retry_window = hs_window;
+	if (retry_window < TIMING_T1_TICKS(AMI_SYNC_RETRY_US)) retry_window = TIMING_T1_TICKS(AMI_SYNC_RETRY_US);
+	if (retry_window > TIMING_T1_TICKS(AMI_SYNC_RETRY_MAX_US)) retry_window = TIMING_T1_TICKS(AMI_SYNC_RETRY_MAX_US);
 
-	while (retries--) {
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-		EIMSK &= ~(1 << INT1); // Disable INT1
-#elif defined (__AVR_ATtiny4313__)
-		GIMSK &= ~(1 << INT1); // Disable INT1
-#elif defined (__AVR_ATmega8A__)
-		GICR  &= ~(1 << INT1); // Disable INT1
-#endif
+	while (!amikbd_synced && retries--) {
+		HAL_INT1_DISABLE();
 
 		*dDir |= (1 << dPNum); // Set the data pin to output, and pull the line low
 		
@@ -188,32 +256,81 @@ uint8_t amikbd_kSync(void) {
 
 		*dDir &= ~(1 << dPNum); // KB Data line set as input
 
-		_delay_us(20);
+		_delay_us(AMI_SYNC_SETTLE_US);
 
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-		EIFR |= (1 << INTF1); // Clear interrupt flag
-#elif defined (__AVR_ATtiny4313__) || defined (__AVR_ATmega8A__)
-		GIFR |= (1 << INTF1); // Clear interrupt flag
-#endif
-		amikbd_synced = 0;
+		amikbd_kArm();
+		amikbd_kWaitSync(retry_window);
+	}
 
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-		EIMSK |= (1 << INT1); // Enable INT1
-#elif defined (__AVR_ATtiny4313__) || defined (__AVR_ATmega8A__)
-		GICR  |= (1 << INT1); // Enable INT1
-#endif
-		_delay_us(120);
+	return amikbd_synced;
+}
+
+// The handshake started: times it (learn), and waits for the Amiga to let go of KDAT
+static void amikbd_kSynced(uint8_t learn) {
+	uint16_t last, now;
+	uint32_t elapsed = 0;
 
-		if (amikbd_synced) return 1;
+	// Modulo 16 bits: a slower one is taken as that much less, and soon forgotten
+	if (learn) amikbd_kLearn(hs_elapsed > 0xFFFF ? 0xFFFF : (uint16_t)(hs_stamp - hs_start));
+
+	// The next code can go as soon as the Amiga lets go of KDAT
+	last = HAL_TIMEBASE();
+	while (HAL_INT1_IS_LOW() && elapsed < TIMING_T1_TICKS(AMI_HS_RELEASE_MAX_US)) {
+		now = HAL_TIMEBASE();
+		elapsed += (uint16_t)(now - last);
+		last = now;
 	}
+	_delay_us(AMI_HS_MARGIN_US);
+}
+
+// Waits for the handshake of the code just sent, up to window ticks, then resyncs.
+// A window of 0 goes straight to the resync, as at power up
+static uint8_t amikbd_kSync(uint32_t window) {
+	amikbd_kStartSync();
+	amikbd_kWaitSync(window);
+	if (!amikbd_synced && !amikbd_kResync()) return 0; // Sync failed
+
+	amikbd_kSynced(window != 0);
+	return 1; // The keyboard got synced
+}
+
+// Polls the pending handshake: 1 once it is over, or the Amiga lost the code and got a resync
+static uint8_t amikbd_kPoll(void) {
+	uint16_t now;
+
+	if (!hs_pending) return 1;
+
+	if (!amikbd_synced) {
+		now = HAL_TIMEBASE();
+		hs_elapsed += (uint16_t)(now - hs_last);
+		hs_last = now;
+		if (hs_elapsed < TIMING_T1_TICKS(AMI_HS_WAIT_US)) return 0;
+
+		if (!amikbd_synced) { // Not even now
+			hs_pending = 0;
+			if (amikbd_kResync()) amikbd_kSynced(0);
+			return 1;
+		}
+	}
+
+	hs_pending = 0;
+	amikbd_kSynced(1);
+	return 1;
+}
 
-	return 0; // Sync failed
+// Waits out the pending handshake, for a code sent straight after
+static void amikbd_kFinish(void) {
+	while (!amikbd_kPoll());
 }
 
 // http://amigadev.elowar.com/read/ADCD_2.1/Hardware_Manual_guide/node0173.html
 void amikbd_kSendCommand(uint8_t command) {
 	if (command == 0xFF) return;
 
+	amikbd_kFinish();
+
+	TRACE_TX_START();
+
 	*dDir &= ~(1 << dPNum); // KB Data line set as input, letting the resistor pull the line high
 
 	amikbd_kToggleData((command >> 6) & 1);
@@ -225,6 +342,47 @@ void amikbd_kSendCommand(uint8_t command) {
 	amikbd_kToggleData((command >> 0) & 1);
 	amikbd_kToggleData((command >> 7) & 1);
 
-	amikbd_kSync();
+	TRACE_TX_END();
+
+	// As long as this Amiga has been seen to take, and a bit more; then from the main loop
+	amikbd_kStartSync();
+	amikbd_kWaitSync(hs_window);
+	hs_pending = 1;
+	amikbd_kPoll();
+}
+
+uint8_t amikbd_kQueueCommand(uint8_t command) {
+	uint8_t queued = 0;
+
+	if (command == 0xFF) return 1;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { // May be called both from the main loop and from the PS/2 interrupt
+		if (((q_in + 1) & (AMI_QUEUE_SIZE - 1)) != q_out) {
+			cmdQueue[q_in] = command;
+			q_in = (q_in + 1) & (AMI_QUEUE_SIZE - 1);
+			queued = 1;
+		}
+	}
+
+	return queued;
 }
 
+uint8_t amikbd_kQueueEmpty(void) {
+	return q_in == q_out && !hs_pending; // The last code is not through until the Amiga answered
+}
+
+uint8_t amikbd_kQueueFree(void) {
+	return (q_out - q_in - 1) & (AMI_QUEUE_SIZE - 1); // One slot always stays empty
+}
+
+void amikbd_kProcessQueue(void) {
+	uint8_t command;
+
+	if (!amikbd_kPoll()) return; // The Amiga has not answered the last code yet
+	if (q_in == q_out) return;
+
+	command = cmdQueue[q_out];
+	amikbd_kSendCommand(command); // Returns after the handshake, or with it pending
+
+	q_out = (q_out + 1) & (AMI_QUEUE_SIZE - 1); // Only the main loop moves the out index
+}
@@ -5,8 +5,15 @@
 
 void amikbd_setup(volatile uint8_t *clockPort, volatile uint8_t *clockDir, uint8_t clockPNum, volatile uint8_t *resetPort, volatile uint8_t *resetDir, uint8_t resetPNum);
 void amikbd_init(void);
+void amikbd_resume(void); // Instead of amikbd_init() after a restart of the adapter alone: the Amiga kept running
 
-void amikbd_kSendCommand(uint8_t command); // ANDing the command code with 0x80 sets the release bit
+void amikbd_kSendCommand(uint8_t command); // ANDing the command code with 0x80 sets the release bit. Waits for the handshake of the last one first
 void amikbd_kForceReset(void);
 
+// Queued transmission: codes are pushed (also from interrupt context) and sent from the main loop
+uint8_t amikbd_kQueueCommand(uint8_t command); // Returns 0 if the queue is full and the command was dropped
+uint8_t amikbd_kQueueEmpty(void); // Also waits for the handshake of the last code sent
+uint8_t amikbd_kQueueFree(void); // How many more commands the queue takes
+void amikbd_kProcessQueue(void); // Sends at most one queued command once the last one is answered, polling its handshake
+
 #endif /* _AMIGA_KEYBOARD_HEADER_ */
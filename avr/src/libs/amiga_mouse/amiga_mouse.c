@@ -0,0 +1,132 @@
+#include "amiga_mouse.h"
+
+#include <stdio.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "common/timing.h"
+
+#if !defined (__AVR_ATmega328P__)
+#error "Amiga mouse output needs PORTC and Timer2 (ATmega328P only)"
+#endif
+
+// http://amigadev.elowar.com/read/ADCD_2.1/Hardware_Manual_guide/node0191.html
+
+#define AMIMOUSE_TIMER_PRESCALER 8
+#define AMIMOUSE_OCR TIMING_CTC_TOP(AMIMOUSE_TICK_HZ, AMIMOUSE_TIMER_PRESCALER)
+#define AMIMOUSE_PERIOD_TICKS (AMIMOUSE_TICK_HZ / AMIMOUSE_REPORT_HZ) // Generator ticks in a PS/2 report period
+
+#if (AMIMOUSE_OCR < 1) || (AMIMOUSE_OCR > 255)
+#error "AMIMOUSE_TICK_HZ cannot be reached with Timer2 at this F_CPU"
+#endif
+
+#if TIMING_CTC_INEXACT(AMIMOUSE_TICK_HZ, AMIMOUSE_TIMER_PRESCALER)
+#warning "AMIMOUSE_TICK_HZ is not a divisor of F_CPU / 8: the pointer speed will be off"
+#endif
+
+#if AMIMOUSE_PERIOD_TICKS > 127
+#error "The step accumulator is 8 bits: lower AMIMOUSE_TICK_HZ or raise AMIMOUSE_REPORT_HZ"
+#endif
+
+#define QUAD_X_SHIFT 2 // PC2, PC3
+#define QUAD_Y_SHIFT 4 // PC4, PC5
+#define QUAD_MASK ((0x03 << QUAD_X_SHIFT) | (0x03 << QUAD_Y_SHIFT))
+
+#define BTN_LEFT_PNUM   4 // PD4, fire button
+#define BTN_RIGHT_PNUM  5 // PD5, POTY
+#define BTN_MIDDLE_PNUM 2 // PB2, POTX
+
+// One axis of the generator
+typedef struct {
+	int16_t pending; // Steps still to be emitted, signed
+	uint8_t rate;    // Steps per report period, latched at every report
+	uint8_t frac;    // DDA accumulator: one step every time it overflows AMIMOUSE_PERIOD_TICKS
+	uint8_t phase;   // Quadrature phase, 0..3
+} amimouse_axis_t;
+
+// Gray code sequence on the two lines: 00, 01, 11, 10
+static const uint8_t quad_phase[4] = {0x00, 0x01, 0x03, 0x02};
+
+static amimouse_axis_t axis_x, axis_y; // Shared between PCINT1 and TIMER2 only, which never nest
+
+static inline void amimouse_axisAdd(amimouse_axis_t *axis, int16_t delta);
+static inline void amimouse_axisTick(amimouse_axis_t *axis);
+
+void amimouse_init(void) {
+	axis_x.pending = axis_y.pending = 0;
+	axis_x.rate = axis_y.rate = 0;
+	axis_x.frac = axis_y.frac = 0;
+	axis_x.phase = axis_y.phase = 0;
+
+	// Quadrature lines are driven push-pull, like the comparators in a real mouse
+	PORTC &= ~QUAD_MASK;
+	DDRC |= QUAD_MASK;
+
+	// Buttons are released: inputs without pull-ups, the Amiga has its own
+	DDRD &= ~((1 << BTN_LEFT_PNUM) | (1 << BTN_RIGHT_PNUM));
+	PORTD &= ~((1 << BTN_LEFT_PNUM) | (1 << BTN_RIGHT_PNUM));
+	DDRB &= ~(1 << BTN_MIDDLE_PNUM);
+	PORTB &= ~(1 << BTN_MIDDLE_PNUM);
+
+	// Timer2 in CTC mode
+	TCCR2A = (1 << WGM21);
+	TCCR2B = (1 << CS21); // clk/8
+	OCR2A = AMIMOUSE_OCR;
+	TCNT2 = 0;
+	TIMSK2 |= (1 << OCIE2A);
+}
+
+static inline void amimouse_axisAdd(amimouse_axis_t *axis, int16_t delta) {
+	int16_t steps;
+
+	// A mouse moved faster than the generator goes (more than AMIMOUSE_TICK_HZ counts a second)
+	// would pile steps up without end, and wrap around: past the limit they are dropped
+	axis->pending += delta;
+	if (axis->pending > AMIMOUSE_PENDING_MAX) axis->pending = AMIMOUSE_PENDING_MAX;
+	else if (axis->pending < -AMIMOUSE_PENDING_MAX) axis->pending = -AMIMOUSE_PENDING_MAX;
+
+	// Spread what is pending evenly over the next report period. If it's more than
+	// the generator can emit in one period, go at full speed: steps are delayed, up to the limit
+	steps = axis->pending < 0 ? -axis->pending : axis->pending;
+	axis->rate = steps > AMIMOUSE_PERIOD_TICKS ? AMIMOUSE_PERIOD_TICKS : steps;
+}
+
+void amimouse_report(int16_t dx, int16_t dy, uint8_t buttons) {
+	amimouse_axisAdd(&axis_x, dx);
+	amimouse_axisAdd(&axis_y, -dy); // Amiga counts down the screen
+
+	if (buttons & AMIMOUSE_BTN_LEFT) DDRD |= (1 << BTN_LEFT_PNUM); // Pull the line low
+	else DDRD &= ~(1 << BTN_LEFT_PNUM);
+
+	if (buttons & AMIMOUSE_BTN_RIGHT) DDRD |= (1 << BTN_RIGHT_PNUM);
+	else DDRD &= ~(1 << BTN_RIGHT_PNUM);
+
+	if (buttons & AMIMOUSE_BTN_MIDDLE) DDRB |= (1 << BTN_MIDDLE_PNUM);
+	else DDRB &= ~(1 << BTN_MIDDLE_PNUM);
+}
+
+static inline void amimouse_axisTick(amimouse_axis_t *axis) {
+	if (!axis->pending) return;
+
+	axis->frac += axis->rate;
+	if (axis->frac < AMIMOUSE_PERIOD_TICKS) return;
+	axis->frac -= AMIMOUSE_PERIOD_TICKS;
+
+	if (axis->pending > 0) {
+		axis->pending--;
+		axis->phase = (axis->phase + 1) & 0x03;
+	} else {
+		axis->pending++;
+		axis->phase = (axis->phase - 1) & 0x03;
+	}
+
+	if (!axis->pending) axis->frac = 0;
+}
+
+ISR(TIMER2_COMPA_vect) { // Quadrature generator
+	amimouse_axisTick(&axis_x);
+	amimouse_axisTick(&axis_y);
+
+	PORTC = (PORTC & ~QUAD_MASK) | (quad_phase[axis_x.phase] << QUAD_X_SHIFT) | (quad_phase[axis_y.phase] << QUAD_Y_SHIFT);
+}
@@ -0,0 +1,24 @@
+#ifndef _AMIGA_MOUSE_HEADER_
+#define _AMIGA_MOUSE_HEADER_
+
+#include <stdint.h>
+
+// Quadrature signals for the Amiga mouse port, generated by Timer2:
+// H (XA) on PC2, HQ (XB) on PC3, V (YA) on PC4, VQ (YB) on PC5.
+// Buttons are open drain: left on PD4, right on PD5, middle on PB2.
+
+#define AMIMOUSE_BTN_LEFT   0x01
+#define AMIMOUSE_BTN_RIGHT  0x02
+#define AMIMOUSE_BTN_MIDDLE 0x04
+
+#define AMIMOUSE_TICK_HZ 10000UL // Quadrature generator rate: maximum steps per second on each axis
+#define AMIMOUSE_REPORT_HZ 100   // PS/2 default sample rate: movement is spread over one report period
+#define AMIMOUSE_PENDING_MAX ((int16_t)(AMIMOUSE_TICK_HZ / 8)) // Steps kept waiting on an axis, at most: 125ms behind at full speed
+
+void amimouse_init(void);
+
+// Accumulates a movement (dy positive moving up, as reported by PS/2) and updates the buttons (AMIMOUSE_BTN_*).
+// Can be called from interrupt context
+void amimouse_report(int16_t dx, int16_t dy, uint8_t buttons);
+
+#endif /* _AMIGA_MOUSE_HEADER_ */
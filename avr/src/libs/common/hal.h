@@ -0,0 +1,156 @@
+#ifndef _AKAB_HAL_HEADER_
+#define _AKAB_HAL_HEADER_
+
+// Per-MCU register and pin differences, in one place.
+// Supported: ATmega328P, ATmega8A, ATtiny4313 (and the old ATmega128 board).
+
+#include <avr/io.h>
+
+// External interrupt control, mask and flag registers (INT0: PS/2 clock, INT1: Amiga KDAT handshake)
+#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
+#define HAL_EXTINT_CTRL  EICRA
+#define HAL_EXTINT_MASK  EIMSK
+#define HAL_EXTINT_FLAGS EIFR
+#elif defined (__AVR_ATtiny4313__)
+#define HAL_EXTINT_CTRL  MCUCR
+#define HAL_EXTINT_MASK  GIMSK
+#define HAL_EXTINT_FLAGS GIFR
+#elif defined (__AVR_ATmega8A__)
+#define HAL_EXTINT_CTRL  MCUCR
+#define HAL_EXTINT_MASK  GICR
+#define HAL_EXTINT_FLAGS GIFR
+#else
+#error "Unsupported MCU"
+#endif
+
+// Pins of INT0 and INT1, both on PORTD
+#if defined (__AVR_ATmega128__)
+#define HAL_INT0_PNUM 0 // PD0
+#define HAL_INT1_PNUM 1 // PD1
+#else
+#define HAL_INT0_PNUM 2 // PD2
+#define HAL_INT1_PNUM 3 // PD3
+#endif
+
+#define HAL_INT0_FALLING() (HAL_EXTINT_CTRL = (HAL_EXTINT_CTRL & ~((1 << ISC00) | (1 << ISC01))) | (1 << ISC01))
+#define HAL_INT0_RISING()  (HAL_EXTINT_CTRL |= (1 << ISC00) | (1 << ISC01))
+#define HAL_INT0_ENABLE()  (HAL_EXTINT_MASK |= (1 << INT0))
+#define HAL_INT0_CLEAR()   (HAL_EXTINT_FLAGS = (1 << INTF0)) // Writing a one clears the flag, and only that one
+
+#define HAL_INT1_FALLING() (HAL_EXTINT_CTRL = (HAL_EXTINT_CTRL & ~((1 << ISC10) | (1 << ISC11))) | (1 << ISC11))
+#define HAL_INT1_ENABLE()   (HAL_EXTINT_MASK |= (1 << INT1))
+#define HAL_INT1_DISABLE()  (HAL_EXTINT_MASK &= ~(1 << INT1))
+#define HAL_INT1_CLEAR()    (HAL_EXTINT_FLAGS = (1 << INTF1)) // Writing a one clears the flag, and only that one
+#define HAL_INT1_IS_LOW()   (!(PIND & (1 << HAL_INT1_PNUM)))
+
+// Timer1 free running at F_CPU / TIMING_T1_PRESCALER (8), for timestamps. Same registers on every MCU.
+// With the PS/2 clock on ICP1 (AKAB_PS2_ICP), it also captures the falling edges, noise canceller on
+#if defined (AKAB_PS2_ICP)
+#define HAL_TIMEBASE_INIT() do { TCCR1A = 0; TCCR1B = (1 << ICNC1) | (1 << CS11); } while (0)
+#else
+#define HAL_TIMEBASE_INIT() do { TCCR1A = 0; TCCR1B = (1 << CS11); } while (0)
+#endif
+#define HAL_TIMEBASE()      TCNT1
+
+// Timer1 input capture pin (PORTB) and interrupt, for the PS/2 clock with AKAB_PS2_ICP.
+// Not defined where ICP1 is elsewhere (PD6 on the ATtiny4313, PD4 on the ATmega128)
+#if defined (__AVR_ATmega328P__)
+#define HAL_ICP_PNUM 0 // PB0
+#define HAL_ICP_ENABLE() (TIMSK1 |= (1 << ICIE1))
+#define HAL_ICP_CLEAR()  (TIFR1 = (1 << ICF1))
+#elif defined (__AVR_ATmega8A__)
+#define HAL_ICP_PNUM 0 // PB0
+#define HAL_ICP_ENABLE() (TIMSK |= (1 << TICIE1))
+#define HAL_ICP_CLEAR()  (TIFR = (1 << ICF1))
+#endif
+
+// Timer1 compare B interrupt: the XT frame phases (AKAB_OUTPUT_XT), OCR1B set from HAL_TIMEBASE()
+#if defined (__AVR_ATmega328P__)
+#define HAL_T1COMPB_ENABLE()  (TIMSK1 |= (1 << OCIE1B))
+#define HAL_T1COMPB_DISABLE() (TIMSK1 &= ~(1 << OCIE1B))
+#define HAL_T1COMPB_CLEAR()   (TIFR1 = (1 << OCF1B))
+#else
+#define HAL_T1COMPB_ENABLE()  (TIMSK |= (1 << OCIE1B))
+#define HAL_T1COMPB_DISABLE() (TIMSK &= ~(1 << OCIE1B))
+#define HAL_T1COMPB_CLEAR()   (TIFR = (1 << OCF1B))
+#endif
+
+// USART of the management port (AKAB_UART): RXD on PD0, TXD on PD1. 8N1 is the reset default.
+// Not defined on the ATtiny4313: no room for it in 4KB
+#if defined (__AVR_ATmega328P__)
+#define HAL_UART_STATUS  UCSR0A
+#define HAL_UART_CTRL    UCSR0B
+#define HAL_UART_UBRRH   UBRR0H
+#define HAL_UART_UBRRL   UBRR0L
+#define HAL_UART_DATA    UDR0
+#define HAL_UART_RX_vect USART_RX_vect
+#define HAL_UART_U2X     (1 << U2X0)
+#define HAL_UART_ENABLE  ((1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0)) // Receive interrupt only: sending is polled
+#define HAL_UART_READY   (1 << UDRE0)
+#define HAL_UART_ERRORS  ((1 << FE0) | (1 << DOR0))
+#elif defined (__AVR_ATmega8A__)
+#define HAL_UART_STATUS  UCSRA
+#define HAL_UART_CTRL    UCSRB
+#define HAL_UART_UBRRH   UBRRH
+#define HAL_UART_UBRRL   UBRRL
+#define HAL_UART_DATA    UDR
+#define HAL_UART_RX_vect USART_RXC_vect
+#define HAL_UART_U2X     (1 << U2X)
+#define HAL_UART_ENABLE  ((1 << RXEN) | (1 << TXEN) | (1 << RXCIE))
+#define HAL_UART_READY   (1 << UDRE)
+#define HAL_UART_ERRORS  ((1 << FE) | (1 << DOR))
+#endif
+
+// System clock prescaler, set first thing in main(): F_CPU is the oscillator divided by AKAB_CLOCK_DIV
+#ifndef AKAB_CLOCK_DIV
+#define AKAB_CLOCK_DIV 1
+#endif
+
+#if AKAB_CLOCK_DIV == 1
+#define HAL_CLOCK_INIT() do { } while (0) // Fuses already give the full oscillator speed
+#elif !defined (CLKPR)
+#error "This MCU has no clock prescaler: build with CLOCK_DIV=1"
+#else
+#include <avr/power.h>
+#if AKAB_CLOCK_DIV == 2
+#define HAL_CLOCK_INIT() clock_prescale_set(clock_div_2) // 16MHz crystal down to 8MHz
+#else
+#error "CLOCK_DIV must be 1 or 2"
+#endif
+#endif
+
+// Reset cause flags, cleared by hand: MCUCSR on the older parts
+#if defined (__AVR_ATmega8A__) || defined (__AVR_ATmega128__)
+#define HAL_RESET_FLAGS MCUCSR
+#else
+#define HAL_RESET_FLAGS MCUSR
+#endif
+
+// Variables the C startup code leaves alone: they keep their value over a watchdog reset.
+// No initializer, and meaningless after a power on
+#define HAL_NOINIT __attribute__ ((section (".noinit")))
+
+// Pull-up resistors on every pin not used by the adapter itself:
+// PB0/PB1 (Amiga KCLK or XT data, PS/2 data), PD2/PD3 (INT0, INT1) stay untouched.
+// With AKAB_PS2_ICP, PB0 and PD2 swap roles: the same pins.
+// With AKAB_UART, the USART takes PD0/PD1 (pulled up, harmless) and the Amiga reset moves to PC5
+#if defined (__AVR_ATtiny4313__)
+#define HAL_PULLUP_UNUSED() do { \
+		DDRA &= ~0x07; PORTA |= 0x07; \
+		DDRB &= 0x03; PORTB |= 0xFC; \
+		DDRD &= 0x0C; PORTD |= 0x73; \
+	} while (0)
+#elif defined (__AVR_ATmega128__)
+#define HAL_PULLUP_UNUSED() do { \
+		DDRB &= 0x03; PORTB |= 0xFC; \
+		DDRD &= 0x03; PORTD |= 0xFC; \
+	} while (0)
+#else
+#define HAL_PULLUP_UNUSED() do { \
+		DDRB &= 0x03; PORTB |= 0xFC; \
+		DDRC &= 0xC0; PORTC |= 0x3F; \
+		DDRD &= 0x0C; PORTD |= 0xF3; \
+	} while (0)
+#endif
+
+#endif /* _AKAB_HAL_HEADER_ */
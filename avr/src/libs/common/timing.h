@@ -0,0 +1,68 @@
+#ifndef _AKAB_TIMING_HEADER_
+#define _AKAB_TIMING_HEADER_
+
+// Everything timed in the firmware is derived from F_CPU at compile time: busy waits
+// go through _delay_us()/_delay_ms(), which count F_CPU cycles, and timer reload values
+// through TIMING_CTC_TOP(). The protocol limits that depend on the clock speed are
+// checked here, so a build for a clock that can't meet them fails instead of losing keys.
+//
+// F_CPU is the system clock: the oscillator divided by AKAB_CLOCK_DIV (see HAL_CLOCK_INIT()).
+// Macros below are usable in #if, so no casts.
+
+#ifndef F_CPU
+#error "F_CPU is not defined"
+#endif
+
+// The clocks the host simulations (host/, make check) run the receivers and the Amiga pacing at.
+// Any other one has only been worked out on paper: the INT0 check below is an estimate
+#if (F_CPU != 8000000UL) && (F_CPU != 16000000UL)
+#error "F_CPU must be 8MHz or 16MHz"
+#endif
+
+#define TIMING_CYCLES(us) ((us) * (F_CPU / 1000UL) / 1000UL) // CPU cycles in us microseconds, rounded down
+
+// Compare value of a timer in CTC mode interrupting hz times a second
+#define TIMING_CTC_TOP(hz, prescaler) (F_CPU / (prescaler) / (hz) - 1)
+// Nonzero if the rate is off by more than 1%
+#define TIMING_CTC_INEXACT(hz, prescaler) ((F_CPU / (prescaler) % (hz)) * 100 > (F_CPU / (prescaler)))
+
+// PS/2 device clock: 10 to 16.7kHz, so a clock phase (low or high) can be as short as 30us.
+// The INT0 handler flips its edge sense on every edge: it must get there before the
+// next edge, or that edge is lost and the frame with it.
+// With the clock on the Timer1 capture pin (AKAB_PS2_ICP), only falling edges interrupt, and the
+// hardware keeps their time: the handler still has to read the data line before the clock phase
+// is over, the same budget as below.
+#define TIMING_PS2_PHASE_MIN_US 30
+#define TIMING_PS2_PHASE_MAX_US 50
+
+// Worst case cycles from a PS/2 clock edge to the edge flip in the INT0 handler: interrupt
+// response and vector jump, the register saves of a handler that calls a function, the bit
+// sample. An estimate, with some margin; TRACE=1 shows the real handler on PC0.
+#define TIMING_INT0_EDGE_CYCLES 110
+
+// INT0 has the highest priority, so at most one other handler, already running when the
+// edge comes, can delay it. Estimated like the one above; the longest one counts.
+#if defined (AKAB_KEYB2) || defined (AKAB_MOUSE)
+#define TIMING_INT0_DELAY_CYCLES 100 // Second keyboard or mouse receiver on a pin change interrupt
+#elif defined (AKAB_UART)
+#define TIMING_INT0_DELAY_CYCLES 40 // Management port byte into its ring
+#else
+#define TIMING_INT0_DELAY_CYCLES 30 // Amiga handshake on INT1
+#endif
+
+// Timer1 runs free at F_CPU / 8 as a timestamp counter (HAL_TIMEBASE()): 1us a tick at 8MHz.
+// 16 bits wide, so differences of up to 65535 ticks
+#define TIMING_T1_PRESCALER 8
+#define TIMING_T1_TICKS(us) ((us) * (F_CPU / TIMING_T1_PRESCALER / 1000UL) / 1000UL)
+
+// USART baud rate register in double speed mode (U2X), rounded to the nearest rate,
+// and nonzero if the rate is off by more than 2%: too much for 8N1 at the other end
+#define TIMING_UART_UBRR(baud) ((F_CPU + 4UL * (baud)) / (8UL * (baud)) - 1)
+#define TIMING_UART_INEXACT(baud) (F_CPU / (8UL * (TIMING_UART_UBRR(baud) + 1)) * 50 > (baud) * 51 || \
+		F_CPU / (8UL * (TIMING_UART_UBRR(baud) + 1)) * 50 < (baud) * 49)
+
+#if TIMING_CYCLES(TIMING_PS2_PHASE_MIN_US) < (TIMING_INT0_EDGE_CYCLES + TIMING_INT0_DELAY_CYCLES)
+#error "F_CPU too low for the PS/2 clock: the INT0 handler can miss an edge (raise F_CPU or lower CLOCK_DIV)"
+#endif
+
+#endif /* _AKAB_TIMING_HEADER_ */
@@ -0,0 +1,55 @@
+#ifndef _AKAB_TRACE_HEADER_
+#define _AKAB_TRACE_HEADER_
+
+// Hot path tracing markers on spare PORTC pins, for simavr VCD traces or a logic analyzer.
+// tools/vcd_latency.py turns a capture into per-stage latency statistics.
+// Without AKAB_TRACE every marker compiles to nothing.
+
+#ifdef AKAB_TRACE
+
+#include <avr/io.h>
+
+#if defined (AKAB_MOUSE)
+#error "Tracing uses PC0-PC4, which are taken by the PS/2 mouse"
+#endif
+
+#if !defined (__AVR_ATmega328P__) && !defined (__AVR_ATmega8A__)
+#error "Tracing needs PORTC"
+#endif
+
+#define TRACE_INT0_PNUM  0 // High while in the INT0 handler
+#define TRACE_FRAME_PNUM 1 // Toggles when a valid PS/2 frame has been received
+#define TRACE_CONV_PNUM  2 // Toggles when the converter starts on a scancode sequence
+#define TRACE_TX_PNUM    3 // High while a code is clocked out to the Amiga
+#define TRACE_SYNC_PNUM  4 // Toggles when the Amiga handshake is received
+
+#define TRACE_MASK 0x1F
+
+#define TRACE_INIT() do { PORTC &= ~TRACE_MASK; DDRC |= TRACE_MASK; } while (0)
+#define TRACE_HIGH(a) (PORTC |= (1 << (a))) // Single sbi/cbi instructions
+#define TRACE_LOW(a) (PORTC &= ~(1 << (a)))
+
+#if defined (__AVR_ATmega328P__)
+#define TRACE_TOGGLE(a) (PINC = (1 << (a))) // Writing a one to PINx toggles the pin
+#else
+#define TRACE_TOGGLE(a) (PORTC ^= (1 << (a)))
+#endif
+
+#else
+
+#define TRACE_INIT() do { } while (0)
+#define TRACE_HIGH(a) do { } while (0)
+#define TRACE_LOW(a) do { } while (0)
+#define TRACE_TOGGLE(a) do { } while (0)
+
+#endif /* AKAB_TRACE */
+
+#define TRACE_INT0_ENTER()  TRACE_HIGH(TRACE_INT0_PNUM)
+#define TRACE_INT0_EXIT()   TRACE_LOW(TRACE_INT0_PNUM)
+#define TRACE_FRAME()       TRACE_TOGGLE(TRACE_FRAME_PNUM)
+#define TRACE_CONV_START()  TRACE_TOGGLE(TRACE_CONV_PNUM)
+#define TRACE_TX_START()    TRACE_HIGH(TRACE_TX_PNUM)
+#define TRACE_TX_END()      TRACE_LOW(TRACE_TX_PNUM)
+#define TRACE_SYNC()        TRACE_TOGGLE(TRACE_SYNC_PNUM)
+
+#endif /* _AKAB_TRACE_HEADER_ */
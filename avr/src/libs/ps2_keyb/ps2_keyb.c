@@ -1,5 +1,10 @@
 #include "ps2_keyb.h"
 #include "ps2_proto.h"
+#include "ps2_rx.h"
+
+#include "common/trace.h"
+#include "common/hal.h"
+#include "common/timing.h" // Checks that F_CPU keeps up with the PS/2 clock
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
@@ -12,300 +17,515 @@
 // See the following link for details on the keyboard PS/2 commands
 // http://www.computer-engineering.org/ps2keyboard/
 
-// Data port
-static volatile uint8_t *dPort, *dPin, *dDir;
-static volatile uint8_t dPNum; // Data port pin (leg) number
+static ps2_lines_t kb_lines; // Data and clock lines of the keyboard
+
+#define PS2_RTS_US   100 // Host to device: clock held low at least this long before the request to send
+#define PS2_READY_MS 15  // Host to device: pause after each byte
+#define PS2_CLOCK_MS 15  // Host to device: the device starts clocking a byte within this (and takes 2ms for it)
+#define PS2_ANSWER_MS 20 // Device to host: the answer to a command byte starts within this
+
+// Polled frames (ps2keyb_query()): a clock phase longer than a whole period means the device gave up
+#define KB_POLL_BIT_TICKS TIMING_T1_TICKS(2 * TIMING_PS2_PHASE_MAX_US)
+
+#ifdef AKAB_PS2_ICP
+#ifndef HAL_ICP_PNUM
+#error "PS2_RX=icp needs the Timer1 capture pin on PB0 (ATmega328P or ATmega8A)"
+#endif
 
-// Clock port
-static volatile uint8_t *cPort, *cPin, *cDir;
-static volatile uint8_t cPNum;
+// Falling clock edges are timestamped by the Timer1 input capture, at F_CPU / 8, and filtered
+// on the time since the last edge taken: a clock period is 60 to 100us, allowed 20% either way
+#define KB_ICP_PERIOD_MIN TIMING_T1_TICKS(2 * TIMING_PS2_PHASE_MIN_US * 4 / 5)
+#define KB_ICP_PERIOD_MAX TIMING_T1_TICKS(2 * TIMING_PS2_PHASE_MAX_US * 5 / 4)
+#define KB_ICP_PULSE_MIN  TIMING_T1_TICKS(TIMING_PS2_PHASE_MIN_US * 4 / 5) // Shorter low pulses are noise
 
+static uint16_t kb_lastEdge; // Capture time of the last edge taken
+#else
 #define KB_CLOCK_FALL 0
 #define KB_CLOCK_RISE 1
-#define PS2_START_BITCOUNT 11 // 12 bits is only for host-to-device communication
-
-#define KEY_BUF_SIZE 8
 
 static volatile uint8_t clock_edge;
-static volatile uint8_t kb_bitCount;
+#endif
+static ps2_rx_t kb_rx; // Only touched by the clock interrupt once initialized
+
+// Scancode sequence being assembled, one per keyboard
+typedef struct {
+	uint8_t code_array[9];
+	uint8_t cur;
+	uint8_t device;
+	uint16_t stamp; // Timebase at the start bit of the first frame
+} kb_assembler_t;
+
+static kb_assembler_t kb_asm[PS2KEYB_DEVICES];
+static uint16_t cb_stamp; // Of the sequence in the callback
+static uint16_t kb_frames, kb_frameErrors; // Updated in the clock interrupts
+
+#ifdef AKAB_KEYB2
+#if !defined (__AVR_ATmega328P__)
+#error "The second keyboard needs pin change interrupts on PORTD (ATmega328P only)"
+#endif
 
-static volatile uint8_t keyBuffer[KEY_BUF_SIZE];
-static volatile uint8_t *kb_inPtr, *kb_outPtr, *kb_endPtr;
+#define KB2_CLK_PNUM  7 // PD7 - PCINT23
+#define KB2_DATA_PNUM 6 // PD6
 
-#define KB_START_BIT(a) ((a >> 0) & 0x01)
-#define KB_PARITY_BIT(a) ((a >> 1) & 0x01)
-#define KB_STOP_BIT(a) ((a >> 2) & 0x01)
+static const ps2_lines_t kb2_lines = {
+	&PORTD, &DDRD, &PIND, KB2_DATA_PNUM,
+	&PORTD, &DDRD, &PIND, KB2_CLK_PNUM
+};
 
-#define KB_SET_START_BIT(a, b) (a |= (b << 0))
-#define KB_SET_PARITY_BIT(a, b) (a |= (b << 1))
-#define KB_SET_STOP_BIT(a, b) (a |= (b << 2))
+static ps2_rx_t kb2_rx; // Only touched by PCINT2 once initialized
+static uint8_t kb2_clkLevel; // Last clock level seen: the other PORTD pins may fire the interrupt too
+static uint8_t kb2_ready = 0;
+#endif
 
-void ps2_dumb_print(uint8_t *code, uint8_t count);
+void ps2_dumb_print(uint8_t device, uint8_t *code, uint8_t count);
 
-void static (*keypress_callback)(uint8_t *code, uint8_t count) = ps2_dumb_print;
-static volatile uint8_t kb_data, kb_flag;
+void static (*keypress_callback)(uint8_t device, uint8_t *code, uint8_t count) = ps2_dumb_print;
 
-int kb_parity_check(uint8_t kb_flag_i, uint8_t kb_data_i);
-void kb_pushScancode(uint8_t code);
+void kb_pushScancode(kb_assembler_t *kb, uint8_t code);
+static inline void kb_clearSequence(kb_assembler_t *kb);
 
-void ps2_dumb_print(uint8_t *code, uint8_t count) {
+void ps2_dumb_print(uint8_t device, uint8_t *code, uint8_t count) {
 	//printf("%.2X %.2X %.2X\n", code[0], code[1], code[2]);
 }
 
-int kb_parity_check(uint8_t kb_flag_i, uint8_t kb_data_i) {
-	uint8_t result = 1;
-	uint8_t counter = 8;
-
-	while (counter--) {
-		result = kb_data_i & 0x1 ? !result : result;
-		kb_data_i >>= 1;
-	}
-
-	return (result == KB_PARITY_BIT(kb_flag_i));
-}
-
 // See http://avrprogrammers.com/example_avr_keyboard.php
 // http://elecrom.wordpress.com/2008/02/12/avr-tutorial-2-avr-input-output/
 void ps2keyb_init(volatile uint8_t *dataPort, volatile uint8_t *dataDir, volatile uint8_t *dataPin, uint8_t pNum) {
-	dPort = dataPort;
-	dPin = dataPin;
-	dDir = dataDir;
-	dPNum = pNum;
-
-	cPort = &PORTD;
-	cPin = &PIND;
-	cDir = &DDRD;
-#if defined (__AVR_ATmega128__)
-	cPNum = 0; // PD0
-#elif defined (__AVR_ATtiny4313__) || defined (__AVR_ATmega328P__) || defined (__AVR_ATmega8A__)
-	cPNum = 2; // PD2
+	kb_lines.dPort = dataPort;
+	kb_lines.dPin = dataPin;
+	kb_lines.dDir = dataDir;
+	kb_lines.dPNum = pNum;
+
+#ifdef AKAB_PS2_ICP
+	kb_lines.cPort = &PORTB;
+	kb_lines.cPin = &PINB;
+	kb_lines.cDir = &DDRB;
+	kb_lines.cPNum = HAL_ICP_PNUM;
+#else
+	kb_lines.cPort = &PORTD;
+	kb_lines.cPin = &PIND;
+	kb_lines.cDir = &DDRD;
+	kb_lines.cPNum = HAL_INT0_PNUM;
 #endif
 
 	// Prepare data port
-	*dDir &= ~(1 << dPNum); // KB Data line set as input
-	*dPort |= (1 << dPNum); // Pull-up resistor on data line
+	*kb_lines.dDir &= ~(1 << kb_lines.dPNum); // KB Data line set as input
+	*kb_lines.dPort |= (1 << kb_lines.dPNum); // Pull-up resistor on data line
 
 	// Prepare clock port
-	*cDir &= ~(1 << cPNum); // KB Clock line set as input
-	*cPort |= (1 << cPNum); // Pull-up resistor on clock line
+	*kb_lines.cDir &= ~(1 << kb_lines.cPNum); // KB Clock line set as input
+	*kb_lines.cPort |= (1 << kb_lines.cPNum); // Pull-up resistor on clock line
+
+	HAL_TIMEBASE_INIT(); // Sequence timestamps. Shared with the output backend, which sets it up the same way
 
+	kb_frames = kb_frameErrors = 0;
+
+#ifdef AKAB_PS2_ICP
+	ps2rx_reset(&kb_rx);
+#else
 	// See http://www.avr-tutorials.com/interrupts/The-AVR-8-Bits-Microcontrollers-External-Interrupts
 	// And http://www.atmel.com/images/doc2543.pdf
 
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-	EICRA &= ~((1 << ISC00) | (1 << ISC01)); 
-	EICRA |= (1 << ISC01);  // Trigger interrupt at FALLING EDGE (INT0)
-	EIMSK |= (1 << INT0);
-#elif defined (__AVR_ATtiny4313__) || defined (__AVR_ATmega8A__)
-	MCUCR &= ~((1 << ISC00) | (1 << ISC01)); 
-	MCUCR |= (1 << ISC01);  // Trigger interrupt at FALLING EDGE (INT0)
-#endif
+	HAL_INT0_FALLING(); // Trigger interrupt at FALLING EDGE (INT0)
 
 	// I suspect this to be totally useless...
 	//PCMSK |= (1<<PIND2);	// Enable pin change on INT0 (why is this required?)
 
 	clock_edge = KB_CLOCK_FALL;
-	kb_bitCount = PS2_START_BITCOUNT;
-
-	kb_data = 0;
-	kb_flag = 0;
-
-	// Prepare the ring buffer...
-	kb_inPtr = kb_outPtr = keyBuffer;
-	kb_endPtr = kb_inPtr + KEY_BUF_SIZE;
-
-	// Enable INT0
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-	EIMSK |= (1 << INT0);
-#elif defined (__AVR_ATtiny4313__)
-	GIMSK |= (1 << INT0);
-#elif defined (__AVR_ATmega8A__)
-	GICR  |= (1 << INT0); // Enable INT1
+	ps2rx_reset(&kb_rx);
+#endif
+
+	for (uint8_t idx = 0; idx < PS2KEYB_DEVICES; idx++) {
+		kb_clearSequence(&kb_asm[idx]);
+		kb_asm[idx].device = idx;
+	}
+
+#ifdef AKAB_PS2_ICP
+	HAL_ICP_CLEAR();
+	HAL_ICP_ENABLE();
+#else
+	HAL_INT0_ENABLE();
 #endif
 }
 
-void kb_pushScancode(uint8_t code) {
-	static uint8_t code_array[9];
-	static uint8_t cur = 0;
+static inline void kb_clearSequence(kb_assembler_t *kb) {
+	uint8_t *code_array = kb->code_array;
+
+	kb->cur = 0;
+	code_array[0] = code_array[1] = code_array[2] = 0;
+	code_array[3] = code_array[4] = code_array[5] = 0;
+	code_array[6] = code_array[7] = code_array[8] = 0;
+}
 
-	code_array[cur] = code;
+void kb_pushScancode(kb_assembler_t *kb, uint8_t code) {
+	uint8_t *code_array = kb->code_array;
+
+	// No valid sequence is longer than Pause (8 codes): prefixes that never end are noise, start over
+	if (kb->cur >= sizeof(kb->code_array)) kb_clearSequence(kb);
+
+	code_array[kb->cur] = code;
 
 	switch (code) {
 		case PS2_SCANCODE_RELEASE: // Key released, expect at least another code!
 		case PS2_SCANCODE_EXTENDED: // Extended scancode, one or two more!
 		case PS2_SCANCODE_PAUSE: // Pause ...
-			cur++;
+			kb->cur++;
 			break;
 		default:
-			// Manage pause and printscreen
-			if (((code_array[0] == PS2_SCANCODE_EXTENDED) && (code_array[1] == 0x12) && (code_array[3] != 0x7C)) ||
-				((code_array[0] == PS2_SCANCODE_EXTENDED) && (code_array[1] == 0xF0) && (code_array[2] == 0x7C) && (code_array[5] != 0x12)) ||
-				(code_array[0] == PS2_SCANCODE_PAUSE && cur < 7)) {
-				cur++;
+			// Pause has no break code and comes as one 8 byte sequence. The fake shifts around
+			// Print Screen and around the navigation keys with Num Lock on (E0 12, E0 F0 12)
+			// are sequences of their own, which no table maps
+			if (code_array[0] == PS2_SCANCODE_PAUSE && kb->cur < 7) {
+				kb->cur++;
 				break;
 			}
 
-			(*keypress_callback)(code_array, cur);
+			cb_stamp = kb->stamp;
+			(*keypress_callback)(kb->device, code_array, kb->cur);
 
-			cur = 0;
-			code_array[0] = code_array[1] = code_array[2] = 0;
-			code_array[3] = code_array[4] = code_array[5] = 0;
-			code_array[6] = code_array[7] = code_array[8] = 0;
+			kb_clearSequence(kb);
 
 			break;
 	}
 }
 
-void ps2keyb_setCallback(void (*callback)(uint8_t *code, uint8_t count)) {
+void ps2keyb_setCallback(void (*callback)(uint8_t device, uint8_t *code, uint8_t count)) {
 	keypress_callback = callback;
 }
 
+uint16_t ps2keyb_seqStamp(void) {
+	return cb_stamp;
+}
+
+void ps2keyb_frameCounts(uint16_t *frames, uint16_t *errors) {
+	uint8_t sreg = SREG;
+
+	cli();
+	*frames = kb_frames;
+	*errors = kb_frameErrors;
+	SREG = sreg;
+}
+
 // See http://www.avrfreaks.net/index.php?name=PNphpBB2&file=viewtopic&t=134386
 void ps2keyb_sendCommand(uint8_t *command, uint8_t length) {
-	uint8_t cur_data = 0;
+	ps2keyb_sendCommandTo(&kb_lines, command, length);
+
+#ifdef AKAB_PS2_ICP
+	// Our own clocking was captured too: start from a clean receiver state
+	uint8_t icp_sreg = SREG;
+	cli();
+	HAL_ICP_CLEAR();
+	ps2rx_reset(&kb_rx);
+	SREG = icp_sreg;
+#endif
+
+#ifdef AKAB_KEYB2
+	if (!kb2_ready) return;
+
+	ps2keyb_sendCommandTo(&kb2_lines, command, length);
+
+	// Our own clocking toggled the pin: start from a clean receiver state
+	uint8_t sreg = SREG;
+	cli();
+	PCIFR = (1 << PCIF2);
+	ps2rx_reset(&kb2_rx);
+	kb2_clkLevel = 1;
+	SREG = sreg;
+#endif
+}
+
+// Waits for the pin of mask to go high (or low), for up to ticks of HAL_TIMEBASE() (0: for as long as it takes).
+// Returns 0 if it did not
+static uint8_t kb_wait(volatile uint8_t *pin, uint8_t mask, uint8_t high, uint32_t ticks) {
+	uint16_t last = HAL_TIMEBASE(), now;
+	uint32_t elapsed = 0;
+
+	while ((*pin & mask) ? !high : high) {
+		if (!ticks) continue;
+
+		now = HAL_TIMEBASE();
+		elapsed += (uint16_t)(now - last);
+		last = now;
+		if (elapsed >= ticks) return 0;
+	}
+
+	return 1;
+}
+
+// One host-to-device byte. Every clock edge is waited for up to ticks (0: as long as it takes).
+// Returns 0 if the device stopped clocking: the lines are let go, the byte is lost
+static uint8_t kb_sendByte(const ps2_lines_t *lines, uint8_t cur_data, uint32_t ticks) {
 	uint8_t parity_check;
+	uint8_t sent = 0;
 
-	// Send host-to-device command...
+	// Bring the clock line LOW for at least PS2_RTS_US microseconds
+	*lines->cDir |= (1 << lines->cPNum); // KB Clock line set as output
+	*lines->dDir |= (1 << lines->dPNum); // KB Data line set as output
 
-	cli(); // Disable all interrupts in preparation to command sending
+	*lines->cPort &= ~(1 << lines->cPNum); // bring clock line LOW
+	_delay_us(PS2_RTS_US);
 
-	// Iterate over all the data bytes we have to send
-	for (uint8_t idx = 0; idx < length; idx++) {
-		// Bring the clock line LOW for at least 100 microseconds
-		*cDir |= (1 << cPNum); // KB Clock line set as output
-		*dDir |= (1 << dPNum); // KB Data line set as output
-
-		*cPort &= ~(1 << cPNum); // bring clock line LOW
-		_delay_us(100);
-
-		// Apply a request-to-send by bringing data line low
-		*dPort &= ~(1 << dPNum); // Bring data line LOW
-
-		// Release the clock port (set it to floating and give control back)
-		*cDir &= ~(1 << cPNum); // KB Clock line set as input
-		*cPort |= (1 << cPNum); // Pull-up resistor on clock line
-
-		// And wait for the device to bring clock line LOW
-		while (*cPin & (1 << cPNum));
-
-		// Now begin send the data bits...
-		cur_data = command[idx];
-		parity_check = 1;
-		for (uint8_t bit_idx = 0; bit_idx < 8; bit_idx++) {
-			if (cur_data & 0x01) {  // Set the line to floating with pullup
-				*dDir &= ~(1 << dPNum); // KB Data line set as input
-				*dPort |= (1 << dPNum); // Pull-up resistor on data line
-
-				if (!parity_check) parity_check = 1;
-				else parity_check = 0;
-			} else {
-				*dDir |= (1 << dPNum); // KB Data line set as output
-				*dPort &= ~(1 << dPNum); // Force it low
-			}
+	// Apply a request-to-send by bringing data line low
+	*lines->dPort &= ~(1 << lines->dPNum); // Bring data line LOW
 
-			cur_data >>= 1;
-			
-			// Wait for the device to bring the clock high and then low
-			while (!(*cPin & (1 << cPNum)));
-			while (*cPin & (1 << cPNum));
-		}
+	// Release the clock port (set it to floating and give control back)
+	*lines->cDir &= ~(1 << lines->cPNum); // KB Clock line set as input
+	*lines->cPort |= (1 << lines->cPNum); // Pull-up resistor on clock line
+
+	// And wait for the device to bring clock line LOW
+	if (!kb_wait(lines->cPin, 1 << lines->cPNum, 0, ticks)) goto release;
 
-		// Send the parity bit
-		if (parity_check) {
-			*dDir &= ~(1 << dPNum); // Force the line as floating again
-			*dPort |= (1 << dPNum); // Pull-up resistor on data line
+	// Now begin send the data bits...
+	parity_check = 1;
+	for (uint8_t bit_idx = 0; bit_idx < 8; bit_idx++) {
+		if (cur_data & 0x01) {  // Set the line to floating with pullup
+			*lines->dDir &= ~(1 << lines->dPNum); // KB Data line set as input
+			*lines->dPort |= (1 << lines->dPNum); // Pull-up resistor on data line
+
+			if (!parity_check) parity_check = 1;
+			else parity_check = 0;
 		} else {
-			*dDir |= (1 << dPNum); // KB Data line set as output
-			*dPort &= ~(1 << dPNum); // And force it low
+			*lines->dDir |= (1 << lines->dPNum); // KB Data line set as output
+			*lines->dPort &= ~(1 << lines->dPNum); // Force it low
 		}
-		// Wait for the device to bring the clock high and then low
-		while (!(*cPin & (1 << cPNum)));
-		while (*cPin & (1 << cPNum));
 
-		// Parity sent, now set the data high (floating)
-		*dDir &= ~(1 << dPNum); // KB Data line set as input
-		*dPort |= (1 << dPNum); // Pull-up resistor on data line
+		cur_data >>= 1;
 		
 		// Wait for the device to bring the clock high and then low
-		while (!(*cPin & (1 << cPNum)));
-		while (*cPin & (1 << cPNum));
-		
-		// Set the data line low
-		*dDir |= (1 << dPNum); // KB Data line set as output
-		*dPort &= ~(1 << dPNum); // Pull the line low
-		
-		*dDir &= ~(1 << dPNum); // KB Data line set as input
-		
-		// Wait for clock line to get high
-		while (!(*cPin & (1 << cPNum)));
-		while (*cPin & (1 << cPNum)); // Then low
-		while (!(*cPin & (1 << cPNum))); // Then high
-
-		// Wait for the data line to get high
-		while (!(*dPin & (1 << dPNum)));
-
-		_delay_ms(15); // Wait for the device to be ready again
+		if (!kb_wait(lines->cPin, 1 << lines->cPNum, 1, ticks)) goto release;
+		if (!kb_wait(lines->cPin, 1 << lines->cPNum, 0, ticks)) goto release;
 	}
 
+	// Send the parity bit
+	if (parity_check) {
+		*lines->dDir &= ~(1 << lines->dPNum); // Force the line as floating again
+		*lines->dPort |= (1 << lines->dPNum); // Pull-up resistor on data line
+	} else {
+		*lines->dDir |= (1 << lines->dPNum); // KB Data line set as output
+		*lines->dPort &= ~(1 << lines->dPNum); // And force it low
+	}
+	// Wait for the device to bring the clock high and then low
+	if (!kb_wait(lines->cPin, 1 << lines->cPNum, 1, ticks)) goto release;
+	if (!kb_wait(lines->cPin, 1 << lines->cPNum, 0, ticks)) goto release;
+
+	// Parity sent, now set the data high (floating)
+	*lines->dDir &= ~(1 << lines->dPNum); // KB Data line set as input
+	*lines->dPort |= (1 << lines->dPNum); // Pull-up resistor on data line
+	
+	// Wait for the device to bring the clock high and then low
+	if (!kb_wait(lines->cPin, 1 << lines->cPNum, 1, ticks)) goto release;
+	if (!kb_wait(lines->cPin, 1 << lines->cPNum, 0, ticks)) goto release;
+	
+	// Set the data line low
+	*lines->dDir |= (1 << lines->dPNum); // KB Data line set as output
+	*lines->dPort &= ~(1 << lines->dPNum); // Pull the line low
+	
+	*lines->dDir &= ~(1 << lines->dPNum); // KB Data line set as input
+	
+	// Wait for clock line to get high
+	if (!kb_wait(lines->cPin, 1 << lines->cPNum, 1, ticks)) goto release;
+	if (!kb_wait(lines->cPin, 1 << lines->cPNum, 0, ticks)) goto release; // Then low
+	if (!kb_wait(lines->cPin, 1 << lines->cPNum, 1, ticks)) goto release; // Then high
+
+	// Wait for the data line to get high
+	sent = kb_wait(lines->dPin, 1 << lines->dPNum, 1, ticks);
+
+release:
 	// Prepare data port
-	*dDir &= ~(1 << dPNum); // KB Data line set as input
-	*dPort |= (1 << dPNum); // Pull-up resistor on data line
+	*lines->dDir &= ~(1 << lines->dPNum); // KB Data line set as input
+	*lines->dPort |= (1 << lines->dPNum); // Pull-up resistor on data line
 
 	// Prepare clock port
-	*cDir &= ~(1 << cPNum); // KB Clock line set as input
-	*cPort |= (1 << cPNum); // Pull-up resistor on clock line
+	*lines->cDir &= ~(1 << lines->cPNum); // KB Clock line set as input
+	*lines->cPort |= (1 << lines->cPNum); // Pull-up resistor on clock line
 
-	sei();
+	return sent;
 }
 
-ISR(INT0_vect) { // Manage INT0
-	uint8_t kBit = 0;
+void ps2keyb_sendCommandTo(const ps2_lines_t *lines, uint8_t *command, uint8_t length) {
+	uint8_t sreg = SREG;
 
-	if (clock_edge == KB_CLOCK_FALL) { // Falling edge
-		kBit = (*dPin & (1 << dPNum)) ? 1 : 0;
-
-		// bit 0 is start bit, bit 9,10 are parity and stop bits
-		// What is left are the data bits!
-		if (kb_bitCount < 11 && kb_bitCount > 2) { 
-			kb_data >>= 1; // Shift the data
-
-			if (kBit) kb_data |= 0x80; // Add a bit if the read data is one
-		} else if (kb_bitCount == 11) { // start bit, must always be 0!
-			KB_SET_START_BIT(kb_flag, kBit);
-		} else if (kb_bitCount == 2) { // Parity bit: 1 if there is an even number of 1s in the data bits
-			KB_SET_PARITY_BIT(kb_flag, kBit);			
-		} else if (kb_bitCount == 1) { // Stop bit, must always be 1!
-			KB_SET_STOP_BIT(kb_flag, kBit);	
+	// Send host-to-device command...
+
+	cli(); // Disable all interrupts in preparation to command sending
+
+	// Iterate over all the data bytes we have to send. A device that stops clocking (unplugged, hung)
+	// loses the byte instead of holding the main loop, with interrupts off, until the watchdog bites
+	for (uint8_t idx = 0; idx < length; idx++) {
+		kb_sendByte(lines, command[idx], TIMING_T1_TICKS(PS2_CLOCK_MS * 1000UL));
+
+		_delay_ms(PS2_READY_MS); // Wait for the device to be ready again
+	}
+
+	SREG = sreg; // Do not re-enable interrupts when called from a handler
+}
+
+// One device-to-host frame, read by polling the lines: the start bit within ticks, the other
+// bits each within KB_POLL_BIT_TICKS of the last. Returns 0 on a timeout or a bad frame
+static uint8_t kb_readByte(const ps2_lines_t *lines, uint8_t *value, uint32_t ticks) {
+	ps2_rx_t rx;
+
+	ps2rx_reset(&rx);
+
+	for (uint8_t bit = PS2_START_BITCOUNT; bit; bit--) {
+		if (!kb_wait(lines->cPin, 1 << lines->cPNum, 0, bit == PS2_START_BITCOUNT ? ticks : KB_POLL_BIT_TICKS)) return 0;
+		ps2rx_sample(&rx, (*lines->dPin & (1 << lines->dPNum)) ? 1 : 0);
+		if (!kb_wait(lines->cPin, 1 << lines->cPNum, 1, KB_POLL_BIT_TICKS)) return 0;
+
+		if (ps2rx_clock(&rx)) {
+			*value = rx.data;
+			return 1;
 		}
-		clock_edge = KB_CLOCK_RISE;			// Ready for rising edge.
+	}
 
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-		EICRA |= ((1 << ISC00) | (1 << ISC01)); // Setup INT0 for rising edge.
-#elif defined (__AVR_ATtiny4313__) || defined (__AVR_ATmega8A__)
-		MCUCR |= ((1 << ISC00) | (1 << ISC01)); // Setup INT0 for rising edge.
+	return 0; // The frame ended, not valid
+}
+
+// After polling: the receiver interrupt saw those frames too, start it from a clean state
+static void kb_restartReceiver(void) {
+#if defined (AKAB_PS2_ICP)
+	HAL_ICP_CLEAR();
+	ps2rx_reset(&kb_rx);
+#else
+	HAL_INT0_FALLING();
+	HAL_INT0_CLEAR();
+	clock_edge = KB_CLOCK_FALL;
+	ps2rx_reset(&kb_rx);
 #endif
-	} else { // Rising edge
-		if(!(--kb_bitCount)) {
-			if (!KB_START_BIT(kb_flag) && KB_STOP_BIT(kb_flag) && kb_parity_check(kb_flag, kb_data)) {
-				kb_pushScancode(kb_data);
-			} // Else... there was a problem somewhere, probably timing
+	kb_clearSequence(&kb_asm[0]);
+}
+
+uint8_t ps2keyb_query(const uint8_t *command, uint8_t length, uint8_t *reply, uint8_t replyLength) {
+	uint8_t sreg = SREG;
+	uint8_t count = 0, answer;
 
-			kb_data = 0;
-			kb_flag = 0;
+	cli();
 
-			kb_bitCount = PS2_START_BITCOUNT; // Start over.
+	for (uint8_t idx = 0; idx < length; idx++) {
+		if (!kb_sendByte(&kb_lines, command[idx], TIMING_T1_TICKS(PS2_CLOCK_MS * 1000UL)) ||
+				!kb_readByte(&kb_lines, &answer, TIMING_T1_TICKS(PS2_ANSWER_MS * 1000UL)) || answer != PS2_SCANCODE_ACK) {
+			count = PS2KEYB_NOACK;
+			break;
 		}
+	}
+
+	while (count < replyLength && kb_readByte(&kb_lines, &reply[count], TIMING_T1_TICKS(PS2_ANSWER_MS * 1000UL))) count++;
+
+	kb_restartReceiver();
+	SREG = sreg;
+
+	return count;
+}
+
+uint8_t ps2keyb_readByte(uint8_t *value, uint8_t timeout_ms) {
+	uint8_t sreg = SREG;
+	uint8_t done;
+
+	cli();
+	done = kb_readByte(&kb_lines, value, TIMING_T1_TICKS(timeout_ms * 1000UL));
+	kb_restartReceiver();
+	SREG = sreg;
+
+	return done;
+}
+
+#ifdef AKAB_PS2_ICP
+ISR(TIMER1_CAPT_vect) { // Falling edge of the keyboard clock, captured
+	uint16_t stamp = ICR1;
+	uint8_t bit = (*kb_lines.dPin & (1 << kb_lines.dPNum)) ? 1 : 0; // Steady while the clock is low
+
+	TRACE_INT0_ENTER(); // Same marker as the INT0 receiver
+
+	// The clock is up again, and was low for less than a phase: a glitch, not a bit.
+	// If this handler comes late the pulse looks long, and the edge is taken
+	if ((*kb_lines.cPin & (1 << kb_lines.cPNum)) && (uint16_t)(HAL_TIMEBASE() - stamp) < KB_ICP_PULSE_MIN) {
+		TRACE_INT0_EXIT();
+		return;
+	}
+
+	if (kb_rx.bitCount != PS2_START_BITCOUNT) {
+		if ((uint16_t)(stamp - kb_lastEdge) < KB_ICP_PERIOD_MIN) { // Too soon after the last bit: spurious edge
+			TRACE_INT0_EXIT();
+			return;
+		}
+		// Too late: the frame lost a clock pulse, or the keyboard gave up on it. This edge starts a new one
+		if ((uint16_t)(stamp - kb_lastEdge) > KB_ICP_PERIOD_MAX) ps2rx_reset(&kb_rx);
+	}
+	kb_lastEdge = stamp;
+
+	if (kb_rx.bitCount == PS2_START_BITCOUNT && !kb_asm[0].cur) kb_asm[0].stamp = stamp;
+
+	// The whole bit at once: the frame ends on the falling edge of the stop bit
+	ps2rx_sample(&kb_rx, bit);
+	if (ps2rx_clock(&kb_rx)) {
+		TRACE_FRAME();
+		kb_frames++;
+		kb_pushScancode(&kb_asm[0], kb_rx.data);
+	} else if (kb_rx.bitCount == PS2_START_BITCOUNT) { // Frame over, and not valid
+		kb_frameErrors++;
+	}
+
+	TRACE_INT0_EXIT();
+}
+#else
+ISR(INT0_vect) { // Manage INT0
+	TRACE_INT0_ENTER();
+
+	if (clock_edge == KB_CLOCK_FALL) { // Falling edge
+		if (kb_rx.bitCount == PS2_START_BITCOUNT && !kb_asm[0].cur) kb_asm[0].stamp = HAL_TIMEBASE();
+		ps2rx_sample(&kb_rx, (*kb_lines.dPin & (1 << kb_lines.dPNum)) ? 1 : 0);
+
+		clock_edge = KB_CLOCK_RISE;			// Ready for rising edge.
+
+		HAL_INT0_RISING(); // Setup INT0 for rising edge.
+	} else { // Rising edge
+		if (ps2rx_clock(&kb_rx)) {
+			TRACE_FRAME();
+			kb_frames++;
+			kb_pushScancode(&kb_asm[0], kb_rx.data);
+		} else if (kb_rx.bitCount == PS2_START_BITCOUNT) { // Frame over, and not valid
+			kb_frameErrors++;
+		}
+
 		clock_edge = KB_CLOCK_FALL;		// Setup routine the next falling edge.
 
-#if defined (__AVR_ATmega128__) || defined (__AVR_ATmega328P__)
-		EICRA &= ~((1 << ISC00) | (1 << ISC01)); 
-		EICRA |= (1 << ISC01);  // Trigger interrupt at FALLING EDGE (INT0)
-#elif defined (__AVR_ATtiny4313__) || defined (__AVR_ATmega8A__)
-		MCUCR &= ~((1 << ISC00) | (1 << ISC01)); 
-		MCUCR |= (1 << ISC01);  // Trigger interrupt at FALLING EDGE (INT0)
-#endif
+		HAL_INT0_FALLING(); // Trigger interrupt at FALLING EDGE (INT0)
 	}
+
+	TRACE_INT0_EXIT();
 }
+#endif
 
+#ifdef AKAB_KEYB2
+void ps2keyb_initSecond(void) {
+	// Clock and data as inputs with pull-ups
+	DDRD &= ~((1 << KB2_CLK_PNUM) | (1 << KB2_DATA_PNUM));
+	PORTD |= (1 << KB2_CLK_PNUM) | (1 << KB2_DATA_PNUM);
 
+	ps2rx_reset(&kb2_rx);
+	kb2_clkLevel = 1;
+	kb2_ready = 1;
+
+	PCMSK2 |= (1 << PCINT23);
+	PCIFR = (1 << PCIF2); // Clear any pending flag
+	PCICR |= (1 << PCIE2);
+}
 
+ISR(PCINT2_vect) { // Second keyboard clock changed
+	uint8_t clk = (PIND & (1 << KB2_CLK_PNUM)) ? 1 : 0;
+
+	if (clk == kb2_clkLevel) return; // Not our pin
+	kb2_clkLevel = clk;
+
+	if (!clk) { // Falling edge
+		if (kb2_rx.bitCount == PS2_START_BITCOUNT && !kb_asm[1].cur) kb_asm[1].stamp = HAL_TIMEBASE();
+		ps2rx_sample(&kb2_rx, (PIND & (1 << KB2_DATA_PNUM)) ? 1 : 0);
+	} else if (ps2rx_clock(&kb2_rx)) { // Rising edge
+		TRACE_FRAME();
+		kb_frames++;
+		kb_pushScancode(&kb_asm[1], kb2_rx.data);
+	} else if (kb2_rx.bitCount == PS2_START_BITCOUNT) {
+		kb_frameErrors++;
+	}
+}
+#endif
@@ -3,11 +3,50 @@
 
 #include <stdint.h>
 
+// Lines of a PS/2 device, as used when sending host-to-device commands
+typedef struct {
+	volatile uint8_t *dPort, *dDir, *dPin;
+	uint8_t dPNum; // Data port pin (leg) number
+	volatile uint8_t *cPort, *cDir, *cPin;
+	uint8_t cPNum; // Clock port pin number
+} ps2_lines_t;
+
+#ifdef AKAB_KEYB2
+#define PS2KEYB_DEVICES 2 // Second keyboard on a pin change interrupt: clock on PD7 (PCINT23), data on PD6
+#else
+#define PS2KEYB_DEVICES 1
+#endif
+
 // Clock port MUST be the one corresponding to INT0 !
+// (With AKAB_PS2_ICP, the Timer1 input capture pin ICP1 instead: PB0)
 
-// Data port can be set at will
+// Data port can be set at will. Also starts the Timer1 timebase (HAL_TIMEBASE_INIT())
 void ps2keyb_init(volatile uint8_t *dataPort, volatile uint8_t *dataDir, volatile uint8_t *dataPin, uint8_t pNum);
-void ps2keyb_setCallback(void (*callback)(uint8_t *code, uint8_t count));
+void ps2keyb_setCallback(void (*callback)(uint8_t device, uint8_t *code, uint8_t count)); // device is 0 for the INT0 keyboard
+// From the callback: HAL_TIMEBASE() at the start bit of the sequence's first frame.
+// With AKAB_PS2_ICP, the time the hardware captured the clock edge, whatever the interrupt load
+uint16_t ps2keyb_seqStamp(void);
+// Frames received since ps2keyb_init(), on every keyboard: valid ones, and those with a bad start,
+// stop or parity bit. Both wrap around at 65535
+void ps2keyb_frameCounts(uint16_t *frames, uint16_t *errors);
+// Sent to every keyboard. Leaves the interrupt flag as it found it. A byte the keyboard does not clock
+// within 15ms (PS2_CLOCK_MS) of the request, or between two of its clock edges, is lost
 void ps2keyb_sendCommand(uint8_t *command, uint8_t length);
 
+// Polled exchanges with the first keyboard, interrupts off throughout: for the start up, before sei().
+// ps2keyb_query() sends each command byte as soon as the last one is acknowledged (no PS2_READY_MS pause),
+// then reads up to replyLength more bytes. Returns how many it read, or PS2KEYB_NOACK if the keyboard
+// did not clock a byte in within 15ms, or did not answer it with an ACK within 20ms (e.g. a resend, or 0xAA
+// at the end of its power on self test). The receiver starts over afterwards, whatever it saw meanwhile
+#define PS2KEYB_NOACK 0xFF
+uint8_t ps2keyb_query(const uint8_t *command, uint8_t length, uint8_t *reply, uint8_t replyLength);
+uint8_t ps2keyb_readByte(uint8_t *value, uint8_t timeout_ms); // One byte within timeout_ms, 0 if none (e.g. the 0xAA of a reset)
+
+#ifdef AKAB_KEYB2
+void ps2keyb_initSecond(void); // ATmega328P only
+#endif
+
+// Same as above, for any other PS/2 device (e.g. a mouse on a pin change interrupt)
+void ps2keyb_sendCommandTo(const ps2_lines_t *lines, uint8_t *command, uint8_t length);
+
 #endif /* _AVR_PS2_KEYB_HEADER_ */
@@ -6,8 +6,16 @@
 #define PS2_SCANCODE_EXTENDED 0xE0
 #define PS2_SCANCODE_PAUSE 0xE1
 #define PS2_SCANCODE_ACK 0xFA
+#define PS2_SCANCODE_RESEND 0xFE
+#define PS2_SCANCODE_BAT_OK 0xAA // Self test passed, after a power on or PS2_HTD_RESET
+#define PS2_SCANCODE_OVERRUN 0x00 // Keyboard buffer overrun, or key detection error: keystrokes were lost
+#define PS2_SCANCODE_OVERRUN_SET1 0xFF // The same in scancode set 1, which some set 2 keyboards send too
 
 #define PS2_HTD_LEDCONTROL 0xED
+#define PS2_HTD_SCANCODESET 0xF0 // Then 1, 2 or 3 to select one, or 0 to ask which (a byte of answer)
+#define PS2_HTD_READID 0xF2 // Answered with 0 to 2 bytes: none on an AT keyboard, AB 83 on most MF2 ones
+#define PS2_HTD_TYPEMATIC 0xF3 // Then the rate (bits 0-4, 30 to 2 per second) and delay (bits 5-6, 250 to 1000ms)
+#define PS2_HTD_ENABLE 0xF4
 #define PS2_HTD_ALLKEYSMAKEBREAK 0xF8
 #define PS2_HTD_RESET 0xFF
 
@@ -0,0 +1,76 @@
+#ifndef _PS2_RX_HEADER_
+#define _PS2_RX_HEADER_
+
+#include <stdint.h>
+
+// Device-to-host frame receiver, shared by every PS/2 input channel
+// (the keyboard on INT0 and the devices on pin change interrupts).
+// Everything is inlined in the interrupt handlers.
+
+#define PS2_START_BITCOUNT 11 // 12 bits is only for host-to-device communication
+
+typedef struct {
+	uint8_t bitCount;
+	uint8_t data;
+	uint8_t flag;
+} ps2_rx_t;
+
+#define PS2RX_START_BIT(a) ((a >> 0) & 0x01)
+#define PS2RX_PARITY_BIT(a) ((a >> 1) & 0x01)
+#define PS2RX_STOP_BIT(a) ((a >> 2) & 0x01)
+
+#define PS2RX_SET_START_BIT(a, b) (a |= (b << 0))
+#define PS2RX_SET_PARITY_BIT(a, b) (a |= (b << 1))
+#define PS2RX_SET_STOP_BIT(a, b) (a |= (b << 2))
+
+static inline void ps2rx_reset(ps2_rx_t *rx) {
+	rx->bitCount = PS2_START_BITCOUNT;
+	rx->data = 0;
+	rx->flag = 0;
+}
+
+static inline uint8_t ps2rx_parityCheck(uint8_t flag, uint8_t data) {
+	uint8_t result = 1;
+	uint8_t counter = 8;
+
+	while (counter--) {
+		result = data & 0x1 ? !result : result;
+		data >>= 1;
+	}
+
+	return (result == PS2RX_PARITY_BIT(flag));
+}
+
+// Falling clock edge: store the bit read on the data line
+static inline void ps2rx_sample(ps2_rx_t *rx, uint8_t kBit) {
+	// bit 0 is start bit, bit 9,10 are parity and stop bits
+	// What is left are the data bits!
+	if (rx->bitCount < 11 && rx->bitCount > 2) {
+		rx->data >>= 1; // Shift the data
+
+		if (kBit) rx->data |= 0x80; // Add a bit if the read data is one
+	} else if (rx->bitCount == 11) { // start bit, must always be 0!
+		PS2RX_SET_START_BIT(rx->flag, kBit);
+	} else if (rx->bitCount == 2) { // Parity bit: 1 if there is an even number of 1s in the data bits
+		PS2RX_SET_PARITY_BIT(rx->flag, kBit);
+	} else if (rx->bitCount == 1) { // Stop bit, must always be 1!
+		PS2RX_SET_STOP_BIT(rx->flag, kBit);
+	}
+}
+
+// Rising clock edge: returns 1 when a complete and valid byte is waiting in rx->data
+static inline uint8_t ps2rx_clock(ps2_rx_t *rx) {
+	uint8_t valid;
+
+	if (--rx->bitCount) return 0;
+
+	valid = !PS2RX_START_BIT(rx->flag) && PS2RX_STOP_BIT(rx->flag) && ps2rx_parityCheck(rx->flag, rx->data);
+	// Else... there was a problem somewhere, probably timing
+
+	rx->flag = 0;
+	rx->bitCount = PS2_START_BITCOUNT; // Start over. The data bits will all be shifted out by the next frame
+
+	return valid;
+}
+
+#endif /* _PS2_RX_HEADER_ */
@@ -0,0 +1,138 @@
+#include "ps2_mouse.h"
+
+#include "ps2_keyb.h"
+#include "ps2_rx.h"
+
+#include <stdio.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#if !defined (__AVR_ATmega328P__)
+#error "PS/2 mouse support needs pin change interrupts on PORTC (ATmega328P only)"
+#endif
+
+// See http://www.computer-engineering.org/ps2mouse/
+
+#define PS2_MOUSE_ACK          0xFA
+#define PS2_MOUSE_BAT_OK       0xAA // Sent after the self test, followed by the device ID
+#define PS2_MOUSE_ENABLE       0xF4 // Enable data reporting in stream mode
+#define PS2_MOUSE_RESET        0xFF
+
+#define PS2_MOUSE_PKT_ALWAYS1  0x08 // Bit 3 of the first packet byte is always set
+#define PS2_MOUSE_PKT_XSIGN    0x10
+#define PS2_MOUSE_PKT_YSIGN    0x20
+#define PS2_MOUSE_PKT_XOVF     0x40
+#define PS2_MOUSE_PKT_YOVF     0x80
+
+#define MS_CLK_PNUM  0 // PC0 - PCINT8
+#define MS_DATA_PNUM 1 // PC1
+
+static const ps2_lines_t ms_lines = {
+	&PORTC, &DDRC, &PINC, MS_DATA_PNUM,
+	&PORTC, &DDRC, &PINC, MS_CLK_PNUM
+};
+
+static ps2_rx_t ms_rx; // Only touched by PCINT1 once initialized
+static uint8_t ms_clkLevel; // Last clock level seen: the other PORTC pins may fire the interrupt too
+static uint8_t ms_packet[3];
+static uint8_t ms_packetIdx;
+static uint8_t ms_batStart; // The last byte was BAT OK, where a packet starts
+
+static volatile uint8_t ms_enableRequest;
+static uint8_t ms_expectAck; // The ACK to our enable command looks like a valid first packet byte
+
+static void ps2mouse_dumb_move(int16_t dx, int16_t dy, uint8_t buttons);
+static void (*move_callback)(int16_t dx, int16_t dy, uint8_t buttons) = ps2mouse_dumb_move;
+
+static inline void ps2mouse_pushByte(uint8_t code);
+
+static void ps2mouse_dumb_move(int16_t dx, int16_t dy, uint8_t buttons) {
+}
+
+void ps2mouse_setCallback(void (*callback)(int16_t dx, int16_t dy, uint8_t buttons)) {
+	move_callback = callback;
+}
+
+void ps2mouse_init(void) {
+	uint8_t command = PS2_MOUSE_RESET;
+
+	// Clock and data as inputs with pull-ups
+	DDRC &= ~((1 << MS_CLK_PNUM) | (1 << MS_DATA_PNUM));
+	PORTC |= (1 << MS_CLK_PNUM) | (1 << MS_DATA_PNUM);
+
+	ps2rx_reset(&ms_rx);
+	ms_clkLevel = 1;
+	ms_packetIdx = 0;
+	ms_batStart = 0;
+	ms_enableRequest = 0;
+	ms_expectAck = 1; // The ACK to the reset, else it starts a packet and the BAT that follows is missed
+
+	PCMSK1 |= (1 << PCINT8);
+	PCIFR = (1 << PCIF1); // Clear any pending flag
+	PCICR |= (1 << PCIE1);
+
+	// The mouse answers with ACK, BAT OK and its ID: reporting is enabled in ps2mouse_task() once the ID arrives
+	ps2keyb_sendCommandTo(&ms_lines, &command, 1);
+}
+
+void ps2mouse_task(void) {
+	uint8_t command = PS2_MOUSE_ENABLE;
+
+	if (!ms_enableRequest) return;
+	ms_enableRequest = 0;
+
+	ps2keyb_sendCommandTo(&ms_lines, &command, 1);
+
+	// Our own clocking toggled the pin: start from a clean receiver state
+	PCICR &= ~(1 << PCIE1);
+	PCIFR = (1 << PCIF1);
+	ps2rx_reset(&ms_rx);
+	ms_clkLevel = 1;
+	ms_packetIdx = 0;
+	ms_expectAck = 1;
+	PCICR |= (1 << PCIE1);
+}
+
+static inline void ps2mouse_pushByte(uint8_t code) {
+	int16_t dx, dy;
+
+	if (ms_batStart && code == 0x00) { // Self test passed, ID 0: a mouse was (re)plugged
+		ms_batStart = 0;
+		ms_packetIdx = 0;
+		ms_enableRequest = 1;
+		return;
+	}
+	// Inside a packet, AA 00 is only a movement (dx -86 or 170, then dy 0)
+	ms_batStart = (ms_packetIdx == 0 && code == PS2_MOUSE_BAT_OK);
+
+	if (ms_packetIdx == 0 && ms_expectAck) { // Usually lost while the command is being sent, so only look at one byte
+		ms_expectAck = 0;
+		if (code == PS2_MOUSE_ACK) return;
+	}
+
+	if (ms_packetIdx == 0 && !(code & PS2_MOUSE_PKT_ALWAYS1)) return; // Out of sync (or an ACK): wait for a valid first byte
+
+	ms_packet[ms_packetIdx++] = code;
+	if (ms_packetIdx < 3) return;
+	ms_packetIdx = 0;
+
+	// Deltas are 9 bit two's complement values, sign in the first byte
+	dx = (ms_packet[0] & PS2_MOUSE_PKT_XSIGN) ? (int16_t)ms_packet[1] - 256 : ms_packet[1];
+	dy = (ms_packet[0] & PS2_MOUSE_PKT_YSIGN) ? (int16_t)ms_packet[2] - 256 : ms_packet[2];
+
+	(*move_callback)(dx, dy, ms_packet[0] & (PS2MOUSE_BTN_LEFT | PS2MOUSE_BTN_RIGHT | PS2MOUSE_BTN_MIDDLE));
+}
+
+ISR(PCINT1_vect) { // Mouse clock changed
+	uint8_t clk = (PINC & (1 << MS_CLK_PNUM)) ? 1 : 0;
+
+	if (clk == ms_clkLevel) return; // Not our pin
+	ms_clkLevel = clk;
+
+	if (!clk) { // Falling edge
+		ps2rx_sample(&ms_rx, (PINC & (1 << MS_DATA_PNUM)) ? 1 : 0);
+	} else if (ps2rx_clock(&ms_rx)) { // Rising edge
+		ps2mouse_pushByte(ms_rx.data);
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef _AVR_PS2_MOUSE_HEADER_
+#define _AVR_PS2_MOUSE_HEADER_
+
+#include <stdint.h>
+
+// The mouse uses a pin change interrupt: clock on PC0 (PCINT8), data on PC1.
+// Only available on the ATmega328P.
+
+#define PS2MOUSE_BTN_LEFT   0x01
+#define PS2MOUSE_BTN_RIGHT  0x02
+#define PS2MOUSE_BTN_MIDDLE 0x04
+
+void ps2mouse_init(void);
+// Called from the interrupt for every movement packet. dy is positive when moving up, as in the PS/2 protocol
+void ps2mouse_setCallback(void (*callback)(int16_t dx, int16_t dy, uint8_t buttons));
+
+// To be called from the main loop: (re)enables data reporting after the mouse completed its self test
+void ps2mouse_task(void);
+
+#endif /* _AVR_PS2_MOUSE_HEADER_ */
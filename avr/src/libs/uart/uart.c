@@ -0,0 +1,74 @@
+#include "uart.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "common/hal.h"
+#include "common/timing.h"
+
+#ifndef HAL_UART_DATA
+#error "UART=1 needs the USART of the ATmega328P or ATmega8A"
+#endif
+
+#if TIMING_UART_INEXACT(UART_BAUD)
+#error "UART_BAUD is more than 2% off at this F_CPU: pick another rate"
+#endif
+
+static volatile uint8_t rx_ring[UART_RX_SIZE];
+static volatile uint8_t rx_head, rx_tail; // Written by the interrupt / by uart_getc()
+static volatile uint16_t rx_errors;
+
+void uart_init(void) {
+	rx_head = rx_tail = 0;
+	rx_errors = 0;
+
+	HAL_UART_UBRRH = TIMING_UART_UBRR(UART_BAUD) >> 8;
+	HAL_UART_UBRRL = TIMING_UART_UBRR(UART_BAUD) & 0xFF;
+	HAL_UART_STATUS = HAL_UART_U2X;
+	HAL_UART_CTRL = HAL_UART_ENABLE;
+}
+
+uint8_t uart_getc(uint8_t *c) {
+	uint8_t tail = rx_tail;
+
+	if (tail == rx_head) return 0;
+
+	*c = rx_ring[tail];
+	rx_tail = (tail + 1) & (UART_RX_SIZE - 1);
+
+	return 1;
+}
+
+uint8_t uart_putc(uint8_t c) {
+	if (!(HAL_UART_STATUS & HAL_UART_READY)) return 0;
+
+	HAL_UART_DATA = c;
+
+	return 1;
+}
+
+uint16_t uart_errors(void) {
+	uint16_t errors;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		errors = rx_errors;
+	}
+
+	return errors;
+}
+
+ISR(HAL_UART_RX_vect) {
+	uint8_t status = HAL_UART_STATUS; // Before the data: reading it moves the receive buffer on
+	uint8_t c = HAL_UART_DATA;
+	uint8_t head = rx_head;
+	uint8_t next = (head + 1) & (UART_RX_SIZE - 1);
+
+	if ((status & HAL_UART_ERRORS) || next == rx_tail) {
+		rx_errors++;
+		return;
+	}
+
+	rx_ring[head] = c;
+	rx_head = next;
+}
@@ -0,0 +1,23 @@
+#ifndef _AKAB_UART_HEADER_
+#define _AKAB_UART_HEADER_
+
+#include <stdint.h>
+
+// USART at UART_BAUD, 8N1 (pins in common/hal.h). Bytes received go into a ring from the
+// receive interrupt, a handler of a few instructions; sending is polled, with no interrupt at all.
+// ATmega328P and ATmega8A only.
+
+#ifndef UART_BAUD
+#define UART_BAUD 38400
+#endif
+
+#define UART_RX_SIZE 32 // Power of two: a few frames of the management protocol
+
+void uart_init(void);
+
+uint8_t uart_getc(uint8_t *c); // 1 with a byte from the ring, 0 if it is empty
+uint8_t uart_putc(uint8_t c); // 1 if the transmitter took it, 0 while it is still busy with the last one
+
+uint16_t uart_errors(void); // Bytes lost since uart_init(): overrun, framing error or ring full
+
+#endif /* _AKAB_UART_HEADER_ */
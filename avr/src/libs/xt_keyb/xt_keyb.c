@@ -0,0 +1,343 @@
+#include "xt_keyb.h"
+
+#include <stdio.h>
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "common/trace.h"
+#include "common/hal.h"
+#include "common/timing.h"
+
+// PC/XT keyboard frame, as sent by the original keyboard:
+//   clock low 120us with data high, clock high 66us, clock low 30us (start)
+//   8 data bits, LSB first: data set with the clock going high, 66us high, 30us low
+//   clock high, data low, 1ms before the next frame
+// The host holds the clock low to inhibit us (or, for long enough, to reset us),
+// and holds data low until it has read the last byte.
+//
+// Nothing here waits. The Timer1 compare B handler clocks the frames out, one phase per
+// compare, and starts the next queued frame at the end of the gap. Each compare is set from the
+// last one, so a handler held up by another interrupt moves one edge, not the rest of the frame.
+// The main loop only starts a frame when the wire is idle, and times the host holding the
+// clock low (inhibit or reset) and the self test on HAL_TIMEBASE().
+
+#define XT_START_LOW_US  120
+#define XT_START_HIGH_US 66
+#define XT_START2_LOW_US 30
+#define XT_BIT_HIGH_US   66
+#define XT_BIT_LOW_US    30
+#define XT_GAP_US        1000
+#define XT_GAP_RELEASE_US 125 // Data released this long before the end of the gap, so it is up when the next frame starts
+
+#define XT_TICKS(us) TIMING_T1_TICKS(us)
+
+#define XT_KBDCODE_SELFTESTOK 0xAA
+#define XT_KBDCODE_EXTENDED   0xE0
+
+#define XT_QUEUE_SIZE 16 // Must be a power of two
+
+// Wire scancodes for XTKBD_E0_RCTRL ... XTKBD_E0_DELETE
+static const uint8_t xt_e0_codes[XTKBD_E0_COUNT] PROGMEM = {
+	0x1D, // RIGHT CTRL
+	0x38, // RIGHT ALT
+	0x1C, // KP ENTER
+	0x35, // KP /
+	0x37, // PRINT SCREEN
+	0x47, // HOME
+	0x48, // UP ARROW
+	0x49, // PAG UP
+	0x4B, // LEFT ARROW
+	0x4D, // RIGHT ARROW
+	0x4F, // END
+	0x50, // DOWN ARROW
+	0x51, // PAG DOWN
+	0x52, // INSERT
+	0x53  // DELETE
+};
+
+// Frame phases, run by the compare handler
+enum {
+	XT_IDLE,
+	XT_START_LOW,
+	XT_START_HIGH,
+	XT_START2_LOW,
+	XT_BIT_HIGH,
+	XT_BIT_LOW,
+	XT_GAP,
+	XT_GAP_END
+};
+
+// Host side of the clock, followed from xtkbd_processQueue() while the wire is idle
+enum {
+	XT_HOST_IDLE,    // Clock released: frames may go out
+	XT_HOST_LOW,     // Clock held low: inhibit, or the start of a reset
+	XT_HOST_RESET,   // Held past XTKBD_RESET_MS, waiting for the release
+	XT_HOST_SELFTEST // Released after a reset, 0xAA goes out after XTKBD_SELFTEST_MS
+};
+
+// Data port
+static volatile uint8_t *dPort, *dDir, *dPin;
+static uint8_t dPNum; // Data port pin number
+
+// Clock port
+static volatile uint8_t *cPort, *cDir, *cPin;
+static uint8_t cPNum; // Clock port pin number
+
+// Ring buffer of codes waiting to be clocked out to the host
+static volatile uint8_t cmdQueue[XT_QUEUE_SIZE];
+static volatile uint8_t q_in, q_out;
+
+static volatile uint8_t tx_phase = XT_IDLE;
+static uint8_t tx_shift, tx_bits;
+static uint8_t tx_prefixed = 0; // The E0 prefix of the code at q_out went out: its scancode is next
+
+static uint8_t host_state = XT_HOST_IDLE;
+static uint16_t host_last;    // HAL_TIMEBASE() at the last poll
+static uint32_t host_elapsed; // Ticks in host_state, as of the last poll
+
+// Open drain: pulled low by setting the pin as output, released to the pull-up as input
+#define XT_CLK_LOW()     do { *cPort &= ~(1 << cPNum); *cDir |= (1 << cPNum); } while (0)
+#define XT_CLK_RELEASE() do { *cDir &= ~(1 << cPNum); *cPort |= (1 << cPNum); } while (0)
+#define XT_DAT_LOW()     do { *dPort &= ~(1 << dPNum); *dDir |= (1 << dPNum); } while (0)
+#define XT_DAT_RELEASE() do { *dDir &= ~(1 << dPNum); *dPort |= (1 << dPNum); } while (0)
+#define XT_CLK_IS_HIGH() (*cPin & (1 << cPNum))
+#define XT_DAT_IS_HIGH() (*dPin & (1 << dPNum))
+
+static void xtkbd_startFrame(void);
+static void xtkbd_flush(void);
+
+void xtkbd_setup(volatile uint8_t *clockPort, volatile uint8_t *clockDir, volatile uint8_t *clockPin, uint8_t clockPNum, volatile uint8_t *dataPort, volatile uint8_t *dataDir, volatile uint8_t *dataPin, uint8_t dataPNum) {
+	cPort = clockPort;
+	cDir = clockDir;
+	cPin = clockPin;
+	cPNum = clockPNum;
+
+	dPort = dataPort;
+	dDir = dataDir;
+	dPin = dataPin;
+	dPNum = dataPNum;
+
+	HAL_T1COMPB_DISABLE();
+
+	// Both lines released, with the pull-up resistors on
+	XT_CLK_RELEASE();
+	XT_DAT_RELEASE();
+
+	q_in = q_out = 0;
+	tx_phase = XT_IDLE;
+	tx_prefixed = 0;
+	host_state = XT_HOST_IDLE;
+
+	HAL_TIMEBASE_INIT(); // Frame phases and host timing
+	host_last = HAL_TIMEBASE();
+}
+
+void xtkbd_init(void) {
+	xtkbd_queueCommand(XT_KBDCODE_SELFTESTOK); // Power up self test passed, as the original keyboard does
+}
+
+static uint8_t xtkbd_isExtended(uint8_t command) {
+	uint8_t code = command & 0x7F;
+
+	return code >= XTKBD_E0_BASE && code < XTKBD_E0_BASE + XTKBD_E0_COUNT;
+}
+
+// Starts the frame of the code at q_out, if there is one and the host is ready.
+// Interrupts off: from the main loop, or from the handler at the end of a gap.
+// The code stays queued until its frame is over, so a frame the host cuts short is sent again.
+// An E0 key goes out as two frames, the prefix and then the scancode: if the host cuts the
+// second one, it already has the prefix, and only the scancode is sent again
+static void xtkbd_startFrame(void) {
+	uint8_t command;
+
+	if (q_in == q_out || !XT_CLK_IS_HIGH() || !XT_DAT_IS_HIGH()) { // Nothing to send, or the host has not read the last code yet
+		tx_phase = XT_IDLE;
+		HAL_T1COMPB_DISABLE();
+		return;
+	}
+
+	command = cmdQueue[q_out];
+	if (!xtkbd_isExtended(command)) tx_shift = command;
+	else if (!tx_prefixed) tx_shift = XT_KBDCODE_EXTENDED;
+	else tx_shift = pgm_read_byte(&xt_e0_codes[(command & 0x7F) - XTKBD_E0_BASE]) | (command & 0x80);
+	tx_bits = 8;
+
+	TRACE_TX_START();
+
+	XT_DAT_RELEASE();
+	XT_CLK_LOW();
+	tx_phase = XT_START_LOW;
+	OCR1B = HAL_TIMEBASE() + XT_TICKS(XT_START_LOW_US);
+	HAL_T1COMPB_CLEAR();
+	HAL_T1COMPB_ENABLE();
+}
+
+// The host pulled the clock low while we had it released: the frame is given up, the code is still queued
+static uint8_t xtkbd_aborted(void) {
+	if (XT_CLK_IS_HIGH()) return 0;
+
+	XT_DAT_RELEASE();
+	tx_phase = XT_IDLE;
+	HAL_T1COMPB_DISABLE();
+	TRACE_TX_END();
+	return 1;
+}
+
+ISR(TIMER1_COMPB_vect) {
+	switch (tx_phase) {
+		case XT_START_LOW:
+			XT_CLK_RELEASE();
+			tx_phase = XT_START_HIGH;
+			OCR1B += XT_TICKS(XT_START_HIGH_US);
+			break;
+
+		case XT_START_HIGH:
+			if (xtkbd_aborted()) break;
+			XT_CLK_LOW();
+			tx_phase = XT_START2_LOW;
+			OCR1B += XT_TICKS(XT_START2_LOW_US);
+			break;
+
+		case XT_START2_LOW:
+		case XT_BIT_LOW:
+			if (tx_bits) { // Data first, then the clock edge
+				if (tx_shift & 1) XT_DAT_RELEASE();
+				else XT_DAT_LOW();
+				tx_shift >>= 1;
+				tx_bits--;
+
+				XT_CLK_RELEASE();
+				tx_phase = XT_BIT_HIGH;
+				OCR1B += XT_TICKS(XT_BIT_HIGH_US);
+				break;
+			}
+
+			if (xtkbd_isExtended(cmdQueue[q_out]) && !tx_prefixed) {
+				tx_prefixed = 1; // The scancode follows
+			} else {
+				tx_prefixed = 0;
+				q_out = (q_out + 1) & (XT_QUEUE_SIZE - 1); // Sent
+			}
+			TRACE_TX_END();
+
+			XT_CLK_RELEASE();
+			XT_DAT_LOW();
+			tx_phase = XT_GAP;
+			OCR1B += XT_TICKS(XT_GAP_US - XT_GAP_RELEASE_US);
+			break;
+
+		case XT_BIT_HIGH:
+			if (xtkbd_aborted()) break;
+			XT_CLK_LOW();
+			tx_phase = XT_BIT_LOW;
+			OCR1B += XT_TICKS(XT_BIT_LOW_US);
+			break;
+
+		case XT_GAP:
+			XT_DAT_RELEASE();
+			tx_phase = XT_GAP_END;
+			OCR1B += XT_TICKS(XT_GAP_RELEASE_US);
+			break;
+
+		case XT_GAP_END:
+			TRACE_SYNC(); // No handshake on the XT: the gap after the frame is over
+			xtkbd_startFrame(); // Back to back if more codes are queued
+			break;
+
+		default:
+			tx_phase = XT_IDLE;
+			HAL_T1COMPB_DISABLE();
+			break;
+	}
+}
+
+// Only while the wire is idle: no frame half sent
+static void xtkbd_flush(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		q_out = q_in;
+		tx_prefixed = 0;
+	}
+}
+
+uint8_t xtkbd_queueCommand(uint8_t command) {
+	uint8_t queued = 0;
+
+	if (command == 0xFF) return 1;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { // May be called both from the main loop and from the PS/2 interrupt
+		if (((q_in + 1) & (XT_QUEUE_SIZE - 1)) != q_out) {
+			cmdQueue[q_in] = command;
+			q_in = (q_in + 1) & (XT_QUEUE_SIZE - 1);
+			queued = 1;
+		}
+	}
+
+	return queued;
+}
+
+uint8_t xtkbd_queueEmpty(void) {
+	return q_in == q_out;
+}
+
+uint8_t xtkbd_queueFree(void) {
+	return (q_out - q_in - 1) & (XT_QUEUE_SIZE - 1); // One slot always stays empty
+}
+
+// The host holding the clock low while we are idle: a short hold is an inhibit, the queue waits.
+// A hold of XTKBD_RESET_MS or more is a reset: the queue is flushed, and XTKBD_SELFTEST_MS after
+// the release 0xAA goes out, ahead of any key pressed meanwhile
+void xtkbd_processQueue(void) {
+	uint16_t now;
+
+	if (tx_phase != XT_IDLE) return; // A frame is on the wire: the handler notices the host pulling the clock low
+
+	now = HAL_TIMEBASE();
+	host_elapsed += (uint16_t)(now - host_last);
+	host_last = now;
+
+	switch (host_state) {
+		case XT_HOST_IDLE:
+			if (!XT_CLK_IS_HIGH()) {
+				host_state = XT_HOST_LOW;
+				host_elapsed = 0;
+			}
+			break;
+
+		case XT_HOST_LOW:
+			if (XT_CLK_IS_HIGH()) {
+				host_state = XT_HOST_IDLE; // Just an inhibit: the queue goes out now
+			} else if (host_elapsed >= XT_TICKS(XTKBD_RESET_MS * 1000UL)) {
+				xtkbd_flush();
+				host_state = XT_HOST_RESET;
+			}
+			break;
+
+		case XT_HOST_RESET:
+			if (XT_CLK_IS_HIGH()) {
+				xtkbd_flush(); // Keys pressed during the reset are not reported
+				host_state = XT_HOST_SELFTEST;
+				host_elapsed = 0;
+			}
+			break;
+
+		case XT_HOST_SELFTEST:
+			if (!XT_CLK_IS_HIGH()) {
+				host_state = XT_HOST_LOW;
+				host_elapsed = 0;
+			} else if (host_elapsed >= XT_TICKS(XTKBD_SELFTEST_MS * 1000UL)) {
+				xtkbd_flush(); // Nor those pressed during the self test
+				xtkbd_queueCommand(XT_KBDCODE_SELFTESTOK);
+				host_state = XT_HOST_IDLE;
+			}
+			break;
+	}
+
+	if (host_state != XT_HOST_IDLE) return;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (tx_phase == XT_IDLE) xtkbd_startFrame();
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef _XT_KEYBOARD_HEADER_
+#define _XT_KEYBOARD_HEADER_
+
+#include <stdint.h>
+
+// Keys sent with an E0 prefix get their own 7 bit codes, above the highest XT scancode (0x58).
+// xtkbd_processQueue() turns them back into E0 + scancode.
+#define XTKBD_E0_BASE     0x60
+#define XTKBD_E0_RCTRL    0x60
+#define XTKBD_E0_RALT     0x61
+#define XTKBD_E0_KP_ENTER 0x62
+#define XTKBD_E0_KP_DIV   0x63
+#define XTKBD_E0_PRTSCR   0x64
+#define XTKBD_E0_HOME     0x65
+#define XTKBD_E0_UP       0x66
+#define XTKBD_E0_PGUP     0x67
+#define XTKBD_E0_LEFT     0x68
+#define XTKBD_E0_RIGHT    0x69
+#define XTKBD_E0_END      0x6A
+#define XTKBD_E0_DOWN     0x6B
+#define XTKBD_E0_PGDN     0x6C
+#define XTKBD_E0_INSERT   0x6D
+#define XTKBD_E0_DELETE   0x6E
+#define XTKBD_E0_COUNT    15
+
+#define XTKBD_RESET_MS    12 // The host holding the clock low this long asks for a reset. The XT BIOS holds it 20ms
+#define XTKBD_SELFTEST_MS 10 // From the end of the reset to the 0xAA answer
+
+void xtkbd_setup(volatile uint8_t *clockPort, volatile uint8_t *clockDir, volatile uint8_t *clockPin, uint8_t clockPNum, volatile uint8_t *dataPort, volatile uint8_t *dataDir, volatile uint8_t *dataPin, uint8_t dataPNum);
+void xtkbd_init(void);
+
+// Queued transmission: codes are pushed (also from interrupt context), and clocked out by the
+// Timer1 compare B interrupt (OCR1B) once the main loop started the first frame
+uint8_t xtkbd_queueCommand(uint8_t command); // Bit 7 set for a release. Returns 0 if the queue is full and the command was dropped
+uint8_t xtkbd_queueEmpty(void);
+uint8_t xtkbd_queueFree(void); // How many more commands the queue takes
+void xtkbd_processQueue(void); // Starts the next frame when the host is ready, times host inhibit and reset. Never waits
+
+#endif /* _XT_KEYBOARD_HEADER_ */
@@ -8,42 +8,133 @@
 #include "ps2_keyb.h"
 #include "ps2_proto.h"
 
-#include "amiga_keyb.h"
+#include "output.h"
 
 #include "ps2_converter.h"
+#include "key_macro.h"
+#include "instrument.h"
+#include "watchdog.h"
+#ifdef AKAB_KEYB_PROFILE
+#include "keyb_profile.h"
+#endif
+#ifdef AKAB_UART
+#include "mgmt.h"
+#endif
+
+#ifdef AKAB_MOUSE
+#include "ps2_mouse.h"
+#include "amiga_mouse.h"
+#endif
+
+#include "common/trace.h"
+#include "common/hal.h"
 
 #include "main.h"
 
+#if defined (AKAB_TRACE) && defined (AKAB_SIMAVR)
+// simavr reads this section and dumps the marker pins to a VCD file while the firmware runs
+#include "avr_mcu_section.h"
+
+AVR_MCU(F_CPU, AKAB_MCU_NAME);
+AVR_MCU_VCD_FILE("out/akab_trace.vcd", 1000);
+
+const struct avr_mmcu_vcd_trace_t akab_trace[] _MMCU_ = {
+	{ AVR_MCU_VCD_SYMBOL("int0"), .mask = (1 << TRACE_INT0_PNUM), .what = (void *)&PORTC, },
+	{ AVR_MCU_VCD_SYMBOL("frame"), .mask = (1 << TRACE_FRAME_PNUM), .what = (void *)&PORTC, },
+	{ AVR_MCU_VCD_SYMBOL("conv"), .mask = (1 << TRACE_CONV_PNUM), .what = (void *)&PORTC, },
+	{ AVR_MCU_VCD_SYMBOL("tx"), .mask = (1 << TRACE_TX_PNUM), .what = (void *)&PORTC, },
+	{ AVR_MCU_VCD_SYMBOL("sync"), .mask = (1 << TRACE_SYNC_PNUM), .what = (void *)&PORTC, },
+};
+#endif
+
+#ifdef AKAB_MOUSE
+static void mouse_callback(int16_t dx, int16_t dy, uint8_t buttons);
+
+static void mouse_callback(int16_t dx, int16_t dy, uint8_t buttons) {
+	uint8_t amiga_buttons = 0;
+
+	if (buttons & PS2MOUSE_BTN_LEFT) amiga_buttons |= AMIMOUSE_BTN_LEFT;
+	if (buttons & PS2MOUSE_BTN_RIGHT) amiga_buttons |= AMIMOUSE_BTN_RIGHT;
+	if (buttons & PS2MOUSE_BTN_MIDDLE) amiga_buttons |= AMIMOUSE_BTN_MIDDLE;
+
+	amimouse_report(dx, dy, amiga_buttons);
+}
+#endif
+
 
 int main(void) {
+#ifndef AKAB_KEYB_PROFILE
 	uint8_t keyb_commands[2];
+#endif
+	uint8_t warm;
 
-	// Set the pull-up resistor to all unused I/O ...
-	DDRB &= 0x03;
-	PORTB |= 0xFC;
-	
-	DDRC &= 0xC0;
-	PORTC |= 0x3F;
+	HAL_CLOCK_INIT(); // Every delay below counts cycles of F_CPU
 
-	DDRD &= 0x0C;
-	PORTD |= 0xF3;
+	warm = wdog_init(); // Watchdog reset: the keyboard and the host are already up
 
-	_delay_ms(50);
+	// Set the pull-up resistor to all unused I/O ...
+	HAL_PULLUP_UNUSED();
 
+	TRACE_INIT(); // Marker pins, when tracing is enabled
 
-	// Initialization of PS/2 and Amiga interface
-	amikbd_setup(&PORTB, &DDRB, 0, &PORTD, &DDRD, 0);
+	instr_init();
 
-	ps2keyb_init(&PORTB, &DDRB, &PINB, 1);
-	ps2keyb_setCallback(ps2k_callback);
+	if (!warm) _delay_ms(50);
 
-	// Force the keyboard reset
-	keyb_commands[0] = PS2_HTD_RESET;
-	ps2keyb_sendCommand(keyb_commands, 1); // This also enables interrupts
 
-	amikbd_init();
+	// Initialization of PS/2 and host interface
+	out_setup();
 
-	while(1);
+	ps2keyb_init(&PORTB, &DDRB, &PINB, 1);
+	ps2keyb_setCallback(ps2k_callback);
+#ifdef AKAB_KEYB2
+	ps2keyb_initSecond();
+#endif
+	if (warm && !ps2k_restart()) warm = 0; // Queues the release of the held keys and puts the LEDs back, if they are intact
+
+	if (!warm) {
+		ps2k_reset();
+
+#ifdef AKAB_KEYB_PROFILE
+		kbprof_boot(); // A keyboard seen before is set up without a reset
+#else
+		// Force the keyboard reset
+		keyb_commands[0] = PS2_HTD_RESET;
+		ps2keyb_sendCommand(keyb_commands, 1);
+#endif
+	}
+
+	sei();
+
+	if (warm) out_resume();
+	else out_init();
+
+#ifdef AKAB_UART
+	mgmt_init();
+#endif
+
+#ifdef AKAB_MOUSE
+	amimouse_init();
+	ps2mouse_setCallback(mouse_callback);
+	ps2mouse_init();
+#endif
+
+	wdog_ready();
+
+	while(1) {
+		wdog_kick();
+		instr_task();
+		ps2k_task(); // Releases after an overflow, before the macros too
+		kmacro_task(); // Macro playback only fills the queue when no live key is waiting
+		out_task();
+		instr_latencyCheck();
+#ifdef AKAB_UART
+		mgmt_task();
+#endif
+#ifdef AKAB_MOUSE
+		ps2mouse_task();
+#endif
+	}
 
     return 0;
 }
@@ -0,0 +1,211 @@
+#include "mgmt.h"
+
+#include <avr/io.h>
+#include <util/crc16.h>
+
+#include "uart.h"
+#include "output.h"
+#include "convtable.h"
+#include "key_macro.h"
+#include "instrument.h"
+#include "watchdog.h"
+#include "ps2_converter.h"
+#include "ps2_keyb.h"
+
+#include "common/hal.h"
+#include "common/timing.h"
+
+#define MGMT_TIMEOUT TIMING_T1_TICKS(MGMT_TIMEOUT_MS * 1000UL)
+
+#if MGMT_TIMEOUT > 0xFFFF
+#error "MGMT_TIMEOUT_MS does not fit the 16 bit timebase at this F_CPU"
+#endif
+
+// Receiver states
+#define MGMT_RX_SOF     0
+#define MGMT_RX_LENGTH  1
+#define MGMT_RX_COMMAND 2
+#define MGMT_RX_PAYLOAD 3
+#define MGMT_RX_CRC_LO  4
+#define MGMT_RX_CRC_HI  5
+#define MGMT_RX_DONE    6 // A good frame, waiting to run
+
+static uint8_t rx_state;
+static uint8_t rx_length, rx_command, rx_idx;
+static uint8_t rx_payload[MGMT_PAYLOAD_MAX];
+static uint16_t rx_crc, rx_stamp;
+
+static uint8_t tx_frame[MGMT_FRAME_MAX];
+static uint8_t tx_length, tx_idx;
+
+void mgmt_init(void) {
+	rx_state = MGMT_RX_SOF;
+	tx_length = tx_idx = 0;
+
+	uart_init();
+}
+
+static void mgmt_rxByte(uint8_t c) {
+	switch (rx_state) {
+		case MGMT_RX_SOF:
+			if (c == MGMT_SOF) rx_state = MGMT_RX_LENGTH;
+			return;
+		case MGMT_RX_LENGTH:
+			if (c > MGMT_PAYLOAD_MAX) {
+				rx_state = MGMT_RX_SOF;
+				return;
+			}
+			rx_length = c;
+			rx_crc = _crc_xmodem_update(0, c);
+			rx_state = MGMT_RX_COMMAND;
+			return;
+		case MGMT_RX_COMMAND:
+			rx_command = c;
+			rx_crc = _crc_xmodem_update(rx_crc, c);
+			rx_idx = 0;
+			rx_state = rx_length ? MGMT_RX_PAYLOAD : MGMT_RX_CRC_LO;
+			return;
+		case MGMT_RX_PAYLOAD:
+			rx_payload[rx_idx++] = c;
+			rx_crc = _crc_xmodem_update(rx_crc, c);
+			if (rx_idx == rx_length) rx_state = MGMT_RX_CRC_LO;
+			return;
+		case MGMT_RX_CRC_LO:
+			rx_state = (c == (rx_crc & 0xFF)) ? MGMT_RX_CRC_HI : MGMT_RX_SOF;
+			return;
+		case MGMT_RX_CRC_HI:
+			rx_state = (c == (rx_crc >> 8)) ? MGMT_RX_DONE : MGMT_RX_SOF;
+			return;
+	}
+}
+
+// Frames the reply in tx_frame: status, then length bytes already at tx_frame + 4
+static void mgmt_reply(uint8_t status, uint8_t length) {
+	uint16_t crc = 0;
+	uint8_t idx;
+
+	tx_frame[0] = MGMT_SOF;
+	tx_frame[1] = length + 1;
+	tx_frame[2] = rx_command | MGMT_REPLY;
+	tx_frame[3] = status;
+
+	for (idx = 1; idx < length + 4; idx++) crc = _crc_xmodem_update(crc, tx_frame[idx]);
+	tx_frame[idx++] = crc & 0xFF;
+	tx_frame[idx++] = crc >> 8;
+
+	tx_length = idx;
+	tx_idx = 0;
+}
+
+static void mgmt_counter(uint8_t idx, uint16_t value) {
+	tx_frame[5 + 2 * idx] = value & 0xFF;
+	tx_frame[6 + 2 * idx] = value >> 8;
+}
+
+static uint8_t mgmt_validKey(uint8_t key_code) {
+	return !(key_code & 0x80) || key_code == CONV_UNMAPPED || key_code == CONV_RESET_CODE || key_code == CONV_READOUT_CODE;
+}
+
+static void mgmt_execute(void) {
+	uint8_t *data = &tx_frame[4];
+	uint16_t frames, errors;
+	uint16_t drops[PS2K_DROP_COUNT];
+
+	switch (rx_command) {
+		case MGMT_CMD_PING:
+			if (rx_length) break;
+			data[0] = MGMT_VERSION;
+#if defined (AKAB_OUTPUT_XT)
+			data[1] = 1;
+#else
+			data[1] = 0;
+#endif
+#if defined (AKAB_PS2_ICP)
+			data[2] = 1;
+#else
+			data[2] = 0;
+#endif
+			mgmt_reply(MGMT_OK, 3);
+			return;
+		case MGMT_CMD_GET_OPTIONS:
+			if (rx_length) break;
+			data[0] = ps2k_options();
+			mgmt_reply(MGMT_OK, 1);
+			return;
+		case MGMT_CMD_SET_OPTIONS:
+			if (rx_length != 1 || (rx_payload[0] & ~PS2K_OPTS_DEFAULT)) break;
+			ps2k_setOptions(rx_payload[0]);
+			mgmt_reply(MGMT_OK, 0);
+			return;
+		case MGMT_CMD_GET_MAP:
+			if (rx_length != 2 || rx_payload[1] > 1) break;
+			data[0] = ps2k_map(rx_payload[0], rx_payload[1]);
+			mgmt_reply(MGMT_OK, 1);
+			return;
+		case MGMT_CMD_SET_MAP:
+			if (rx_length != 3 || rx_payload[1] > 1 || !mgmt_validKey(rx_payload[2])) break;
+			if (ps2k_anyHeld()) {
+				mgmt_reply(MGMT_ERR_BUSY, 0);
+			} else {
+				mgmt_reply(ps2k_remap(rx_payload[0], rx_payload[1], rx_payload[2]) ? MGMT_OK : MGMT_ERR_FULL, 0);
+			}
+			return;
+		case MGMT_CMD_CLEAR_MAPS:
+			if (rx_length) break;
+			if (ps2k_anyHeld()) {
+				mgmt_reply(MGMT_ERR_BUSY, 0);
+			} else {
+				ps2k_clearRemaps();
+				mgmt_reply(MGMT_OK, 0);
+			}
+			return;
+		case MGMT_CMD_COUNTERS:
+			if (rx_length) break;
+			ps2keyb_frameCounts(&frames, &errors);
+			data[0] = MGMT_CNT_COUNT;
+			mgmt_counter(MGMT_CNT_FRAMES, frames);
+			mgmt_counter(MGMT_CNT_FRAME_ERRORS, errors);
+			mgmt_counter(MGMT_CNT_UART_ERRORS, uart_errors());
+			mgmt_counter(MGMT_CNT_STACK_FREE, instr_stackFreeMin());
+			mgmt_counter(MGMT_CNT_LATENCY_MAX, instr_latencyMax());
+			mgmt_counter(MGMT_CNT_RESTARTS, wdog_restarts());
+			ps2k_dropCounts(drops);
+			for (uint8_t idx = 0; idx < PS2K_DROP_COUNT; idx++) mgmt_counter(MGMT_CNT_SHED_REPEATS + idx, drops[idx]);
+			mgmt_reply(MGMT_OK, 1 + 2 * MGMT_CNT_COUNT);
+			return;
+		case MGMT_CMD_KEYB_INIT:
+			if (rx_length) break;
+			ps2k_reinit();
+			mgmt_reply(MGMT_OK, 0);
+			return;
+		default:
+			mgmt_reply(MGMT_ERR_COMMAND, 0);
+			return;
+	}
+
+	mgmt_reply(MGMT_ERR_ARGUMENT, 0);
+}
+
+void mgmt_task(void) {
+	uint8_t c;
+
+	// The reply goes out first, a byte whenever the transmitter is free
+	while (tx_idx < tx_length) {
+		if (!uart_putc(tx_frame[tx_idx])) return;
+		tx_idx++;
+	}
+
+	if (rx_state != MGMT_RX_SOF && rx_state != MGMT_RX_DONE && (uint16_t)(HAL_TIMEBASE() - rx_stamp) > MGMT_TIMEOUT)
+		rx_state = MGMT_RX_SOF; // The rest of the frame never came
+
+	while (rx_state != MGMT_RX_DONE && uart_getc(&c)) {
+		rx_stamp = HAL_TIMEBASE();
+		mgmt_rxByte(c);
+	}
+
+	// Keys first: a command waits until nothing is queued for the host
+	if (rx_state == MGMT_RX_DONE && out_queueEmpty() && !kmacro_running()) {
+		mgmt_execute();
+		rx_state = MGMT_RX_SOF;
+	}
+}
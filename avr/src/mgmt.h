@@ -0,0 +1,58 @@
+#ifndef _MGMT_HEADER_
+#define _MGMT_HEADER_
+
+#include <stdint.h>
+
+// Management port on the USART (UART=1): configuration, counters and keyboard re-init at runtime.
+//
+// Frames, both ways: MGMT_SOF, length, command, length bytes of payload, then the CRC-16/XMODEM
+// (polynomial 0x1021, starting from 0) of length, command and payload, low byte first.
+// The adapter answers every frame it takes with command | MGMT_REPLY and a status byte first
+// in the payload. A frame with a bad CRC, too long, or stopping for more than MGMT_TIMEOUT_MS
+// in the middle is dropped without an answer: the client tries again.
+// Commands only run with no code waiting for the host, never from the PS/2 interrupt.
+// The same header is used by host/akabctl.c.
+
+#define MGMT_SOF         0xA5
+#define MGMT_REPLY       0x80
+#define MGMT_PAYLOAD_MAX 24
+#define MGMT_FRAME_MAX   (MGMT_PAYLOAD_MAX + 5)
+#define MGMT_TIMEOUT_MS  20
+
+#define MGMT_VERSION 1
+
+// Commands: arguments -> reply payload after the status
+#define MGMT_CMD_PING        0x01 // -> version, output (0 Amiga, 1 PC/XT), receiver (0 INT0, 1 input capture)
+#define MGMT_CMD_GET_OPTIONS 0x02 // -> options (PS2K_OPT_* in ps2_converter.h)
+#define MGMT_CMD_SET_OPTIONS 0x03 // options ->
+#define MGMT_CMD_GET_MAP     0x04 // scancode, extended -> key code (0xFF: not mapped)
+#define MGMT_CMD_SET_MAP     0x05 // scancode, extended, key code ->
+#define MGMT_CMD_CLEAR_MAPS  0x06 // Every key back to the conversion table
+#define MGMT_CMD_COUNTERS    0x07 // -> count, then count 16 bit counters (MGMT_CNT_*), low byte first
+#define MGMT_CMD_KEYB_INIT   0x08 // Releases the held keys on the host and resets the keyboard, from the main loop after the reply
+
+// Status
+#define MGMT_OK           0
+#define MGMT_ERR_COMMAND  1 // Unknown command
+#define MGMT_ERR_ARGUMENT 2 // Wrong length or value
+#define MGMT_ERR_BUSY     3 // Keys held: a remap would leave one stuck on the host
+#define MGMT_ERR_FULL     4 // No room left in the remap table
+
+// Counters, in reply order
+#define MGMT_CNT_FRAMES       0 // Valid PS/2 frames
+#define MGMT_CNT_FRAME_ERRORS 1 // PS/2 frames with a bad start, stop or parity bit
+#define MGMT_CNT_UART_ERRORS  2 // Management port bytes lost
+#define MGMT_CNT_STACK_FREE   3 // Lowest free stack seen, bytes
+#define MGMT_CNT_LATENCY_MAX  4 // Worst end-to-end latency, microseconds
+#define MGMT_CNT_RESTARTS     5 // Watchdog restarts since power on
+#define MGMT_CNT_SHED_REPEATS 6 // From here, the PS2K_DROP_* counters in ps2_converter.h: PC/XT typematic repeats shed
+#define MGMT_CNT_SHED_MACROS  7 // Macros shed
+#define MGMT_CNT_DROP_PRESSES 8 // Key presses dropped, the queue kept for releases
+#define MGMT_CNT_OVERFLOWS    9 // Every key held released, after an overflow or a keyboard overrun
+#define MGMT_CNT_OVERRUNS     10 // Keyboard overrun codes
+#define MGMT_CNT_COUNT        11
+
+void mgmt_init(void); // Starts the USART
+void mgmt_task(void); // From the main loop
+
+#endif /* _MGMT_HEADER_ */
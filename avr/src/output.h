@@ -0,0 +1,66 @@
+#ifndef _AKAB_OUTPUT_HEADER_
+#define _AKAB_OUTPUT_HEADER_
+
+#include <stdint.h>
+#include <avr/io.h>
+
+// Output backend, picked at build time by OUTPUT in the Makefile:
+//   amiga - Amiga keyboard port (src/libs/amiga_keyb), the default
+//   xt    - PC/XT keyboard port (src/libs/xt_keyb), AKAB_OUTPUT_XT
+// The PS/2 side, the converter, key state, macros and instrumentation talk to the host only through these.
+// Codes are the 7 bit key codes of convtable.h, with bit 7 set for a release.
+
+#if defined (AKAB_OUTPUT_XT)
+
+#include "xt_keyb.h"
+
+#if defined (AKAB_MOUSE)
+#error "The mouse quadrature output is for the Amiga, it can't be used with the XT output"
+#endif
+
+#if defined (AKAB_PS2_ICP)
+// XT clock on PD3, data on PD2: PB0 is the PS/2 clock
+static inline void out_setup(void) { xtkbd_setup(&PORTD, &DDRD, &PIND, 3, &PORTD, &DDRD, &PIND, 2); }
+#else
+// XT clock on PD3, data on PB0: the same pins as the pcxtkbd sketch
+static inline void out_setup(void) { xtkbd_setup(&PORTD, &DDRD, &PIND, 3, &PORTB, &DDRB, &PINB, 0); }
+#endif
+static inline void out_init(void) { xtkbd_init(); }
+static inline void out_resume(void) { } // The PC did not see the restart: no self test code
+static inline uint8_t out_queue(uint8_t code) { return xtkbd_queueCommand(code); } // Returns 0 if dropped
+static inline uint8_t out_queueEmpty(void) { return xtkbd_queueEmpty(); }
+static inline uint8_t out_queueFree(void) { return xtkbd_queueFree(); } // Codes that can still be queued
+static inline void out_task(void) { xtkbd_processQueue(); } // From the main loop
+static inline void out_hostReset(void) { } // No reset line on the XT port
+
+#else
+
+#include "amiga_keyb.h"
+
+// KCLK on PB0, or on PD2 with AKAB_PS2_ICP (PB0 is the PS/2 clock then). KDAT on PD3 (fixed in amiga_keyb.c).
+// Reset on PD0, or on PC5 with AKAB_UART (PD0 is the USART receiver then)
+#if defined (AKAB_PS2_ICP)
+#define OUT_KCLK_PORT &PORTD, &DDRD, 2
+#else
+#define OUT_KCLK_PORT &PORTB, &DDRB, 0
+#endif
+#if defined (AKAB_UART)
+#if defined (AKAB_MOUSE)
+#error "UART=1 moves the Amiga reset to PC5, which MOUSE=1 drives as its Y quadrature output"
+#endif
+#define OUT_RESET_PORT &PORTC, &DDRC, 5
+#else
+#define OUT_RESET_PORT &PORTD, &DDRD, 0
+#endif
+static inline void out_setup(void) { amikbd_setup(OUT_KCLK_PORT, OUT_RESET_PORT); }
+static inline void out_init(void) { amikbd_init(); }
+static inline void out_resume(void) { amikbd_resume(); } // After a watchdog restart, instead of out_init()
+static inline uint8_t out_queue(uint8_t code) { return amikbd_kQueueCommand(code); } // Returns 0 if dropped
+static inline uint8_t out_queueEmpty(void) { return amikbd_kQueueEmpty(); }
+static inline uint8_t out_queueFree(void) { return amikbd_kQueueFree(); } // Codes that can still be queued
+static inline void out_task(void) { amikbd_kProcessQueue(); } // From the main loop
+static inline void out_hostReset(void) { amikbd_kForceReset(); }
+
+#endif /* AKAB_OUTPUT_XT */
+
+#endif /* _AKAB_OUTPUT_HEADER_ */
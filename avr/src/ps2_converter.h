@@ -4,7 +4,52 @@
 #include <stdint.h>
 
 #include "ps2_proto.h"
+#include "conv_core.h"
 
-void ps2k_callback(uint8_t *code, uint8_t count);
+// Carries out what the converter core (conv_core.c) asks for: codes to the output backend,
+// commands to the PS/2 keyboard, macros. Its state is kept over a watchdog restart
+
+void ps2k_callback(uint8_t device, uint8_t *code, uint8_t count);
+void ps2k_reset(void); // Power on: no key held, no lock, default options, no remaps
+uint8_t ps2k_restart(void); // After a watchdog restart: releases the held keys on the host, keeps the lock state and its LEDs. 0 if they were corrupted
+void ps2k_reinit(void); // Releases the held keys (and locks) on the host, then resets the keyboard
+
+// From the main loop, before the macros: after an overflow, a restart or a re-init, queues the release
+// of the held keys as room comes, and for a re-init resets the keyboard once they are all released
+void ps2k_task(void);
+uint8_t ps2k_releasing(void); // 1 until that release is over
+
+// What was given up because the host took codes too slowly, since power on
+#define PS2K_DROP_REPEATS  0 // PC/XT typematic repeats shed, the queue half full
+#define PS2K_DROP_MACROS   1 // Macros not started, the queue half full, or cut short by an overflow
+#define PS2K_DROP_PRESSES  2 // Key presses dropped: the last slots of the queue are kept for releases
+#define PS2K_DROP_RELEASES 3 // Overflows: a release found the queue full, or the keyboard overran; every key held released
+#define PS2K_DROP_OVERRUNS 4 // Keyboard overrun codes (PS2_SCANCODE_OVERRUN*), never converted
+#define PS2K_DROP_COUNT    5
+
+void ps2k_dropCounts(uint16_t *counts); // PS2K_DROP_COUNT of them, in that order
+
+// Runtime options (CONVCORE_OPT_*), 1 by default. Not kept over a reset
+#define PS2K_OPT_RESET_CHORD CONVCORE_OPT_RESET_CHORD
+#define PS2K_OPT_CAPS_LATCH  CONVCORE_OPT_CAPS_LATCH
+#define PS2K_OPTS_DEFAULT    CONVCORE_OPTS_DEFAULT
+
+uint8_t ps2k_options(void);
+void ps2k_setOptions(uint8_t options); // From the main loop. Turning the latch off lets go of a latched Caps Lock
+
+// What a scancode converts to now (extended: E0 prefixed), remaps included
+uint8_t ps2k_map(uint8_t ps2_code, uint8_t extended);
+
+uint8_t ps2k_isHeld(uint8_t key_code); // Down on the host, from any keyboard
+uint8_t ps2k_anyHeld(void);
+
+#ifdef AKAB_UART
+#define PS2K_REMAP_SIZE CONVCORE_REMAPS // Keys converted to something else than the table says, set from the management port
+
+// From the main loop, with no key held. Mapping a key back to its table entry drops the remap.
+// Returns 0 if the remap table is full
+uint8_t ps2k_remap(uint8_t ps2_code, uint8_t extended, uint8_t key_code);
+void ps2k_clearRemaps(void);
+#endif
 
 #endif /* _PS2_AMIGA_CONVERTER_ */
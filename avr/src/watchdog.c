@@ -0,0 +1,42 @@
+#include "watchdog.h"
+
+#include <avr/io.h>
+#include <avr/wdt.h>
+
+#include "common/hal.h"
+
+#define WDOG_MAGIC 0x5AA5 // The .noinit state was written by a running firmware
+
+static uint8_t reset_flags HAL_NOINIT;
+static uint16_t state_magic HAL_NOINIT;
+static uint8_t restart_count HAL_NOINIT;
+
+void wdog_early(void) __attribute__ ((naked)) __attribute__ ((used)) __attribute__ ((section (".init3")));
+
+// Runs before main(): after a watchdog reset the watchdog stays on, at its shortest
+// timeout, and would fire again in the middle of the startup
+void wdog_early(void) {
+	reset_flags = HAL_RESET_FLAGS;
+	HAL_RESET_FLAGS = 0;
+	wdt_disable();
+}
+
+uint8_t wdog_init(void) {
+	uint8_t warm = (reset_flags & (1 << WDRF)) && !(reset_flags & ((1 << PORF) | (1 << BORF))) && (state_magic == WDOG_MAGIC);
+
+	state_magic = 0; // Until wdog_ready(): a hang during the restart itself gets a cold start
+	wdt_enable(WDOG_TIMEOUT);
+
+	if (!warm) restart_count = 0;
+	else if (restart_count < 0xFF) restart_count++;
+
+	return warm;
+}
+
+void wdog_ready(void) {
+	state_magic = WDOG_MAGIC;
+}
+
+uint8_t wdog_restarts(void) {
+	return restart_count;
+}
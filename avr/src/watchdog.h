@@ -0,0 +1,24 @@
+#ifndef _WATCHDOG_HEADER_
+#define _WATCHDOG_HEADER_
+
+#include <stdint.h>
+#include <avr/wdt.h>
+
+// The watchdog resets the MCU if the main loop stops coming round, e.g. when a
+// keyboard or the host never answers a handshake. The key and lock state live in
+// .noinit (HAL_NOINIT) so that a watchdog reset can take the fast restart path.
+
+// Longer than the slowest thing done in one go: the Amiga reset pulse (600ms), from the PS/2 interrupt
+#define WDOG_TIMEOUT WDTO_1S
+
+// First thing in main(): starts the watchdog. Returns 1 after a watchdog reset
+// that happened once the firmware was up, when the .noinit state can be trusted
+uint8_t wdog_init(void);
+
+void wdog_ready(void); // Initialization done: from now on a watchdog reset takes the fast path
+
+uint8_t wdog_restarts(void); // Fast restarts since power on (saturates at 255)
+
+static inline void wdog_kick(void) { wdt_reset(); } // Once per main loop round
+
+#endif /* _WATCHDOG_HEADER_ */
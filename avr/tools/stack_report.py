@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+#
+# Static RAM budget of the AKAB firmware.
+#
+# Reports the flash usage (.text + .data) against --flash when given, the
+# .data/.bss/.noinit usage of the ELF file and the worst-case stack
+# depth of main() and of every interrupt handler. Frame sizes come from the
+# .su files written by gcc -fstack-usage, the call graph from avr-objdump.
+#
+# Calls through function pointers cannot be seen in the disassembly: they are
+# given with --icall caller=callee (see the Makefile for the defaults). The
+# caller can also be an interrupt vector name, e.g. PCINT1_vect.
+#
+# Usage: stack_report.py --ram BYTES [--flash BYTES] [--objdump avr-objdump] [--icall a=b ...] out/akab.elf src/*.su ...
+
+import argparse
+import re
+import subprocess
+import sys
+
+RET_ADDR = 2 # Bytes pushed by call/rcall and by an interrupt, on parts with up to 128 KB of flash
+
+FUNC_RE = re.compile(r'^[0-9a-f]+ <([^>]+)>:$')
+CALL_RE = re.compile(r'\s(r?call|r?jmp)\s.*<([^>+]+)>')
+ICALL_RE = re.compile(r'\s(e?icall|e?ijmp)\b')
+
+def read_su(paths):
+	frames, sources = {}, {}
+
+	for path in paths:
+		with open(path) as f:
+			for line in f:
+				fields = line.rstrip('\n').split('\t')
+				if len(fields) < 2:
+					continue
+
+				location = fields[0]
+				name = location.split(':')[-1]
+				frames[name] = max(frames.get(name, 0), int(fields[1]))
+				sources[name] = location
+
+	return frames, sources
+
+def read_callgraph(elf, objdump):
+	graph, indirect = {}, set()
+	current = None
+
+	out = subprocess.run([objdump, '-d', elf], check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+	for line in out.splitlines():
+		m = FUNC_RE.match(line)
+		if m:
+			current = m.group(1)
+			graph.setdefault(current, [])
+			continue
+
+		if current is None:
+			continue
+
+		m = CALL_RE.search(line)
+		if m and m.group(2) != current:
+			tail = m.group(1).endswith('jmp') # Tail call: no return address left on the stack
+			graph[current].append((m.group(2), 0 if tail else RET_ADDR))
+		elif ICALL_RE.search(line):
+			indirect.add(current)
+
+	return graph, indirect
+
+def read_sections(elf, size_tool):
+	sections = {}
+
+	out = subprocess.run([size_tool, '-A', elf], check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+	for line in out.splitlines():
+		fields = line.split()
+		if len(fields) >= 2 and fields[0] in ('.text', '.data', '.bss', '.noinit'):
+			sections[fields[0]] = int(fields[1])
+
+	return sections
+
+def isr_name(name, sources):
+	# __vector_N is defined by ISR(XXX_vect): show XXX_vect, read back from the source line
+	location = sources.get(name, '')
+	parts = location.split(':')
+
+	if len(parts) >= 2:
+		try:
+			with open(parts[0]) as f:
+				line = f.readlines()[int(parts[1]) - 1]
+			m = re.search(r'ISR\s*\(\s*(\w+)', line)
+			if m:
+				return m.group(1)
+		except (OSError, IndexError, ValueError):
+			pass
+
+	return name
+
+def depth(name, frames, graph, stack, memo, warnings):
+	if name in memo:
+		return memo[name]
+
+	if name in stack:
+		warnings.add('recursion through %s: depth is not bounded' % name)
+		return 0
+
+	stack.append(name)
+	worst, path = 0, []
+	for callee, ret in graph.get(name, []):
+		callee_depth, callee_path = depth(callee, frames, graph, stack, memo, warnings)
+		if callee_depth + ret > worst:
+			worst, path = callee_depth + ret, callee_path
+	stack.pop()
+
+	if name not in frames and graph.get(name):
+		warnings.add('no stack usage data for %s' % name)
+
+	memo[name] = (frames.get(name, 0) + worst, [name] + path)
+	return memo[name]
+
+def main():
+	parser = argparse.ArgumentParser(description='AKAB static RAM budget')
+	parser.add_argument('--ram', type=int, required=True, help='SRAM size of the MCU, in bytes')
+	parser.add_argument('--flash', type=int, default=0, help='flash size of the MCU, in bytes')
+	parser.add_argument('--mcu', default='', help='MCU name, for the report title')
+	parser.add_argument('--objdump', default='avr-objdump')
+	parser.add_argument('--size', default='avr-size')
+	parser.add_argument('--icall', action='append', default=[], help='caller=callee, for calls through function pointers')
+	parser.add_argument('elf')
+	parser.add_argument('su', nargs='+')
+	args = parser.parse_args()
+
+	frames, sources = read_su(args.su)
+	graph, indirect = read_callgraph(args.elf, args.objdump)
+	sections = read_sections(args.elf, args.size)
+
+	vectors = dict((isr_name(n, sources), n) for n in graph if n.startswith('__vector_'))
+	for pair in args.icall:
+		caller, callee = pair.split('=')
+		caller = vectors.get(caller, caller) # Handlers can be given by vector name, e.g. INT0_vect
+		graph.setdefault(caller, []).append((callee, RET_ADDR))
+		indirect.discard(caller)
+
+	warnings = set('indirect call in %s: pass --icall %s=<callee>' % (f, f) for f in indirect)
+	memo = {}
+
+	static_ram = sum(sections.get(name, 0) for name in ('.data', '.bss', '.noinit'))
+	flash = sections.get('.text', 0) + sections.get('.data', 0) # .data is copied from flash at startup
+	flash_ok = not args.flash or flash <= args.flash
+
+	if args.flash:
+		print('---- Flash budget %s ----' % args.mcu)
+		print('%-8s %5d of %d bytes, %d left' % ('flash', flash, args.flash, args.flash - flash))
+		print()
+
+	print('---- RAM budget %s ----' % args.mcu)
+	for name in ('.data', '.bss', '.noinit'):
+		print('%-8s %5d bytes' % (name, sections.get(name, 0)))
+	print('%-8s %5d of %d bytes' % ('static', static_ram, args.ram))
+	print()
+
+	main_depth, main_path = depth('main', frames, graph, [], memo, warnings)
+	print('%-18s %4d bytes  %s' % ('main', main_depth, ' > '.join(main_path)))
+
+	isr_depths = []
+	for name in sorted(n for n in graph if n.startswith('__vector_') and n in frames):
+		isr_depth, isr_path = depth(name, frames, graph, [], memo, warnings)
+		isr_depth += RET_ADDR
+		isr_depths.append(isr_depth)
+		print('%-18s %4d bytes  %s' % (isr_name(name, sources), isr_depth, ' > '.join(isr_path)))
+
+	isr_depths.sort(reverse=True)
+	worst = main_depth + (isr_depths[0] if isr_depths else 0)
+	nested = main_depth + sum(isr_depths[:2])
+
+	print()
+	print('worst case, main + one handler:    %4d bytes, %4d left' % (worst, args.ram - static_ram - worst))
+	print('worst case, if two handlers nest:  %4d bytes, %4d left' % (nested, args.ram - static_ram - nested))
+
+	for warning in sorted(warnings):
+		print('warning: ' + warning, file=sys.stderr)
+
+	return 0 if args.ram - static_ram - nested >= 0 and flash_ok else 1
+
+if __name__ == '__main__':
+	sys.exit(main())
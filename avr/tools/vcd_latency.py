@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+#
+# Per-stage latency statistics from a VCD capture of the AKAB trace markers
+# (build with 'make TRACE=1', see src/libs/common/trace.h).
+#
+# The capture can come from simavr (the signal names are set by the firmware)
+# or from a logic analyzer: use the --int0/--frame/--conv/--tx/--sync options
+# to give the names of the probes wired to PC0-PC4.
+#
+# Stages:
+#   int0         time spent in the INT0 handler, for every clock edge
+#   frame>conv   valid PS/2 frame to converter start
+#   conv>tx      converter start to the first Amiga clock
+#   tx           eight bits clocked out to the Amiga
+#   tx>sync      end of the transmission to the Amiga handshake
+#   frame>sync   end to end: last PS/2 frame to handshake
+#
+# Usage: vcd_latency.py capture.vcd
+
+import argparse
+import re
+import sys
+
+UNITS = {'s': 1e6, 'ms': 1e3, 'us': 1.0, 'ns': 1e-3, 'ps': 1e-6, 'fs': 1e-9}
+
+def parse_vcd(path, wanted):
+	ids, edges = {}, dict((name, []) for name in wanted)
+	scale = 1e-3 # 1 ns, in microseconds
+	now = 0.0
+	last = {}
+
+	with open(path) as f:
+		text = f.read()
+
+	header, _, body = text.partition('$enddefinitions')
+
+	m = re.search(r'\$timescale\s+(\d+)\s*(\w+)\s+\$end', header)
+	if m:
+		scale = int(m.group(1)) * UNITS[m.group(2)]
+
+	for m in re.finditer(r'\$var\s+\S+\s+\d+\s+(\S+)\s+(\S+)(?:\s+\[[^\]]*\])?\s+\$end', header):
+		ident, name = m.group(1), m.group(2)
+		if name in wanted:
+			ids[ident] = name
+
+	missing = set(wanted) - set(ids.values())
+	if missing:
+		sys.exit('signals not found in %s: %s' % (path, ', '.join(sorted(missing))))
+
+	tokens = body.split()[1:] # Skip the $end closing $enddefinitions
+	idx = 0
+	while idx < len(tokens):
+		token = tokens[idx]
+		idx += 1
+
+		if token[0] == '#':
+			now = int(token[1:]) * scale
+			continue
+
+		if token[0] in 'bB': # Vector value, identifier in the next token: keep the lowest bit
+			if idx >= len(tokens):
+				break
+			value, ident = token[-1], tokens[idx]
+			idx += 1
+		elif token[0] in '01xXzZ':
+			value, ident = token[0], token[1:]
+		else:
+			continue
+
+		if ident not in ids:
+			continue
+
+		name = ids[ident]
+		if last.get(name) != value:
+			if name in last:
+				edges[name].append((now, value))
+			last[name] = value
+
+	return edges
+
+def next_after(times, t, start=0):
+	# Index of the first time >= t, searching from start
+	idx = start
+	while idx < len(times) and times[idx] < t:
+		idx += 1
+	return idx
+
+def pair_stage(starts, ends):
+	# For every start, the first end that follows it, before the next start
+	samples = []
+	j = 0
+	for i, t in enumerate(starts):
+		j = next_after(ends, t, j)
+		if j >= len(ends):
+			break
+		if i + 1 < len(starts) and ends[j] > starts[i + 1]:
+			continue
+		samples.append(ends[j] - t)
+	return samples
+
+def stats(samples):
+	if not samples:
+		return None
+
+	ordered = sorted(samples)
+	pick = lambda q: ordered[min(len(ordered) - 1, int(q * len(ordered)))]
+
+	return (len(ordered), ordered[0], sum(ordered) / len(ordered), pick(0.5), pick(0.99), ordered[-1])
+
+def main():
+	parser = argparse.ArgumentParser(description='AKAB trace marker latencies')
+	parser.add_argument('--int0', default='int0')
+	parser.add_argument('--frame', default='frame')
+	parser.add_argument('--conv', default='conv')
+	parser.add_argument('--tx', default='tx')
+	parser.add_argument('--sync', default='sync')
+	parser.add_argument('vcd')
+	args = parser.parse_args()
+
+	names = [args.int0, args.frame, args.conv, args.tx, args.sync]
+	edges = parse_vcd(args.vcd, names)
+
+	rising = lambda name: [t for t, v in edges[name] if v == '1']
+	falling = lambda name: [t for t, v in edges[name] if v == '0']
+	toggles = lambda name: [t for t, v in edges[name]]
+
+	frame, conv, sync = toggles(args.frame), toggles(args.conv), toggles(args.sync)
+	tx_start, tx_end = rising(args.tx), falling(args.tx)
+
+	stages = [
+		('int0', pair_stage(rising(args.int0), falling(args.int0))),
+		('frame>conv', pair_stage(frame, conv)),
+		('conv>tx', pair_stage(conv, tx_start)),
+		('tx', pair_stage(tx_start, tx_end)),
+		('tx>sync', pair_stage(tx_end, sync)),
+		('frame>sync', pair_stage(frame, sync)),
+	]
+
+	print('%-12s %7s %10s %10s %10s %10s %10s' % ('stage (us)', 'count', 'min', 'mean', 'p50', 'p99', 'max'))
+	for name, samples in stages:
+		result = stats(samples)
+		if result is None:
+			print('%-12s %7d' % (name, 0))
+		else:
+			print('%-12s %7d %10.1f %10.1f %10.1f %10.1f %10.1f' % ((name,) + result))
+
+	return 0
+
+if __name__ == '__main__':
+	sys.exit(main())
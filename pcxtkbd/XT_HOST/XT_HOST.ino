@@ -0,0 +1,146 @@
+// PC/XT host stand-in, to test the XT_KEYBOARD adapter without an XT.
+// Runs on a second Arduino Uno/Nano; received codes and events go to the serial monitor (115200 baud).
+//
+// Wiring: host pin 2 -> adapter pin 3 (XT clock), host pin 4 -> adapter pin 8 (XT data), GND -> GND.
+//
+// Serial commands:
+//   r  reset: hold the clock low for 20ms like the XT BIOS, then time the 0xAA answer
+//   i  inhibit on/off: hold the clock low, the adapter must keep its codes until released
+//   b  busy handshake on/off: hold data low after each byte until it has been printed, like the XT
+//   s  statistics
+
+#define xt_clk 2  // INT0
+#define xt_data 4
+
+#define RESET_HOLD_MS 20
+#define SELFTEST_TIMEOUT_MS 500
+#define FRAME_GAP_US 1000 // Longer without a clock edge: the next edge starts a new frame
+
+#define RX_SIZE 32 // Must be a power of two
+
+static volatile byte rx[RX_SIZE];
+static volatile byte rx_in, rx_out;
+
+static volatile byte edges, shift;
+static volatile unsigned long last_edge;
+static volatile unsigned int frames, short_frames, overruns;
+
+static volatile bool driving; // We hold the clock low: edges are our own
+static bool inhibit, busy;
+
+static unsigned long reset_ms;
+static bool reset_pending;
+
+static void clk_low() { driving = true; digitalWrite(xt_clk, LOW); pinMode(xt_clk, OUTPUT); }
+static void clk_release() { pinMode(xt_clk, INPUT_PULLUP); driving = false; }
+static void dat_low() { digitalWrite(xt_data, LOW); pinMode(xt_data, OUTPUT); }
+static void dat_release() { pinMode(xt_data, INPUT_PULLUP); }
+
+// Falling clock edge: two start edges, then 8 data bits LSB first, data valid while the clock falls
+static void clock_fall()
+{
+  unsigned long now = micros();
+
+  if (driving) return;
+
+  if (now - last_edge > FRAME_GAP_US) {
+    if (edges) short_frames++;
+    edges = 0;
+  }
+  last_edge = now;
+
+  if (++edges <= 2) return;
+
+  shift >>= 1;
+  if (digitalRead(xt_data)) shift |= 0x80;
+
+  if (edges == 10) {
+    byte next = (rx_in + 1) & (RX_SIZE - 1);
+
+    if (next != rx_out) {
+      rx[rx_in] = shift;
+      rx_in = next;
+    } else overruns++;
+    frames++;
+    edges = 0;
+    if (busy) dat_low(); // Released in loop() once the byte is printed
+  }
+}
+
+static void print_hex(byte value)
+{
+  if (value < 0x10) Serial.print('0');
+  Serial.print(value, HEX);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  clk_release();
+  dat_release();
+  attachInterrupt(digitalPinToInterrupt(xt_clk), clock_fall, FALLING);
+  Serial.println(F("XT host stand-in: r reset, i inhibit, b busy handshake, s stats"));
+}
+
+void loop()
+{
+  while (rx_out != rx_in) {
+    byte value = rx[rx_out];
+
+    rx_out = (rx_out + 1) & (RX_SIZE - 1);
+    Serial.print(F("RX "));
+    print_hex(value);
+    if (reset_pending && value == 0xAA) {
+      Serial.print(F("  self test OK after "));
+      Serial.print(millis() - reset_ms);
+      Serial.print(F(" ms"));
+      reset_pending = false;
+    }
+    Serial.println();
+  }
+  if (busy && rx_out == rx_in) dat_release();
+
+  if (reset_pending && millis() - reset_ms > SELFTEST_TIMEOUT_MS) {
+    Serial.println(F("ERR no 0xAA after reset"));
+    reset_pending = false;
+  }
+
+  if (!Serial.available()) return;
+
+  switch (Serial.read()) {
+    case 'r':
+      clk_low();
+      delay(RESET_HOLD_MS);
+      edges = 0;
+      clk_release();
+      reset_ms = millis();
+      reset_pending = true;
+      Serial.println(F("reset"));
+      break;
+
+    case 'i':
+      inhibit = !inhibit;
+      if (inhibit) clk_low();
+      else {
+        edges = 0;
+        clk_release();
+      }
+      Serial.println(inhibit ? F("inhibit on") : F("inhibit off"));
+      break;
+
+    case 'b':
+      busy = !busy;
+      if (!busy) dat_release();
+      Serial.println(busy ? F("busy handshake on") : F("busy handshake off"));
+      break;
+
+    case 's':
+      Serial.print(F("frames "));
+      Serial.print(frames);
+      Serial.print(F(", short "));
+      Serial.print(short_frames);
+      Serial.print(F(", overruns "));
+      Serial.println(overruns);
+      break;
+  }
+}
@@ -0,0 +1,60 @@
+#include <Arduino.h>
+
+#include "xt_log.h"
+
+#if XT_LOG_LEVEL > XT_LOG_OFF
+
+#define XT_LOG_RECORD 4
+
+static uint8_t buffer[XT_LOG_SIZE];
+static uint8_t b_in, b_out;
+static uint16_t dropped;
+
+static inline uint8_t log_free() {
+  return (uint8_t)(b_out - b_in - 1) & (XT_LOG_SIZE - 1);
+}
+
+static void log_put(uint8_t event, uint16_t value) {
+  buffer[b_in] = XT_LOG_SYNC;
+  buffer[(b_in + 1) & (XT_LOG_SIZE - 1)] = event;
+  buffer[(b_in + 2) & (XT_LOG_SIZE - 1)] = value & 0xFF;
+  buffer[(b_in + 3) & (XT_LOG_SIZE - 1)] = value >> 8;
+  b_in = (b_in + XT_LOG_RECORD) & (XT_LOG_SIZE - 1);
+}
+
+void xt_log_begin() {
+  b_in = b_out = 0;
+  dropped = 0;
+  Serial.begin(XT_LOG_BAUD);
+}
+
+// Called from loop() only, not from interrupts
+void xt_log_event(uint8_t event, uint16_t value) {
+  if (dropped) { // Report the loss first, in the slot this record would have used
+    if (log_free() < 2 * XT_LOG_RECORD) {
+      if (dropped != 0xFFFF) dropped++;
+      return;
+    }
+    log_put(XT_EV_DROPPED, dropped);
+    dropped = 0;
+  }
+
+  if (log_free() < XT_LOG_RECORD) {
+    dropped = 1;
+    return;
+  }
+
+  log_put(event, value);
+}
+
+void xt_log_poll() {
+  int room = Serial.availableForWrite();
+
+  while (room > 0 && b_out != b_in) {
+    Serial.write(buffer[b_out]);
+    b_out = (b_out + 1) & (XT_LOG_SIZE - 1);
+    room--;
+  }
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef XT_LOG_H
+#define XT_LOG_H
+
+#include <stdint.h>
+
+// Compact binary event log.
+// Events go into a RAM ring buffer and are copied to the serial port from loop()
+// only as far as the UART TX buffer has room, so logging never waits on 9600 baud.
+// Each record is 4 bytes: XT_LOG_SYNC, event, value low byte, value high byte.
+//
+// XT_LOG_LEVEL selects what is compiled in:
+//   XT_LOG_OFF   (0) nothing, all log calls compile to nothing (default)
+//   XT_LOG_ERROR (1) errors only
+//   XT_LOG_INFO  (2) errors and every key event
+// Set it here or with a build flag: the sketch files are compiled separately,
+// a #define in the .ino does not reach xt_log.cpp.
+
+#define XT_LOG_OFF   0
+#define XT_LOG_ERROR 1
+#define XT_LOG_INFO  2
+
+#ifndef XT_LOG_LEVEL
+#define XT_LOG_LEVEL XT_LOG_OFF
+#endif
+
+#define XT_LOG_BAUD      115200
+#define XT_LOG_SIZE      64 // Bytes, must be a power of two
+#define XT_LOG_SYNC      0xA5
+
+// Events
+#define XT_EV_KEY        0x01 // PS2KeyAdvanced code, status bits in the high byte
+#define XT_EV_UNMAPPED   0x02 // Key without an XT code
+#define XT_EV_SELFTEST   0x03 // Host reset, 0xAA queued
+#define XT_EV_ABORT      0x04 // Host cut a frame short, it is sent again
+#define XT_EV_TX_DROP    0x05 // Host not ready for XT_HOST_TIMEOUT_MS, code lost (value: the code)
+#define XT_EV_DROPPED    0x7F // Records lost to a full buffer since the last one
+
+#if XT_LOG_LEVEL > XT_LOG_OFF
+void xt_log_begin();
+void xt_log_event(uint8_t event, uint16_t value); // Never blocks: drops the record if the buffer is full
+void xt_log_poll();                               // From loop(): moves what fits into the UART
+#define XT_LOG_BEGIN() xt_log_begin()
+#define XT_LOG_POLL()  xt_log_poll()
+#else
+#define XT_LOG_BEGIN() do { } while (0)
+#define XT_LOG_POLL()  do { } while (0)
+#endif
+
+#if XT_LOG_LEVEL >= XT_LOG_ERROR
+#define XT_LOG_ERR(event, value) xt_log_event((event), (value))
+#else
+#define XT_LOG_ERR(event, value) do { } while (0)
+#endif
+
+#if XT_LOG_LEVEL >= XT_LOG_INFO
+#define XT_LOG_INF(event, value) xt_log_event((event), (value))
+#else
+#define XT_LOG_INF(event, value) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef XT_TABLE_H
+#define XT_TABLE_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include <PS2KeyAdvanced.h>
+
+// PS2KeyAdvanced key code -> PC/XT scan code, built by the compiler into flash.
+// Each entry is the XT make code in bits 0-6; XT_EXT (bit 7) means the code
+// goes out with an E0 prefix. 0 means the key has no XT equivalent.
+// The break code is the make code with bit 7 set, for plain and E0 keys alike.
+
+#define XT_EXT 0x80
+
+constexpr uint8_t xt_map(uint8_t k) {
+  return
+    k == PS2_KEY_ESC      ? 0x01 :
+    k == PS2_KEY_1        ? 0x02 :
+    k == PS2_KEY_2        ? 0x03 :
+    k == PS2_KEY_3        ? 0x04 :
+    k == PS2_KEY_4        ? 0x05 :
+    k == PS2_KEY_5        ? 0x06 :
+    k == PS2_KEY_6        ? 0x07 :
+    k == PS2_KEY_7        ? 0x08 :
+    k == PS2_KEY_8        ? 0x09 :
+    k == PS2_KEY_9        ? 0x0A :
+    k == PS2_KEY_0        ? 0x0B :
+    k == PS2_KEY_MINUS    ? 0x0C :
+    k == PS2_KEY_EQUAL    ? 0x0D :
+    k == PS2_KEY_BS       ? 0x0E :
+    k == PS2_KEY_TAB      ? 0x0F :
+    k == PS2_KEY_Q        ? 0x10 :
+    k == PS2_KEY_W        ? 0x11 :
+    k == PS2_KEY_E        ? 0x12 :
+    k == PS2_KEY_R        ? 0x13 :
+    k == PS2_KEY_T        ? 0x14 :
+    k == PS2_KEY_Y        ? 0x15 :
+    k == PS2_KEY_U        ? 0x16 :
+    k == PS2_KEY_I        ? 0x17 :
+    k == PS2_KEY_O        ? 0x18 :
+    k == PS2_KEY_P        ? 0x19 :
+    k == PS2_KEY_OPEN_SQ  ? 0x1A :
+    k == PS2_KEY_CLOSE_SQ ? 0x1B :
+    k == PS2_KEY_ENTER    ? 0x1C :
+    k == PS2_KEY_L_CTRL   ? 0x1D :
+    k == PS2_KEY_A        ? 0x1E :
+    k == PS2_KEY_S        ? 0x1F :
+    k == PS2_KEY_D        ? 0x20 :
+    k == PS2_KEY_F        ? 0x21 :
+    k == PS2_KEY_G        ? 0x22 :
+    k == PS2_KEY_H        ? 0x23 :
+    k == PS2_KEY_J        ? 0x24 :
+    k == PS2_KEY_K        ? 0x25 :
+    k == PS2_KEY_L        ? 0x26 :
+    k == PS2_KEY_SEMI     ? 0x27 :
+    k == PS2_KEY_APOS     ? 0x28 :
+    k == PS2_KEY_SINGLE   ? 0x29 :
+    k == PS2_KEY_L_SHIFT  ? 0x2A :
+    k == PS2_KEY_BACK     ? 0x2B :
+    k == PS2_KEY_Z        ? 0x2C :
+    k == PS2_KEY_X        ? 0x2D :
+    k == PS2_KEY_C        ? 0x2E :
+    k == PS2_KEY_V        ? 0x2F :
+    k == PS2_KEY_B        ? 0x30 :
+    k == PS2_KEY_N        ? 0x31 :
+    k == PS2_KEY_M        ? 0x32 :
+    k == PS2_KEY_COMMA    ? 0x33 :
+    k == PS2_KEY_DOT      ? 0x34 :
+    k == PS2_KEY_DIV      ? 0x35 :
+    k == PS2_KEY_R_SHIFT  ? 0x36 :
+    k == PS2_KEY_KP_TIMES ? 0x37 :
+    k == PS2_KEY_L_ALT    ? 0x38 :
+    k == PS2_KEY_SPACE    ? 0x39 :
+    k == PS2_KEY_CAPS     ? 0x3A :
+    k == PS2_KEY_F1       ? 0x3B :
+    k == PS2_KEY_F2       ? 0x3C :
+    k == PS2_KEY_F3       ? 0x3D :
+    k == PS2_KEY_F4       ? 0x3E :
+    k == PS2_KEY_F5       ? 0x3F :
+    k == PS2_KEY_F6       ? 0x40 :
+    k == PS2_KEY_F7       ? 0x41 :
+    k == PS2_KEY_F8       ? 0x42 :
+    k == PS2_KEY_F9       ? 0x43 :
+    k == PS2_KEY_F10      ? 0x44 :
+    k == PS2_KEY_NUM      ? 0x45 :
+    k == PS2_KEY_SCROLL   ? 0x46 :
+    k == PS2_KEY_KP7      ? 0x47 :
+    k == PS2_KEY_KP8      ? 0x48 :
+    k == PS2_KEY_KP9      ? 0x49 :
+    k == PS2_KEY_KP_MINUS ? 0x4A :
+    k == PS2_KEY_KP4      ? 0x4B :
+    k == PS2_KEY_KP5      ? 0x4C :
+    k == PS2_KEY_KP6      ? 0x4D :
+    k == PS2_KEY_KP_PLUS  ? 0x4E :
+    k == PS2_KEY_KP1      ? 0x4F :
+    k == PS2_KEY_KP2      ? 0x50 :
+    k == PS2_KEY_KP3      ? 0x51 :
+    k == PS2_KEY_KP0      ? 0x52 :
+    k == PS2_KEY_KP_DOT   ? 0x53 :
+    k == PS2_KEY_F11      ? 0x57 :
+    k == PS2_KEY_F12      ? 0x58 :
+    k == PS2_KEY_PAUSE    ? 0x5F :
+    // Enhanced keyboard keys: E0 prefix
+    k == PS2_KEY_KP_ENTER ? (XT_EXT | 0x1C) :
+    k == PS2_KEY_R_CTRL   ? (XT_EXT | 0x1D) :
+    k == PS2_KEY_KP_DIV   ? (XT_EXT | 0x35) :
+    k == PS2_KEY_PRTSCR   ? (XT_EXT | 0x37) :
+    k == PS2_KEY_R_ALT    ? (XT_EXT | 0x38) :
+    k == PS2_KEY_HOME     ? (XT_EXT | 0x47) :
+    k == PS2_KEY_UP_ARROW ? (XT_EXT | 0x48) :
+    k == PS2_KEY_PGUP     ? (XT_EXT | 0x49) :
+    k == PS2_KEY_L_ARROW  ? (XT_EXT | 0x4B) :
+    k == PS2_KEY_R_ARROW  ? (XT_EXT | 0x4D) :
+    k == PS2_KEY_END      ? (XT_EXT | 0x4F) :
+    k == PS2_KEY_DN_ARROW ? (XT_EXT | 0x50) :
+    k == PS2_KEY_PGDN     ? (XT_EXT | 0x51) :
+    k == PS2_KEY_INSERT   ? (XT_EXT | 0x52) :
+    k == PS2_KEY_DELETE   ? (XT_EXT | 0x53) :
+    0;
+}
+
+// loop() takes the XT break bit straight from the PS2KeyAdvanced status byte
+static_assert(PS2_BREAK == 0x8000, "XT break bit is taken from PS2_BREAK >> 8");
+
+static_assert(xt_map(PS2_KEY_KP_ENTER) == (XT_EXT | 0x1C), "Keypad Enter is E0 1C, not Esc");
+static_assert(xt_map(PS2_KEY_SINGLE) == 0x29, "Back quote is 0x29");
+static_assert(xt_map(PS2_KEY_L_CTRL) == 0x1D && xt_map(PS2_KEY_R_CTRL) == (XT_EXT | 0x1D), "Left Ctrl is plain, right Ctrl is E0");
+static_assert(xt_map(PS2_KEY_KP4) == 0x4B && xt_map(PS2_KEY_L_ARROW) == (XT_EXT | 0x4B), "Keypad and arrow keys differ only by E0");
+
+#define XT_T4(n)   xt_map(n), xt_map((n) + 1), xt_map((n) + 2), xt_map((n) + 3)
+#define XT_T16(n)  XT_T4(n), XT_T4((n) + 4), XT_T4((n) + 8), XT_T4((n) + 12)
+#define XT_T64(n)  XT_T16(n), XT_T16((n) + 16), XT_T16((n) + 32), XT_T16((n) + 48)
+
+const uint8_t translationTable[256] PROGMEM = {
+  XT_T64(0), XT_T64(64), XT_T64(128), XT_T64(192)
+};
+
+#endif
@@ -0,0 +1,318 @@
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "xt_tx.h"
+
+// XT frame, as sent by the original keyboard:
+//   clock low 120us with data high, clock high 66us, clock low 30us (start)
+//   8 data bits, LSB first: data set with clock going high, 66us high, 30us low
+//   clock high, data low, at least 1ms before the next frame
+
+#define XT_CLK_PORT PORTD
+#define XT_CLK_DDR  DDRD
+#define XT_CLK_PIN  PIND
+#define XT_CLK_BIT  3
+#define XT_DAT_PORT PORTB
+#define XT_DAT_DDR  DDRB
+#define XT_DAT_PIN  PINB
+#define XT_DAT_BIT  0
+
+#define XT_TIMER_PRESCALER 8
+#define XT_TICKS(us) ((uint8_t)((us) * (F_CPU / XT_TIMER_PRESCALER / 1000000UL) - 1))
+
+#if (120 * (F_CPU / XT_TIMER_PRESCALER / 1000000UL)) > 256
+#error "XT start pulse does not fit Timer2 at this F_CPU"
+#endif
+
+#define XT_START_LOW_US  120
+#define XT_START_HIGH_US 66
+#define XT_START2_LOW_US 30
+#define XT_BIT_HIGH_US   66
+#define XT_BIT_LOW_US    30
+#define XT_GAP_STEP_US   125
+#define XT_GAP_STEPS     8 // 1ms between frames
+
+// Open drain: release goes through hi-Z before the pull-up, low through hi-Z before driving
+#define CLK_LOW()     do { XT_CLK_PORT &= ~_BV(XT_CLK_BIT); XT_CLK_DDR |= _BV(XT_CLK_BIT); } while (0)
+#define CLK_RELEASE() do { XT_CLK_DDR &= ~_BV(XT_CLK_BIT); XT_CLK_PORT |= _BV(XT_CLK_BIT); } while (0)
+#define DAT_LOW()     do { XT_DAT_PORT &= ~_BV(XT_DAT_BIT); XT_DAT_DDR |= _BV(XT_DAT_BIT); } while (0)
+#define DAT_RELEASE() do { XT_DAT_DDR &= ~_BV(XT_DAT_BIT); XT_DAT_PORT |= _BV(XT_DAT_BIT); } while (0)
+#define CLK_IS_HIGH() (XT_CLK_PIN & _BV(XT_CLK_BIT))
+#define DAT_IS_HIGH() (XT_DAT_PIN & _BV(XT_DAT_BIT))
+#define HOST_READY()  (CLK_IS_HIGH() && DAT_IS_HIGH()) // The host holds data low until it has read the last byte
+
+enum {
+  XT_IDLE,
+  XT_START_LOW,
+  XT_START_HIGH,
+  XT_START2_LOW,
+  XT_BIT_HIGH,
+  XT_BIT_LOW,
+  XT_GAP
+};
+
+static volatile uint8_t queue[XT_TX_QUEUE_SIZE];
+static volatile uint8_t q_in, q_out;
+
+// Host side of the clock, followed from xt_tx_poll()
+enum {
+  HOST_IDLE,     // Clock released: frames may go out
+  HOST_LOW,      // Clock held low: inhibit, or the start of a reset
+  HOST_RESET,    // Held past XT_RESET_MS, waiting for the release
+  HOST_SELFTEST  // Released after a reset, 0xAA goes out after XT_SELFTEST_MS
+};
+
+static volatile uint8_t phase = XT_IDLE;
+static uint8_t shift, bits, gap;
+
+static uint8_t host = HOST_IDLE;
+static unsigned long host_ms;
+static volatile bool stalled; // No room for XT_HOST_TIMEOUT_MS: codes are dropped until a frame goes out again. Cleared by the ISR
+static bool waiting; // xt_tx_ready() found no room...
+static uint8_t wait_out; // ... with q_out here...
+static unsigned long wait_ms; // ... since then
+static volatile uint8_t events;
+
+static void post_event(uint8_t ev) { // From loop(); the ISR sets events directly
+  noInterrupts();
+  events |= ev;
+  interrupts();
+}
+
+static inline void timer_start(uint8_t ticks) {
+  TCNT2 = 0;
+  OCR2A = ticks;
+  TIFR2 = _BV(OCF2A);
+  TIMSK2 |= _BV(OCIE2A);
+}
+
+static inline void timer_next(uint8_t ticks) {
+  OCR2A = ticks; // CTC: the counter restarted from 0 on this match
+}
+
+static inline void timer_stop() {
+  TIMSK2 &= ~_BV(OCIE2A);
+}
+
+void xt_tx_begin() {
+  CLK_RELEASE();
+  DAT_RELEASE();
+
+  q_in = q_out = 0;
+  phase = XT_IDLE;
+  host = HOST_IDLE;
+  stalled = false;
+  waiting = false;
+  events = 0;
+
+  TCCR2A = _BV(WGM21); // CTC
+  TCCR2B = _BV(CS21);  // clk/8
+  TIMSK2 &= ~_BV(OCIE2A);
+}
+
+bool xt_tx_put(uint8_t value) {
+  uint8_t next = (q_in + 1) & (XT_TX_QUEUE_SIZE - 1);
+
+  if (next == q_out) return false;
+
+  queue[q_in] = value;
+  q_in = next;
+  return true;
+}
+
+static uint8_t xt_tx_room() {
+  return (q_out - q_in - 1) & (XT_TX_QUEUE_SIZE - 1);
+}
+
+// Never waits: loop() holds the next key back (it stays in the PS/2 buffer) until there is room,
+// and only takes it to drop it once no frame has gone out for XT_HOST_TIMEOUT_MS
+bool xt_tx_ready(uint8_t count) {
+  unsigned long now;
+
+  if (xt_tx_room() >= count) {
+    waiting = false;
+    return true;
+  }
+  if (stalled) return true;
+
+  now = millis();
+  if (!waiting || wait_out != q_out) { // The host took a byte since: the wait starts again
+    waiting = true;
+    wait_out = q_out;
+    wait_ms = now;
+  } else if (now - wait_ms >= XT_HOST_TIMEOUT_MS) {
+    stalled = true;
+  }
+
+  return stalled;
+}
+
+bool xt_tx_write(uint8_t value) {
+  if (xt_tx_put(value)) return true;
+
+  post_event(XT_TX_EV_DROP);
+  return false;
+}
+
+bool xt_tx_busy() {
+  return phase != XT_IDLE || q_in != q_out;
+}
+
+bool xt_tx_active() {
+  return phase != XT_IDLE;
+}
+
+uint8_t xt_tx_events() {
+  uint8_t ev;
+
+  noInterrupts();
+  ev = events;
+  events = 0;
+  interrupts();
+  return ev;
+}
+
+// Starts a frame if there is something to send. Called with interrupts disabled.
+// The byte stays in the queue until the frame is complete, so an aborted frame is sent again.
+static void xt_tx_start() {
+  if (q_in == q_out || !HOST_READY()) { // Nothing to do, or the host is not ready
+    phase = XT_IDLE;
+    timer_stop();
+    return;
+  }
+
+  shift = queue[q_out];
+  bits = 8;
+  stalled = false;
+
+  CLK_LOW();
+  DAT_RELEASE();
+  phase = XT_START_LOW;
+  timer_start(XT_TICKS(XT_START_LOW_US));
+}
+
+static void xt_tx_flush() {
+  noInterrupts();
+  q_out = q_in;
+  stalled = false;
+  interrupts();
+}
+
+void xt_tx_poll() {
+  unsigned long now;
+
+  if (phase != XT_IDLE) return; // Our frame; the ISR notices the host pulling the clock low
+
+  now = millis();
+  switch (host) {
+    case HOST_IDLE:
+      if (!CLK_IS_HIGH()) {
+        host = HOST_LOW;
+        host_ms = now;
+      }
+      break;
+
+    case HOST_LOW:
+      if (CLK_IS_HIGH()) host = HOST_IDLE; // Just an inhibit, the queue goes out now
+      else if (now - host_ms >= XT_RESET_MS) {
+        xt_tx_flush();
+        host = HOST_RESET;
+      }
+      break;
+
+    case HOST_RESET:
+      if (CLK_IS_HIGH()) {
+        xt_tx_flush(); // Keys pressed during the reset are not reported
+        host = HOST_SELFTEST;
+        host_ms = now;
+      }
+      break;
+
+    case HOST_SELFTEST:
+      if (!CLK_IS_HIGH()) {
+        host = HOST_LOW;
+        host_ms = now;
+      } else if (now - host_ms > XT_SELFTEST_MS) { // millis() may have ticked just after the release
+        xt_tx_flush(); // Nor those pressed during the self test: 0xAA goes first
+        xt_tx_put(0xAA);
+        post_event(XT_TX_EV_RESET);
+        host = HOST_IDLE;
+      }
+      break;
+  }
+
+  if (host != HOST_IDLE || q_in == q_out) return;
+
+  noInterrupts();
+  if (phase == XT_IDLE) xt_tx_start();
+  interrupts();
+}
+
+// The host pulled the clock low while we had it released: give up the frame, the byte is still queued
+static inline bool xt_tx_aborted() {
+  if (CLK_IS_HIGH()) return false;
+
+  DAT_RELEASE();
+  phase = XT_IDLE;
+  timer_stop();
+  events |= XT_TX_EV_ABORT;
+  return true;
+}
+
+ISR(TIMER2_COMPA_vect) {
+  switch (phase) {
+    case XT_START_LOW:
+      CLK_RELEASE();
+      phase = XT_START_HIGH;
+      timer_next(XT_TICKS(XT_START_HIGH_US));
+      break;
+
+    case XT_START_HIGH:
+      if (xt_tx_aborted()) break;
+      CLK_LOW();
+      phase = XT_START2_LOW;
+      timer_next(XT_TICKS(XT_START2_LOW_US));
+      break;
+
+    case XT_START2_LOW:
+    case XT_BIT_LOW:
+      if (bits) { // Data first, then the clock edge
+        if (shift & 1) DAT_RELEASE();
+        else DAT_LOW();
+        shift >>= 1;
+        bits--;
+
+        CLK_RELEASE();
+        phase = XT_BIT_HIGH;
+        timer_next(XT_TICKS(XT_BIT_HIGH_US));
+      } else {
+        q_out = (q_out + 1) & (XT_TX_QUEUE_SIZE - 1); // Sent
+        CLK_RELEASE();
+        DAT_LOW();
+        gap = XT_GAP_STEPS;
+        phase = XT_GAP;
+        timer_next(XT_TICKS(XT_GAP_STEP_US));
+      }
+      break;
+
+    case XT_BIT_HIGH:
+      if (xt_tx_aborted()) break;
+      CLK_LOW();
+      phase = XT_BIT_LOW;
+      timer_next(XT_TICKS(XT_BIT_LOW_US));
+      break;
+
+    case XT_GAP:
+      if (--gap == 1) DAT_RELEASE(); // One step early, so the data line is up when xt_tx_start() reads it
+      if (gap) break;
+
+      xt_tx_start(); // Back to back if more bytes are queued
+      break;
+
+    default:
+      phase = XT_IDLE;
+      timer_stop();
+      break;
+  }
+}
@@ -0,0 +1,39 @@
+#ifndef XT_TX_H
+#define XT_TX_H
+
+#include <stdint.h>
+
+// Interrupt driven PC/XT keyboard transmitter.
+// Timer2 compare match steps through the frame, the lines are written
+// directly on the ports, open drain style (driven low or released with pull-up):
+//   XT clock on Arduino pin 3 (PD3), XT data on Arduino pin 8 (PB0).
+// Bytes are queued, so loop() keeps polling the PS/2 side while they go out.
+// Nothing here waits for the host: loop() asks xt_tx_ready() before it takes a key.
+//
+// The host may pull the clock low at any time:
+//   - shorter than XT_RESET_MS: inhibit, queued bytes wait (a frame cut short is sent again)
+// Frames also wait while the host holds data low (it has not read the last byte yet).
+//   - XT_RESET_MS or longer: reset, the queue is flushed and 0xAA (self test passed)
+//     goes out XT_SELFTEST_MS after the host releases the clock
+
+#define XT_TX_QUEUE_SIZE 16 // Must be a power of two
+
+#define XT_RESET_MS        12  // The XT BIOS holds the clock low for 20ms
+#define XT_SELFTEST_MS     10
+#define XT_HOST_TIMEOUT_MS 250 // No frame out for this long with the queue full: codes are dropped
+
+// xt_tx_events() flags
+#define XT_TX_EV_RESET 0x01 // Host reset seen, 0xAA queued
+#define XT_TX_EV_ABORT 0x02 // Frame cut short by the host, will be sent again
+#define XT_TX_EV_DROP  0x04 // xt_tx_write() found no room, byte lost
+
+void xt_tx_begin();
+bool xt_tx_put(uint8_t value);   // false if the queue is full
+bool xt_tx_ready(uint8_t count); // Room for count bytes, or the host took none for XT_HOST_TIMEOUT_MS (writes drop)
+bool xt_tx_write(uint8_t value); // Never waits, false if the byte was dropped
+bool xt_tx_busy();               // A frame is on the wire, or bytes are waiting
+bool xt_tx_active();             // We are driving the lines right now
+void xt_tx_poll();               // From loop(): follows the host clock, starts the next frame when it is released
+uint8_t xt_tx_events();          // XT_TX_EV_* seen since the last call
+
+#endif